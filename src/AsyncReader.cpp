@@ -0,0 +1,633 @@
+#include "config.h"
+#include "AsyncReader.h"
+#include "Streams.h"
+#include <deque>
+#include <string>
+#include <stdexcept>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_array.hpp>
+
+#ifdef ARX_LINUX
+#  include <sys/syscall.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#  include <cerrno>
+#  include <cstring>
+#  if defined(__NR_io_uring_setup) && defined(__has_include)
+#    if __has_include(<linux/io_uring.h>)
+#      include <linux/io_uring.h>
+#      ifdef IORING_FEAT_RW_CUR_POS // IORING_OP_READ appeared in the same kernel
+#        define ASYNCREADER_IO_URING
+#      endif
+#    endif
+#  endif
+#endif
+
+using namespace std;
+using namespace boost;
+using namespace arx;
+
+static bool readerMemoryMapped = false;
+
+namespace detail {
+#ifdef ASYNCREADER_IO_URING
+// -------------------------------------------------------------------------- //
+// IoRing
+// -------------------------------------------------------------------------- //
+  /**
+   * IoRing is a minimal io_uring wrapper that only queues reads and waits for
+   * their completions. liburing is not used, it's not installed everywhere.
+   */
+  class IoRing: private noncopyable {
+  private:
+    int fd;
+    void* sqRing;
+    size_t sqRingSize;
+    void* cqRing;
+    size_t cqRingSize;
+    io_uring_sqe* sqes;
+    size_t sqesSize;
+    unsigned* sqTail;
+    unsigned* sqArray;
+    unsigned sqMask;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned cqMask;
+    io_uring_cqe* cqes;
+    uint32 unsubmitted;
+
+    static unsigned* at(void* ring, unsigned offset) {
+      return (unsigned*) ((char*) ring + offset);
+    }
+
+    int enter(unsigned toSubmit, unsigned minComplete, unsigned flags) {
+      return (int) syscall(__NR_io_uring_enter, this->fd, toSubmit, minComplete, flags, NULL, 0);
+    }
+
+  public:
+    IoRing(): fd(-1), sqRing(MAP_FAILED), cqRing(MAP_FAILED), sqes((io_uring_sqe*) MAP_FAILED), unsubmitted(0) {
+      return;
+    }
+
+    ~IoRing() {
+      if(this->sqes != MAP_FAILED)
+        munmap(this->sqes, this->sqesSize);
+      if(this->cqRing != MAP_FAILED && this->cqRing != this->sqRing)
+        munmap(this->cqRing, this->cqRingSize);
+      if(this->sqRing != MAP_FAILED)
+        munmap(this->sqRing, this->sqRingSize);
+      if(this->fd != -1)
+        ::close(this->fd);
+    }
+
+    /**
+     * @returns false if io_uring is not supported by the kernel or is forbidden.
+     */
+    bool init(uint32 entries) {
+      io_uring_params params;
+      memset(&params, 0, sizeof(params));
+      this->fd = (int) syscall(__NR_io_uring_setup, entries, &params);
+      if(this->fd < 0) {
+        this->fd = -1;
+        return false;
+      }
+      if(!(params.features & IORING_FEAT_RW_CUR_POS))
+        return false;
+
+      this->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+      this->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+      bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+      if(singleMmap)
+        this->sqRingSize = this->cqRingSize = max(this->sqRingSize, this->cqRingSize);
+      this->sqRing = mmap(NULL, this->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->fd, IORING_OFF_SQ_RING);
+      if(this->sqRing == MAP_FAILED)
+        return false;
+      if(singleMmap)
+        this->cqRing = this->sqRing;
+      else
+        this->cqRing = mmap(NULL, this->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->fd, IORING_OFF_CQ_RING);
+      if(this->cqRing == MAP_FAILED)
+        return false;
+      this->sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+      this->sqes = (io_uring_sqe*) mmap(NULL, this->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->fd, IORING_OFF_SQES);
+      if(this->sqes == MAP_FAILED)
+        return false;
+
+      this->sqTail = at(this->sqRing, params.sq_off.tail);
+      this->sqArray = at(this->sqRing, params.sq_off.array);
+      this->sqMask = *at(this->sqRing, params.sq_off.ring_mask);
+      this->cqHead = at(this->cqRing, params.cq_off.head);
+      this->cqTail = at(this->cqRing, params.cq_off.tail);
+      this->cqMask = *at(this->cqRing, params.cq_off.ring_mask);
+      this->cqes = (io_uring_cqe*) ((char*) this->cqRing + params.cq_off.cqes);
+      return true;
+    }
+
+    /**
+     * Queues a read, it is passed to the kernel by the next submit() or wait().
+     */
+    void queueRead(int fileFd, void* buf, uint32 len, uint64 offset, uint64 userData) {
+      unsigned tail = *this->sqTail;
+      unsigned index = tail & this->sqMask;
+      io_uring_sqe* sqe = &this->sqes[index];
+      memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode = IORING_OP_READ;
+      sqe->fd = fileFd;
+      sqe->addr = (uint64) (size_t) buf;
+      sqe->len = len;
+      sqe->off = offset;
+      sqe->user_data = userData;
+      this->sqArray[index] = index;
+      __atomic_store_n(this->sqTail, tail + 1, __ATOMIC_RELEASE);
+      this->unsubmitted++;
+    }
+
+    void submit() {
+      while(this->unsubmitted != 0) {
+        int submitted = enter(this->unsubmitted, 0, 0);
+        if(submitted < 0 && errno != EINTR)
+          throw runtime_error("Error while reading file: io_uring_enter failed");
+        if(submitted > 0)
+          this->unsubmitted -= submitted;
+      }
+    }
+
+    /**
+     * Submits the queued reads and waits for a completion.
+     * @param result number of bytes read, or minus error code.
+     */
+    void wait(uint64& userData, int& result) {
+      while(true) {
+        unsigned head = *this->cqHead;
+        if(head != __atomic_load_n(this->cqTail, __ATOMIC_ACQUIRE)) {
+          io_uring_cqe* cqe = &this->cqes[head & this->cqMask];
+          userData = cqe->user_data;
+          result = cqe->res;
+          __atomic_store_n(this->cqHead, head + 1, __ATOMIC_RELEASE);
+          return;
+        }
+        int submitted = enter(this->unsubmitted, 1, IORING_ENTER_GETEVENTS);
+        if(submitted < 0 && errno != EINTR)
+          throw runtime_error("Error while reading file: io_uring_enter failed");
+        if(submitted > 0)
+          this->unsubmitted -= submitted;
+      }
+    }
+  };
+#endif // ASYNCREADER_IO_URING
+
+// -------------------------------------------------------------------------- //
+// AsyncReaderImpl
+// -------------------------------------------------------------------------- //
+  class AsyncReaderImpl: private noncopyable {
+  private:
+    uint32 queueDepth;
+    scoped_array<unsigned char> bufStorage;
+    ArrayList<unsigned char*> freeBuffers;
+    ArrayList<FileEntry> entries;
+    uint32 nextEntry;
+
+    /* File that is read synchronously. */
+    bool streaming;
+    bool streamStart;
+    InputStream stream;
+    FileEntry streamEntry;
+
+#ifdef ARX_LINUX
+    /** Window of a file mapped into memory. */
+    struct MappedWindow: private noncopyable {
+      void* data;
+      size_t size;
+
+      MappedWindow(void* data, size_t size): data(data), size(size) {}
+      ~MappedWindow() {
+        munmap(this->data, this->size);
+      }
+    };
+
+    /* File that is read through memory mapping. */
+    bool memoryMapped;
+    int mapFd;
+    FileEntry mapEntry;
+    uint64 mapSize;
+    uint64 mapOffset;
+
+    /**
+     * Opens the next file for mapping. Files that cannot be mapped, like empty 
+     * ones or pipes, are opened for synchronous reading instead.
+     * @returns false if there are no more files, or the next one is stdin.
+     */
+    bool openNextMappedFile() {
+      while(this->nextEntry < this->entries.size()) {
+        FileEntry entry = this->entries[this->nextEntry];
+        if(entry.isFailed()) {
+          this->nextEntry++;
+          continue;
+        }
+        if(entry.getPath() == _T("-"))
+          return false;
+        this->nextEntry++;
+        int fd = open(entry.getPath().string().c_str(), O_RDONLY);
+        struct stat fileStat;
+        if(fd != -1 && fstat(fd, &fileStat) != 0) {
+          ::close(fd);
+          fd = -1;
+        }
+        if(fd == -1) {
+          entry.setFailed(true);
+          continue;
+        }
+        if(!S_ISREG(fileStat.st_mode) || fileStat.st_size == 0) {
+          ::close(fd);
+          if(openStream(entry, 0))
+            return true;
+          continue;
+        }
+        this->mapFd = fd;
+        this->mapEntry = entry;
+        this->mapSize = fileStat.st_size;
+        this->mapOffset = 0;
+        return true;
+      }
+      return false;
+    }
+
+    void closeMappedFile() {
+      if(this->mapFd == -1)
+        return;
+      ::close(this->mapFd);
+      this->mapFd = -1;
+    }
+
+    /**
+     * Maps the next window of the current file. If mapping fails, the rest of 
+     * the file is read synchronously.
+     * @returns false if no block was produced.
+     */
+    bool readMapped(AsyncReader::Block& block) {
+      size_t size = (size_t) min((uint64) MMAPWINDOWSIZE, this->mapSize - this->mapOffset);
+      void* data = mmap(NULL, size, PROT_READ, MAP_SHARED, this->mapFd, (off_t) this->mapOffset);
+      if(data == MAP_FAILED) {
+        FileEntry entry = this->mapEntry;
+        uint64 offset = this->mapOffset;
+        closeMappedFile();
+        if(openStream(entry, offset))
+          return false;
+        block.data = takeBuffer();
+        block.size = 0;
+        block.entry = entry;
+        block.fileStart = (offset == 0);
+        block.fileEnd = true;
+        block.mapping.reset();
+        return true;
+      }
+      madvise(data, size, MADV_SEQUENTIAL);
+      madvise(data, size, MADV_WILLNEED);
+      block.data = (unsigned char*) data;
+      block.size = (uint32) size;
+      block.entry = this->mapEntry;
+      block.fileStart = (this->mapOffset == 0);
+      block.mapping.reset(new MappedWindow(data, size));
+      this->mapOffset += size;
+      block.fileEnd = (this->mapOffset == this->mapSize);
+      if(block.fileEnd)
+        closeMappedFile();
+      return true;
+    }
+#endif // ARX_LINUX
+
+#ifdef ASYNCREADER_IO_URING
+    struct OpenFile: private noncopyable {
+      FileEntry entry;
+      int fd;
+      uint64 size;
+      bool ended;
+
+      OpenFile(FileEntry entry, int fd): entry(entry), fd(fd), size(entry.getSize()), ended(false) {}
+      ~OpenFile() {
+        ::close(this->fd);
+      }
+    };
+
+    struct Request {
+      unsigned char* buf;
+      uint64 offset;
+      boost::shared_ptr<OpenFile> file;
+      bool done;
+      int result;
+    };
+
+    IoRing ring;
+    bool ringAvailable;
+    ArrayList<Request> requests;
+    ArrayList<uint32> freeRequests;
+    deque<uint32> inFlight;
+    boost::shared_ptr<OpenFile> submitFile;
+    uint64 submitOffset;
+
+    /**
+     * Opens the next file to be read through the ring.
+     * @returns false if there are no more files, or the next one can only be
+     *   read synchronously.
+     */
+    bool openNextRingFile() {
+      while(this->nextEntry < this->entries.size()) {
+        FileEntry entry = this->entries[this->nextEntry];
+        if(entry.isFailed()) {
+          this->nextEntry++;
+          continue;
+        }
+        if(entry.getPath() == _T("-"))
+          return false;
+        this->nextEntry++;
+        string fileName = entry.getPath().string();
+        int fd = open(fileName.c_str(), O_RDONLY | O_DIRECT);
+        if(fd == -1) { // some filesystems do not support O_DIRECT
+          fd = open(fileName.c_str(), O_RDONLY);
+          if(fd != -1)
+            posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        }
+        if(fd == -1) {
+          entry.setFailed(true);
+          continue;
+        }
+        this->submitFile.reset(new OpenFile(entry, fd));
+        this->submitOffset = 0;
+        return true;
+      }
+      return false;
+    }
+
+    /**
+     * Fills the ring up to the queue depth. Every file gets one read past its
+     * known size, so that the end of file is seen even if the size is a
+     * multiple of FILEBUFSIZE.
+     */
+    void submitRequests() {
+      while(this->inFlight.size() < this->queueDepth && !this->freeBuffers.empty()) {
+        if(!this->submitFile && !openNextRingFile())
+          break;
+        if(this->submitFile->ended || this->submitOffset > this->submitFile->size) {
+          this->submitFile.reset();
+          continue;
+        }
+        uint32 index = this->freeRequests[this->freeRequests.size() - 1];
+        this->freeRequests.resize(this->freeRequests.size() - 1);
+        Request& request = this->requests[index];
+        request.buf = takeBuffer();
+        request.offset = this->submitOffset;
+        request.file = this->submitFile;
+        request.done = false;
+        this->ring.queueRead(this->submitFile->fd, request.buf, FILEBUFSIZE, this->submitOffset, index);
+        this->inFlight.push_back(index);
+        this->submitOffset += FILEBUFSIZE;
+      }
+      this->ring.submit();
+    }
+
+    void waitForRequest(uint32 index) {
+      while(!this->requests[index].done) {
+        uint64 userData;
+        int result;
+        this->ring.wait(userData, result);
+        this->requests[(uint32) userData].done = true;
+        this->requests[(uint32) userData].result = result;
+      }
+    }
+
+    /**
+     * Waits for the oldest request and removes it from the queue.
+     */
+    Request& popRequest(uint32& index) {
+      index = this->inFlight.front();
+      waitForRequest(index);
+      this->inFlight.pop_front();
+      this->freeRequests.add(index);
+      return this->requests[index];
+    }
+
+    /**
+     * Reads the rest of the request's buffer after a short read, the hashers
+     * expect full-sized chunks everywhere but at the end of file.
+     * @returns number of bytes in the buffer, or minus error code.
+     */
+    int completeRequest(uint32 index) {
+      Request& request = this->requests[index];
+      OpenFile& file = *request.file;
+      uint32 size = (uint32) request.result;
+      while(size < FILEBUFSIZE && request.offset + size < file.size) {
+        /* O_DIRECT does not allow the misaligned offsets short reads leave. */
+        if((size & (ARX_UNBUFFERED_IO_ALIGN - 1)) != 0)
+          fcntl(file.fd, F_SETFL, fcntl(file.fd, F_GETFL) & ~O_DIRECT);
+        request.done = false;
+        this->ring.queueRead(file.fd, request.buf + size, FILEBUFSIZE - size, request.offset + size, index);
+        waitForRequest(index);
+        if(request.result <= 0)
+          return request.result < 0 ? request.result : (int) size;
+        size += (uint32) request.result;
+      }
+      return (int) size;
+    }
+
+    /**
+     * Turns the oldest request into a block.
+     * @returns false if the request was discarded, because its file has ended
+     *   earlier than expected.
+     */
+    bool readRequest(AsyncReader::Block& block) {
+      uint32 index;
+      Request& request = popRequest(index);
+      boost::shared_ptr<OpenFile> file = request.file;
+      if(file->ended) {
+        request.file.reset();
+        this->freeBuffers.add(request.buf);
+        return false;
+      }
+      int result = request.result > 0 ? completeRequest(index) : request.result;
+      request.file.reset();
+      if(result < 0) {
+        file->entry.setFailed(true);
+        block.size = 0;
+        file->ended = true;
+      } else {
+        block.size = (uint32) result;
+        file->ended = block.size < FILEBUFSIZE;
+      }
+      block.data = request.buf;
+      block.entry = file->entry;
+      block.mapping.reset();
+      block.fileStart = (request.offset == 0);
+      block.fileEnd = file->ended;
+      if(!file->ended && request.offset + FILEBUFSIZE > file->size) {
+        /* The file has grown since its size was taken, the rest of it is read
+         * synchronously, the reads of the next files are already queued. */
+        file->ended = true;
+        block.fileEnd = !openStream(file->entry, request.offset + FILEBUFSIZE);
+      }
+      return true;
+    }
+
+    void cancelRequests() {
+      while(!this->inFlight.empty()) {
+        uint32 index;
+        Request& request = popRequest(index);
+        request.file.reset();
+        this->freeBuffers.add(request.buf);
+      }
+      this->submitFile.reset();
+    }
+#endif // ASYNCREADER_IO_URING
+
+    unsigned char* takeBuffer() {
+      unsigned char* buf = this->freeBuffers[this->freeBuffers.size() - 1];
+      this->freeBuffers.resize(this->freeBuffers.size() - 1);
+      return buf;
+    }
+
+    /**
+     * Opens a file for synchronous reading.
+     * @returns false if the file could not be opened, it's marked as failed then.
+     */
+    bool openStream(FileEntry entry, uint64 offset) {
+      try {
+        this->stream = createInputStream(entry.getPath(), true);
+        if(offset != 0)
+          this->stream.skip(offset);
+      } catch(...) {
+        entry.setFailed(true);
+        return false;
+      }
+      this->streaming = true;
+      this->streamStart = (offset == 0);
+      this->streamEntry = entry;
+      return true;
+    }
+
+    bool openNextStream() {
+      while(this->nextEntry < this->entries.size()) {
+        FileEntry entry = this->entries[this->nextEntry++];
+        if(!entry.isFailed() && openStream(entry, 0))
+          return true;
+      }
+      return false;
+    }
+
+    void readStream(AsyncReader::Block& block) {
+      unsigned char* buf = takeBuffer();
+      int read;
+      try {
+        read = this->stream.read(buf, FILEBUFSIZE);
+      } catch(...) {
+        this->freeBuffers.add(buf);
+        this->streaming = false;
+        throw;
+      }
+      block.data = buf;
+      block.entry = this->streamEntry;
+      block.mapping.reset();
+      block.fileStart = this->streamStart;
+      block.fileEnd = (read == EOF);
+      block.size = block.fileEnd ? 0 : (uint32) read;
+      this->streamStart = false;
+      if(block.fileEnd) {
+        this->streaming = false;
+        this->stream = InputStream();
+      }
+    }
+
+  public:
+    AsyncReaderImpl(uint32 queueDepth): queueDepth(queueDepth), nextEntry(0), streaming(false), streamStart(false) {
+      unsigned char* buf = allocateAligned(this->bufStorage, queueDepth * FILEBUFSIZE);
+      for(uint32 i = 0; i < queueDepth; i++)
+        this->freeBuffers.add(buf + i * FILEBUFSIZE);
+#ifdef ARX_LINUX
+      this->memoryMapped = readerMemoryMapped;
+      this->mapFd = -1;
+#endif
+#ifdef ASYNCREADER_IO_URING
+      this->ringAvailable = !this->memoryMapped && this->ring.init(queueDepth);
+      this->requests.resize(queueDepth);
+      for(uint32 i = 0; i < queueDepth; i++)
+        this->freeRequests.add(i);
+#endif
+    }
+
+    ~AsyncReaderImpl() {
+#ifdef ASYNCREADER_IO_URING
+      /* The kernel may still be writing into the buffers. */
+      cancelRequests();
+#endif
+#ifdef ARX_LINUX
+      closeMappedFile();
+#endif
+    }
+
+    void start(ArrayList<FileEntry> entries) {
+#ifdef ASYNCREADER_IO_URING
+      cancelRequests();
+#endif
+#ifdef ARX_LINUX
+      closeMappedFile();
+#endif
+      this->streaming = false;
+      this->stream = InputStream();
+      this->entries = entries;
+      this->nextEntry = 0;
+    }
+
+    bool read(AsyncReader::Block& block, unsigned char* spare) {
+      this->freeBuffers.add(spare);
+      while(true) {
+        if(this->streaming) {
+          readStream(block);
+          return true;
+        }
+#ifdef ARX_LINUX
+        if(this->memoryMapped && (this->mapFd != -1 || openNextMappedFile())) {
+          if(this->mapFd != -1 && readMapped(block)) {
+            if(block.mapping)
+              this->freeBuffers.remove(spare);
+            return true;
+          }
+          continue;
+        }
+#endif
+#ifdef ASYNCREADER_IO_URING
+        if(this->ringAvailable) {
+          submitRequests();
+          if(!this->inFlight.empty()) {
+            if(readRequest(block))
+              return true;
+            continue;
+          }
+        }
+#endif
+        if(!openNextStream()) {
+          this->freeBuffers.remove(spare);
+          return false;
+        }
+      }
+    }
+  };
+}
+
+// -------------------------------------------------------------------------- //
+// AsyncReader
+// -------------------------------------------------------------------------- //
+AsyncReader::AsyncReader(uint32 queueDepth): impl(new ::detail::AsyncReaderImpl(queueDepth)) {
+  return;
+}
+
+void AsyncReader::start(ArrayList<FileEntry> entries) {
+  this->impl->start(entries);
+}
+
+bool AsyncReader::read(Block& block, unsigned char* spare) {
+  return this->impl->read(block, spare);
+}
+
+void AsyncReader::setMemoryMapped(bool memoryMapped) {
+  readerMemoryMapped = memoryMapped;
+}
@@ -0,0 +1,70 @@
+#ifndef __ASYNCREADER_H__
+#define __ASYNCREADER_H__
+
+#include "config.h"
+#include "ArrayList.h"
+#include "FileEntry.h"
+#include <boost/shared_ptr.hpp>
+
+// -------------------------------------------------------------------------- //
+// AsyncReader
+// -------------------------------------------------------------------------- //
+namespace detail {
+  class AsyncReaderImpl;
+}
+
+/**
+ * AsyncReader reads a sequence of files in blocks of FILEBUFSIZE bytes, keeping
+ * several reads in flight. On linux the reads go through io_uring, and the next
+ * file is already being read while the last blocks of the previous one are
+ * hashed. Where io_uring is not available files are read one block at a time.
+ *
+ * In memory mapped mode regular files are mapped window after window instead, 
+ * and the blocks point right into the mapped pages.
+ */
+class AsyncReader {
+private:
+  boost::shared_ptr< ::detail::AsyncReaderImpl> impl;
+
+public:
+  struct Block {
+    unsigned char* data;
+    uint32 size;
+    FileEntry entry;
+    bool fileStart;
+    bool fileEnd;
+
+    /** Mapped window the data points into, empty if the data was read into a buffer. */
+    boost::shared_ptr<void> mapping;
+  };
+
+  /**
+   * @param queueDepth maximal number of reads in flight.
+   */
+  explicit AsyncReader(uint32 queueDepth);
+
+  /**
+   * Starts reading the given files, abandoning the ones started before. Entries
+   * marked as failed are skipped, files that cannot be opened are marked as
+   * failed.
+   */
+  void start(ArrayList<FileEntry> entries);
+
+  /**
+   * Returns the next block, blocks of a file come in order and end with a
+   * block that has fileEnd set. The caller gives a spare buffer in exchange
+   * for block.data, buffers are FILEBUFSIZE bytes long and must be aligned
+   * for unbuffered reads.
+   * @returns false when all the files have been read, the spare buffer stays
+   *   with the caller then, as it does when the block is mapped.
+   */
+  bool read(Block& block, unsigned char* spare);
+
+  /**
+   * Sets whether files are read through memory mapping, readers created 
+   * afterwards use it. Memory mapping is supported on linux only.
+   */
+  static void setMemoryMapped(bool memoryMapped);
+};
+
+#endif
@@ -0,0 +1,184 @@
+#include "config.h"
+#include "Bencode.h"
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+  bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+  }
+
+  /**
+   * Parses the length of a string, the position is moved past the colon. The
+   * input is assumed to be validated.
+   */
+  size_t parseLength(const char*& pos) {
+    size_t result = 0;
+    while(*pos != ':')
+      result = result * 10 + (*pos++ - '0');
+    pos++;
+    return result;
+  }
+
+  /**
+   * Finds the end of a value that is known to be valid.
+   */
+  const char* skip(const char* pos) {
+    if(isDigit(*pos)) {
+      size_t length = parseLength(pos);
+      return pos + length;
+    } else if(*pos == 'i') {
+      while(*pos != 'e')
+        pos++;
+      return pos + 1;
+    } else {
+      pos++;
+      while(*pos != 'e')
+        pos = skip(pos);
+      return pos + 1;
+    }
+  }
+
+  /**
+   * Finds the end of a value, checking that it is valid.
+   */
+  const char* validate(const char* pos, const char* limit, uint32 depth) {
+    if(pos == limit)
+      throw runtime_error("Unexpected end of bencoded data");
+    if(isDigit(*pos)) {
+      uint64 length = 0;
+      while(pos != limit && isDigit(*pos)) {
+        length = length * 10 + (*pos++ - '0');
+        if(length > (uint64) (limit - pos))
+          throw runtime_error("Bencoded string too long");
+      }
+      if(pos == limit || *pos != ':' || length > (uint64) (limit - pos - 1))
+        throw runtime_error("Malformed bencoded string");
+      return pos + 1 + length;
+    } else if(*pos == 'i') {
+      pos++;
+      if(pos != limit && *pos == '-')
+        pos++;
+      const char* digits = pos;
+      while(pos != limit && isDigit(*pos))
+        pos++;
+      if(pos == digits || pos - digits > 19 || pos == limit || *pos != 'e')
+        throw runtime_error("Malformed bencoded integer");
+      return pos + 1;
+    } else if(*pos == 'l' || *pos == 'd') {
+      if(depth == MAX_BENCODE_DEPTH)
+        throw runtime_error("Bencoded data nested too deep");
+      bool isDictionary = *pos == 'd';
+      pos++;
+      uint32 count = 0;
+      for(; pos == limit || *pos != 'e'; count++) {
+        if(isDictionary && count % 2 == 0 && (pos == limit || !isDigit(*pos)))
+          throw runtime_error("Bencoded dictionary key is not a string");
+        pos = validate(pos, limit, depth + 1);
+      }
+      if(isDictionary && count % 2 != 0)
+        throw runtime_error("Bencoded dictionary key has no value");
+      return pos + 1;
+    } else {
+      throw runtime_error("Malformed bencoded data");
+    }
+  }
+}
+
+// -------------------------------------------------------------------------- //
+// BencodeValue
+// -------------------------------------------------------------------------- //
+BencodeValue::BencodeValue(): begin(NULL), end(NULL) {
+  return;
+}
+
+BencodeValue::BencodeValue(const char* begin, const char* end): begin(begin), end(end) {
+  return;
+}
+
+BencodeValue BencodeValue::parse(const char* data, size_t size) {
+  return BencodeValue(data, validate(data, data + size, 0));
+}
+
+BencodeValue::Type BencodeValue::getType() const {
+  if(this->begin == NULL)
+    return B_NONE;
+  switch(*this->begin) {
+  case 'i':
+    return B_INTEGER;
+  case 'l':
+    return B_LIST;
+  case 'd':
+    return B_DICTIONARY;
+  default:
+    return B_STRING;
+  }
+}
+
+void BencodeValue::throwIfNot(Type type) const {
+  if(getType() != type)
+    throw runtime_error("Bencoded value is of unexpected type");
+}
+
+int64 BencodeValue::getInteger() const {
+  throwIfNot(B_INTEGER);
+  const char* pos = this->begin + 1;
+  bool negative = *pos == '-';
+  if(negative)
+    pos++;
+  uint64 result = 0;
+  while(*pos != 'e')
+    result = result * 10 + (*pos++ - '0');
+  return negative ? -(int64) result : (int64) result;
+}
+
+const char* BencodeValue::getStringData() const {
+  throwIfNot(B_STRING);
+  return (const char*) memchr(this->begin, ':', this->end - this->begin) + 1;
+}
+
+size_t BencodeValue::getStringSize() const {
+  return this->end - getStringData();
+}
+
+string BencodeValue::getString() const {
+  return string(getStringData(), this->end);
+}
+
+BencodeValue BencodeValue::find(const string& key) const {
+  throwIfNot(B_DICTIONARY);
+  const char* pos = this->begin + 1;
+  while(*pos != 'e') {
+    size_t keyLength = parseLength(pos);
+    const char* value = pos + keyLength;
+    const char* valueEnd = skip(value);
+    if(keyLength == key.size() && memcmp(pos, key.data(), keyLength) == 0)
+      return BencodeValue(value, valueEnd);
+    pos = valueEnd;
+  }
+  return BencodeValue();
+}
+
+BencodeValue BencodeValue::operator[] (const string& key) const {
+  BencodeValue result = find(key);
+  if(result.isNone())
+    throw runtime_error("Bencoded dictionary has no key \"" + key + "\"");
+  return result;
+}
+
+BencodeValue BencodeValue::getFirst() const {
+  if(getType() != B_DICTIONARY)
+    throwIfNot(B_LIST);
+  const char* pos = this->begin + 1;
+  if(*pos == 'e')
+    return BencodeValue();
+  return BencodeValue(pos, skip(pos));
+}
+
+BencodeValue BencodeValue::getNext() const {
+  if(*this->end == 'e')
+    return BencodeValue();
+  return BencodeValue(this->end, skip(this->end));
+}
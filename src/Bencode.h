@@ -0,0 +1,96 @@
+#ifndef __BENCODE_H__
+#define __BENCODE_H__
+
+#include "config.h"
+#include <string>
+
+// -------------------------------------------------------------------------- //
+// BencodeValue
+// -------------------------------------------------------------------------- //
+/**
+ * BencodeValue is a view of a bencoded value inside a buffer. Nothing is
+ * decoded or copied: a value is a span of the buffer, strings point into it,
+ * and dictionary entries and list items are found by skipping over the ones
+ * before them. The buffer must outlive the values taken from it.
+ *
+ * The whole buffer is validated once by parse(), malformed input throws
+ * there. Accessors throw if a value is not of the type they expect.
+ */
+class BencodeValue {
+public:
+  enum Type {
+    B_NONE,
+    B_INTEGER,
+    B_STRING,
+    B_LIST,
+    B_DICTIONARY
+  };
+
+private:
+  const char* begin;
+  const char* end;
+
+  BencodeValue(const char* begin, const char* end);
+
+  void throwIfNot(Type type) const;
+
+public:
+  /** Creates a B_NONE value. */
+  BencodeValue();
+
+  /**
+   * Validates the bencoded value at the start of the buffer.
+   * @returns view of the value.
+   */
+  static BencodeValue parse(const char* data, size_t size);
+
+  Type getType() const;
+
+  bool isNone() const {
+    return this->begin == NULL;
+  }
+
+  /** @returns start of the bencoded value in the buffer. */
+  const char* getBegin() const {
+    return this->begin;
+  }
+
+  /** @returns end of the bencoded value in the buffer. */
+  const char* getEnd() const {
+    return this->end;
+  }
+
+  int64 getInteger() const;
+
+  const char* getStringData() const;
+
+  size_t getStringSize() const;
+
+  std::string getString() const;
+
+  /**
+   * @returns value of the given key of a dictionary, or a B_NONE value if
+   *   there is no such key.
+   */
+  BencodeValue find(const std::string& key) const;
+
+  /**
+   * @returns value of the given key of a dictionary, throws if there is no
+   *   such key.
+   */
+  BencodeValue operator[] (const std::string& key) const;
+
+  /** 
+   * @returns first item of a list, or a B_NONE value if it is empty. Items of
+   *   a dictionary are its keys and values in turn.
+   */
+  BencodeValue getFirst() const;
+
+  /**
+   * @returns item that follows this list or dictionary item, or a B_NONE 
+   *   value if this is the last one. Must be called for such items only.
+   */
+  BencodeValue getNext() const;
+};
+
+#endif
@@ -4,9 +4,11 @@
 #include <boost/foreach.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
-#include <boost/regex.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/shared_array.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
+#include <deque>
 #include "arx/Exception.h"
 #include "arx/Converter.h"
 #include "Torrent.h"
@@ -18,14 +20,17 @@
 #include "Streams.h"
 #include "Map.h"
 
+#ifdef ARX_LINUX
+#  include <sys/stat.h>
+#  include <fcntl.h>
+#endif
+
 using namespace std;
 using namespace arx;
 using namespace boost;
 using namespace boost::filesystem;
 using namespace boost::algorithm;
 
-const wstring fileNameRegex = _T("([^\"\\*\\?<>\\|]+)");
-
 // -------------------------------------------------------------------------- //
 // CheckError
 // -------------------------------------------------------------------------- //
@@ -126,6 +131,7 @@ namespace detail {
     virtual void beginFile(const boost::filesystem::path& filePath, const std::wstring& fileString) {return;};
     virtual void update(uint64 justProcessed) {return;};
     virtual void endFile(ArrayList<CheckError> errors) {return;};
+    virtual void endUnreadFile(bool sizeChecked) {return;};
     virtual void end() {return;};
   };
 }
@@ -158,6 +164,10 @@ void CheckResultReporter::endFile(ArrayList<CheckError> errors) {
   this->impl->endFile(errors);
 }
 
+void CheckResultReporter::endUnreadFile(bool sizeChecked) {
+  this->impl->endUnreadFile(sizeChecked);
+}
+
 void CheckResultReporter::end() {
   this->impl->end();
 }
@@ -176,7 +186,7 @@ namespace detail {
     std::wstring checkSumFileName;
     std::wstring fileName;
     uint64 fileSize;
-    uint32 okCount, errorCount;
+    uint32 okCount, errorCount, unreadCount;
     PrinterHasherCallBack progressCallBack;
 
   public:
@@ -197,10 +207,11 @@ namespace detail {
 
 
     virtual void begin(const path& checkSumFilePath) {
-      *this->printer << "  " << checkSumFilePath << ": " << endl;
-      this->checkSumFileName = checkSumFilePath.native();
+      *this->printer << "  " << checkSumFilePath.wstring() << ": " << endl;
+      this->checkSumFileName = checkSumFilePath.wstring();
       this->errorCount = 0;
       this->okCount = 0;
+      this->unreadCount = 0;
     }
 
     virtual void beginFile(const path& filePath, const wstring& fileString) {
@@ -235,9 +246,17 @@ namespace detail {
       }
     }
 
+    virtual void endUnreadFile(bool sizeChecked) {
+      this->progressCallBack.clear();
+      *this->printer << (sizeChecked ? "[size ok] " : "[exists] ") << this->fileName << endl;
+      this->unreadCount++;
+    }
+
     virtual void end() {
       wCout << "  Errors: " << this->errorCount << endl;
       wCout << "  Ok: " << this->okCount << endl;
+      if(this->unreadCount != 0)
+        wCout << "  Not verified: " << this->unreadCount << " (only found and sized, no data was read)" << endl;
       wCout << endl;
     }
 
@@ -285,94 +304,212 @@ public:
 // -------------------------------------------------------------------------- //
 // LineCheckers
 // -------------------------------------------------------------------------- //
+/**
+ * Parts of a parsed line, as positions in the line. Nothing is copied until
+ * it's known which format the line is in.
+ */
+struct ParsedLine {
+  size_t fileNameBegin, fileNameEnd;
+  size_t digestBegin, digestEnd;
+  size_t sizeBegin, sizeEnd;
+  uint32 hashId;
+  bool hasSize;
+};
+
+/**
+ * LineChecker recognizes lines of a single checksum file format. Lines are 
+ * trimmed before they get here.
+ */
 class LineChecker {
+protected:
+  static bool isHexDigit(wchar_t c) {
+    return (c >= _T('0') && c <= _T('9')) || (c >= _T('a') && c <= _T('f')) || (c >= _T('A') && c <= _T('F'));
+  }
+
+  static bool isDigit(wchar_t c) {
+    return c >= _T('0') && c <= _T('9');
+  }
+
+  static bool isAlnum(wchar_t c) {
+    return isDigit(c) || (c >= _T('a') && c <= _T('z')) || (c >= _T('A') && c <= _T('Z'));
+  }
+
+  static bool isBlank(wchar_t c) {
+    return c == _T(' ') || c == _T('\t');
+  }
+
+  static bool isFileNameChar(wchar_t c) {
+    return c != _T('"') && c != _T('*') && c != _T('?') && c != _T('<') && c != _T('>') && c != _T('|');
+  }
+
+  static bool isHexString(const wstring& line, size_t begin, size_t end) {
+    for(size_t i = begin; i < end; i++)
+      if(!isHexDigit(line[i]))
+        return false;
+    return true;
+  }
+
+  static bool isFileName(const wstring& line, size_t begin, size_t end) {
+    if(begin >= end)
+      return false;
+    for(size_t i = begin; i < end; i++)
+      if(!isFileNameChar(line[i]))
+        return false;
+    return true;
+  }
+
 public:
-  virtual bool applicableTo(wstring line) = 0;
+  /**
+   * @returns true if the line is in the format of this checker, the parts of
+   *   the line are stored in the result then.
+   */
+  virtual bool parse(const wstring& line, ParsedLine& result) = 0;
   virtual bool isDefaultFor(path fileName) = 0;
-  virtual void parseLine(wstring line, Map<wstring, CheckTask> m) = 0;
 };
 
-class SimpleLineChecker: public LineChecker {
+/** "name crc32", as in .sfv files. */
+class SFVLineChecker: public LineChecker {
+public:
+  virtual bool parse(const wstring& line, ParsedLine& result) {
+    size_t size = line.size();
+    if(size < 10 || !isBlank(line[size - 9]) || !isHexString(line, size - 8, size) || !isFileName(line, 0, size - 9))
+      return false;
+    result.fileNameBegin = 0;
+    result.fileNameEnd = size - 9;
+    result.digestBegin = size - 8;
+    result.digestEnd = size;
+    result.hashId = H_CRC;
+    result.hasSize = false;
+    return true;
+  }
+
+  virtual bool isDefaultFor(path fileName) {
+    wstring name = to_lower_copy(fileName.filename().wstring());
+    return contains(name, _T("crc")) || contains(name, _T("sfv"));
+  }
+};
+
+/** "ed2k://|file|name|size|ed2k|/" */
+class ED2KLineChecker: public LineChecker {
+public:
+  virtual bool parse(const wstring& line, ParsedLine& result) {
+    static const wstring prefix = _T("ed2k://|file|");
+    if(!starts_with(line, prefix))
+      return false;
+    size_t fileNameEnd = line.find(_T('|'), prefix.size());
+    if(fileNameEnd == wstring::npos || !isFileName(line, prefix.size(), fileNameEnd))
+      return false;
+    size_t sizeEnd = fileNameEnd + 1;
+    while(sizeEnd < line.size() && isDigit(line[sizeEnd]))
+      sizeEnd++;
+    if(sizeEnd == fileNameEnd + 1 || line.size() != sizeEnd + 35 || line[sizeEnd] != _T('|') || 
+       !isHexString(line, sizeEnd + 1, sizeEnd + 33) || line.compare(sizeEnd + 33, 2, _T("|/")) != 0)
+      return false;
+    result.fileNameBegin = prefix.size();
+    result.fileNameEnd = fileNameEnd;
+    result.sizeBegin = fileNameEnd + 1;
+    result.sizeEnd = sizeEnd;
+    result.digestBegin = sizeEnd + 1;
+    result.digestEnd = sizeEnd + 33;
+    result.hashId = H_ED2K;
+    result.hasSize = true;
+    return true;
+  }
+
+  virtual bool isDefaultFor(path fileName) {
+    return contains(to_lower_copy(fileName.filename().wstring()), _T("ed2k"));
+  }
+};
+
+/** "digest *name", as in .md5 and .sha1 files. */
+class DigestFirstLineChecker: public LineChecker {
 private:
-  wregex lineRegex;
-  wregex fileNameRegex;
-  int hashMatchIndex;
-  int fileNameMatchIndex;
-  int sizeMatchIndex;
-  bool sizeCheckNeeded;
-  int hashId;
+  size_t digestLength;
+  uint32 hashId;
+  wstring defaultNamePart;
 
 public:
-  SimpleLineChecker(wstring lineRegex, wstring fileNameRegex, int hashMatchIndex, int fileNameMatchIndex, int hashId, bool sizeCheckNeeded, int sizeMatchIndex): 
-    lineRegex(lineRegex), fileNameRegex(fileNameRegex), hashMatchIndex(hashMatchIndex), fileNameMatchIndex(fileNameMatchIndex), hashId(hashId), sizeCheckNeeded(sizeCheckNeeded), sizeMatchIndex(sizeMatchIndex) {
+  DigestFirstLineChecker(size_t digestLength, uint32 hashId, wstring defaultNamePart): 
+    digestLength(digestLength), hashId(hashId), defaultNamePart(defaultNamePart) {
     return;
   }
 
-  virtual bool applicableTo(wstring line) {
-    return regex_match(line, this->lineRegex);
+  virtual bool parse(const wstring& line, ParsedLine& result) {
+    size_t pos = this->digestLength;
+    if(line.size() <= pos || !isHexString(line, 0, pos) || !(isBlank(line[pos]) || line[pos] == _T('*')))
+      return false;
+    while(pos < line.size() && (isBlank(line[pos]) || line[pos] == _T('*')))
+      pos++;
+    if(!isFileName(line, pos, line.size()))
+      return false;
+    result.fileNameBegin = pos;
+    result.fileNameEnd = line.size();
+    result.digestBegin = 0;
+    result.digestEnd = this->digestLength;
+    result.hashId = this->hashId;
+    result.hasSize = false;
+    return true;
   }
 
   virtual bool isDefaultFor(path fileName) {
-    return regex_match(to_lower_copy(fileName.filename().wstring()), this->fileNameRegex);
-  }
-
-  virtual void parseLine(wstring line, Map<wstring, CheckTask> m) {
-    wsmatch match;
-    regex_match(line, match, this->lineRegex);
-    wstring fileName = trim_copy(wstring(match[this->fileNameMatchIndex].first, match[this->fileNameMatchIndex].second));
-    string hash = toNarrowString(wstring(match[this->hashMatchIndex].first, match[this->hashMatchIndex].second));
-#ifdef ARX_WIN
-    wstring key = to_upper_copy(fileName);
-#else
-    wstring key = fileName;
-#endif
-    if(m.find(key) == m.end())
-      m[key] = CheckTask(fileName);
-    m[key].getRightEntry().setDigest(this->hashId, Digest::fromHexString(hash));
-    m[key].getHashTask().add(this->hashId);
-    if(sizeCheckNeeded) {
-      m[key].setSizeNeedsChecking(true);
-      m[key].getRightEntry().setSize(lexical_cast<uint64>(wstring(match[this->sizeMatchIndex].first, match[this->sizeMatchIndex].second)));
-    }
+    return contains(to_lower_copy(fileName.filename().wstring()), this->defaultNamePart);
   }
 };
 
+/** "HASH (name) = digest", as written by bsd tools. */
 class BSDLineChecker: public LineChecker {
-private:
-  static wregex lineRegex;
 public:
-  virtual bool applicableTo(wstring line) {
-    wsmatch match;
-    if(regex_match(line, match, lineRegex))
-      return Hash::getId(toNarrowString(wstring(match[1].first, match[1].second))) != H_UNKNOWN;
-    return false;
+  virtual bool parse(const wstring& line, ParsedLine& result) {
+    size_t nameEnd = 0;
+    while(nameEnd < line.size() && isAlnum(line[nameEnd]))
+      nameEnd++;
+    if(nameEnd == 0)
+      return false;
+    size_t fileNameBegin = nameEnd;
+    while(fileNameBegin < line.size() && isBlank(line[fileNameBegin]))
+      fileNameBegin++;
+    if(fileNameBegin == line.size() || line[fileNameBegin] != _T('('))
+      return false;
+    fileNameBegin++;
+
+    /* The digest is at the end, file name may contain brackets. */
+    size_t digestBegin = line.size();
+    while(digestBegin > fileNameBegin && isHexDigit(line[digestBegin - 1]))
+      digestBegin--;
+    if(digestBegin == line.size())
+      return false;
+    size_t pos = digestBegin;
+    while(pos > fileNameBegin && isBlank(line[pos - 1]))
+      pos--;
+    if(pos == fileNameBegin || line[pos - 1] != _T('='))
+      return false;
+    pos--;
+    while(pos > fileNameBegin && isBlank(line[pos - 1]))
+      pos--;
+    if(pos == fileNameBegin || line[pos - 1] != _T(')'))
+      return false;
+    size_t fileNameEnd = pos - 1;
+    if(!isFileName(line, fileNameBegin, fileNameEnd))
+      return false;
+
+    uint32 hashId = Hash::getId(toNarrowString(line.substr(0, nameEnd)));
+    if(hashId == H_UNKNOWN)
+      return false;
+    result.fileNameBegin = fileNameBegin;
+    result.fileNameEnd = fileNameEnd;
+    result.digestBegin = digestBegin;
+    result.digestEnd = line.size();
+    result.hashId = hashId;
+    result.hasSize = false;
+    return true;
   }
 
   virtual bool isDefaultFor(path fileName) {
     //return contains(to_lower_copy(fileName.native_file_string()), _T("bsd"));
     return true; // small cheat to prioritize bsd format over sfv one
   }
-
-  virtual void parseLine(wstring line, Map<wstring, CheckTask> m) {
-    wsmatch match;
-    regex_match(line, match, lineRegex);
-    wstring fileName = trim_copy(wstring(match[2].first, match[2].second));
-    uint32 hashId = Hash::getId(toNarrowString(wstring(match[1].first, match[1].second)));
-    string hash = toNarrowString(wstring(match[3].first, match[3].second));
-#ifdef ARX_WIN
-    wstring key = to_upper_copy(fileName);
-#else
-    wstring key = fileName;
-#endif
-    if(m.find(key) == m.end())
-      m[key] = CheckTask(fileName);
-    m[key].getRightEntry().setDigest(hashId, Digest::fromHexString(hash));
-    m[key].getHashTask().add(hashId);
-  }
 };
 
-wregex BSDLineChecker::lineRegex = wregex(_T("([a-zA-Z0-9]+)[ \t]*\\(") + fileNameRegex + _T("\\)[ \t]*=[ \t]*([0-9a-fA-F]+)"));
-
 // -------------------------------------------------------------------------- //
 // FileCheckers
 // -------------------------------------------------------------------------- //
@@ -386,14 +523,14 @@ public:
     return true;
   }
 
-  virtual void check(path fileName, CheckResultReporter reporter) {
+  virtual void check(path fileName, CheckResultReporter reporter, optional<HashCache> cache, optional<Scheduler> scheduler) {
     for(int i = 0; i < fileCheckers.size(); i++) {
       if(fileCheckers[i]->applicableTo(fileName)) {
-        fileCheckers[i]->check(fileName, reporter);
+        fileCheckers[i]->check(fileName, reporter, cache, scheduler);
         return;
       }
     }
-    defaultChecker->check(fileName, reporter);
+    defaultChecker->check(fileName, reporter, cache, scheduler);
   }
 
   static ArrayList<FileChecker*> constructFileCheckerList();
@@ -402,10 +539,10 @@ public:
 class TorrentFileChecker: public FileChecker {
 public:
   virtual bool applicableTo(path fileName) {
-    return ends_with(to_lower_copy(fileName.native()), ".torrent");
+    return ends_with(to_lower_copy(fileName.wstring()), ".torrent");
   }
-  virtual void check(path fileName, CheckResultReporter reporter) {
-    checkTorrent(fileName, reporter);
+  virtual void check(path fileName, CheckResultReporter reporter, optional<HashCache> cache, optional<Scheduler> scheduler) {
+    checkTorrent(fileName, reporter, scheduler);
   }
 };
 
@@ -416,10 +553,10 @@ private:
 public:
   TextFileChecker() {
     if(lineCheckers.size() == 0) {
-      lineCheckers.push_back(new SimpleLineChecker(fileNameRegex + _T("[ \t]+([0-9a-fA-F]{8})"),                                        _T("(.*crc.*)|(.*sfv.*)"), 2, 1, H_CRC,  false, -1));
-      lineCheckers.push_back(new SimpleLineChecker(_T("ed2k://\\|file\\|") + fileNameRegex + _T("\\|([0-9]+)\\|([0-9a-fA-F]{32})\\|/"), _T(".*ed2k.*"),            3, 1, H_ED2K, true,   2));
-      lineCheckers.push_back(new SimpleLineChecker(_T("([0-9a-fA-F]{32})[ \t\\*]+") + fileNameRegex,                                    _T(".*md5.*"),             1, 2, H_MD5,  false, -1));
-      lineCheckers.push_back(new SimpleLineChecker(_T("([0-9a-fA-F]{40})[ \t\\*]+") + fileNameRegex,                                    _T(".*sha1.*"),            1, 2, H_SHA1, false, -1));
+      lineCheckers.push_back(new SFVLineChecker());
+      lineCheckers.push_back(new ED2KLineChecker());
+      lineCheckers.push_back(new DigestFirstLineChecker(32, H_MD5, _T("md5")));
+      lineCheckers.push_back(new DigestFirstLineChecker(40, H_SHA1, _T("sha1")));
       lineCheckers.push_back(new BSDLineChecker());
     }
   }
@@ -428,7 +565,186 @@ public:
     return true;
   }
 
-  virtual void check(path fileName, CheckResultReporter reporter) {
+  static void addCheckTask(const wstring& line, const ParsedLine& parsed, Map<wstring, CheckTask> m) {
+    wstring fileName = trim_copy(line.substr(parsed.fileNameBegin, parsed.fileNameEnd - parsed.fileNameBegin));
+#ifdef ARX_WIN
+    wstring key = to_upper_copy(fileName);
+#else
+    wstring key = fileName;
+#endif
+    /* Everything is parsed before the task is touched, so that a line that throws adds nothing. */
+    Digest digest = Digest::fromHexString(toNarrowString(line.substr(parsed.digestBegin, parsed.digestEnd - parsed.digestBegin)));
+    uint64 size = 0;
+    if(parsed.hasSize)
+      size = lexical_cast<uint64>(line.substr(parsed.sizeBegin, parsed.sizeEnd - parsed.sizeBegin));
+
+    Map<wstring, CheckTask>::iterator i = m.find(key);
+    if(i == m.end())
+      i = m.insert(make_pair(key, CheckTask(fileName))).first;
+    CheckTask& task = i->second;
+    task.getRightEntry().setDigest(parsed.hashId, digest);
+    task.getHashTask().add(parsed.hashId);
+    if(parsed.hasSize) {
+      task.setSizeNeedsChecking(true);
+      task.getRightEntry().setSize(size);
+    }
+  }
+
+  /**
+   * A file listed in a checksum file, along with the result of its check.
+   */
+  struct FileCheck {
+    path filePath;
+    wstring fileString;
+    CheckTask task;
+    ArrayList<CheckError> errors;
+    bool exists;
+    uint64 size;
+    time_t dateTime;
+    bool done;
+
+    FileCheck(path dir, CheckTask task): task(task), exists(false), size(0), dateTime(0), done(false) {
+      this->filePath = task.getRightEntry().getPath();
+      this->fileString = this->filePath.wstring();
+      if(!this->filePath.is_complete())
+        this->filePath = dir / this->filePath;
+    }
+  };
+
+  /**
+   * Finished checks waiting to be reported, checks are reported by the thread
+   * that reads the checksum file.
+   */
+  struct CheckQueue {
+    mutex queueMutex;
+    std::deque<uint32> finished;
+  };
+
+  /** Stats the file being checked, following symlinks. */
+  static void examine(FileCheck& check) {
+    try {
+#if defined(ARX_LINUX) && defined(STATX_SIZE)
+      struct statx st;
+      if(statx(AT_FDCWD, check.filePath.string().c_str(), AT_STATX_SYNC_AS_STAT, STATX_TYPE | STATX_SIZE | STATX_MTIME, &st) != 0 || !S_ISREG(st.stx_mode))
+        return;
+      check.size = st.stx_size;
+      check.dateTime = (time_t) st.stx_mtime.tv_sec;
+#else
+      if(!is_regular(check.filePath))
+        return;
+      check.size = file_size(check.filePath);
+      check.dateTime = last_write_time(check.filePath);
+#endif
+      check.exists = true;
+    } catch (std::exception &) {
+      check.exists = false;
+    }
+  }
+
+  static void examineBatch(ArrayList<boost::shared_ptr<FileCheck> > checks, uint32 first, uint32 count) {
+    for(uint32 i = first; i < first + count; i++)
+      examine(*checks[i]);
+  }
+
+  /**
+   * Stats all the files before any of them is read, CHECKERSTATBATCHSIZE files
+   * per job if there is a scheduler.
+   */
+  static void examineAll(ArrayList<boost::shared_ptr<FileCheck> > checks, optional<Scheduler> scheduler) {
+    if(!scheduler || checks.size() <= CHECKERSTATBATCHSIZE) {
+      examineBatch(checks, 0, checks.size());
+      return;
+    }
+    JobGroup group(*scheduler);
+    for(uint32 first = 0; first < checks.size(); first += CHECKERSTATBATCHSIZE)
+      group.run(boost::bind(&TextFileChecker::examineBatch, checks, first, std::min<uint32>(CHECKERSTATBATCHSIZE, checks.size() - first)));
+    group.wait();
+  }
+
+  static void verify(FileCheck& check, optional<HashCache> cache, HasherCallBack callBack) {
+    try {
+      if(!check.exists)
+        throw runtime_error("v_v");
+
+      HashTask hashTask = check.task.getHashTask();
+      FileEntry rightEntry = check.task.getRightEntry();
+      FileEntry realEntry = FileEntry(check.filePath);
+      realEntry.setSize(check.size);
+
+      Hasher hasher(hashTask, options.isMultiThreaded(), callBack);
+      hasher.setCache(cache);
+      ArrayList<FileEntry> entries;
+      entries.add(realEntry);
+      hasher.hash(entries);
+
+      if(realEntry.isFailed())
+        throw runtime_error("v_v");
+
+      for(int hashId = 0; hashId < H_COUNT; hashId++) {
+        if(hashTask.isSet(hashId)) {
+          if(rightEntry.getDigest(hashId) != realEntry.getDigest(hashId))
+            check.errors.push_back(CheckError(CE_WRONGHASH, hashId, rightEntry.getDigest(hashId), realEntry.getDigest(hashId)));
+          if(check.task.isSizeNeedsChecking() && rightEntry.getSize() != realEntry.getSize())
+            check.errors.push_back(CheckError(CE_WRONGSIZE, rightEntry.getSize(), realEntry.getSize()));
+        }
+      }
+    } catch (std::exception &) {
+      check.errors.push_back(CheckError(CE_NOACCESS));
+    }
+  }
+
+  static void verifyQueued(ArrayList<boost::shared_ptr<FileCheck> > checks, uint32 index, optional<HashCache> cache, boost::shared_ptr<CheckQueue> queue) {
+    verify(*checks[index], cache, HasherCallBack());
+    mutex::scoped_lock lock(queue->queueMutex);
+    checks[index]->done = true;
+    queue->finished.push_back(index);
+  }
+
+  /**
+   * Reports the finished checks, in the order files are listed unless the
+   * output is streamed.
+   * @returns number of checks reported so far.
+   */
+  static uint32 reportFinished(ArrayList<boost::shared_ptr<FileCheck> > checks, uint32 reported, boost::shared_ptr<CheckQueue> queue, CheckResultReporter reporter) {
+    for(;;) {
+      boost::shared_ptr<FileCheck> check;
+      {
+        mutex::scoped_lock lock(queue->queueMutex);
+        if(options.isStreaming()) {
+          if(queue->finished.empty())
+            return reported;
+          check = checks[queue->finished.front()];
+          queue->finished.pop_front();
+        } else {
+          if(reported == checks.size() || !checks[reported]->done)
+            return reported;
+          check = checks[reported];
+        }
+      }
+      reporter.beginFile(check->filePath, check->fileString);
+      reporter.endFile(check->errors);
+      reported++;
+    }
+  }
+
+  /**
+   * Checks the files on the scheduler, several at once. There is no progress
+   * of single files then.
+   */
+  static void checkParallel(ArrayList<boost::shared_ptr<FileCheck> > checks, CheckResultReporter reporter, optional<HashCache> cache, Scheduler scheduler) {
+    boost::shared_ptr<CheckQueue> queue(new CheckQueue());
+    uint32 reported = 0;
+    JobGroup group(scheduler);
+    for(uint32 i = 0; i < checks.size(); i++) {
+      group.run(boost::bind(&TextFileChecker::verifyQueued, checks, i, cache, queue));
+      group.wait(CHECKERQUEUESIZE);
+      reported = reportFinished(checks, reported, queue, reporter);
+    }
+    group.wait();
+    reportFinished(checks, reported, queue, reporter);
+  }
+
+  virtual void check(path fileName, CheckResultReporter reporter, optional<HashCache> cache, optional<Scheduler> scheduler) {
     path dir = fileName.branch_path();
     if(dir == _T(""))
       dir = _T(".");
@@ -447,6 +763,7 @@ public:
 
     Map<wstring, CheckTask> checkTasks;
     shared_array<bool> isApplicable = shared_array<bool>(new bool[lineCheckers.size()]);
+    shared_array<ParsedLine> parsedLines = shared_array<ParsedLine>(new ParsedLine[lineCheckers.size()]);
     shared_array<bool> isDefaultFor = shared_array<bool>(new bool[lineCheckers.size()]);
     for(int i = 0; i < lineCheckers.size(); i++)
       isDefaultFor[i] = lineCheckers[i]->isDefaultFor(fileName);
@@ -471,7 +788,7 @@ public:
       }
 
       for(int i = 0; i < lineCheckers.size(); i++)
-        isApplicable[i] = lineCheckers[i]->applicableTo(s);
+        isApplicable[i] = lineCheckers[i]->parse(s, parsedLines[i]);
 
       int applicableCount = 0;
       int applicableIndex = -1;
@@ -503,42 +820,61 @@ public:
         }
       }
 
-      lineCheckers[applicableIndex]->parseLine(s, checkTasks);
+      /* Digests too long to be stored and sizes that overflow end up here. */
+      try {
+        addCheckTask(s, parsedLines[applicableIndex], checkTasks);
+      } catch (std::exception &) {
+        reporter.error(CheckError(CE_WRONGFORMAT, lineN));
+        criticalErrorCount++;
+      }
     }
 
-    for(Map<wstring, CheckTask>::iterator i = checkTasks.begin(); i != checkTasks.end(); i++) {
-      path filePath = i->second.getRightEntry().getPath();
-      wstring fileString = filePath.native();
-      if(!filePath.is_complete())
-        filePath = dir / filePath;
+    ArrayList<boost::shared_ptr<FileCheck> > checks;
+    for(Map<wstring, CheckTask>::iterator i = checkTasks.begin(); i != checkTasks.end(); i++)
+      checks.add(boost::shared_ptr<FileCheck>(new FileCheck(dir, i->second)));
+    examineAll(checks, scheduler);
 
-      reporter.beginFile(filePath, fileString);
-      ArrayList<CheckError> errors;
-      try {
-        DelegatingHasherCallBack callBack(reporter);
-        
-        HashTask hashTask = i->second.getHashTask();
-        FileEntry rightEntry = i->second.getRightEntry();
-        FileEntry realEntry = FileEntry(rightEntry.getPath());
-
-        Hasher hasher(hashTask, options.isMultiThreaded(), callBack);
-        hasher.hash(realEntry);
-
-        if(realEntry.isFailed())
-          throw runtime_error("v_v");
-
-        for(int hashId = 0; hashId < H_COUNT; hashId++) {
-          if(hashTask.isSet(hashId)) {
-            if(rightEntry.getDigest(hashId) != realEntry.getDigest(hashId))
-              errors.push_back(CheckError(CE_WRONGHASH, hashId, rightEntry.getDigest(hashId), realEntry.getDigest(hashId)));
-            if(i->second.isSizeNeedsChecking() && rightEntry.getSize() != file_size(filePath))
-              errors.push_back(CheckError(CE_WRONGSIZE, rightEntry.getSize(), realEntry.getSize()));
-          }
-        }
-      } catch (std::exception &) {
-        errors.push_back(CheckError(CE_NOACCESS));
+    /* Missing files and files of wrong size are reported before anything is 
+     * read. Files changed after the checksum file was written are the likeliest
+     * to fail, so they are verified first. */
+    time_t checkSumDateTime;
+    try {
+      checkSumDateTime = last_write_time(fileName);
+    } catch (std::exception &) {
+      checkSumDateTime = 0;
+    }
+    ArrayList<boost::shared_ptr<FileCheck> > changedChecks, unchangedChecks;
+    FOREACH(boost::shared_ptr<FileCheck> check, checks) {
+      FileEntry rightEntry = check->task.getRightEntry();
+      if(!check->exists)
+        check->errors.push_back(CheckError(CE_NOACCESS));
+      else if(check->task.isSizeNeedsChecking() && rightEntry.getSize() != check->size)
+        check->errors.push_back(CheckError(CE_WRONGSIZE, rightEntry.getSize(), check->size));
+
+      if(!check->errors.empty()) {
+        reporter.beginFile(check->filePath, check->fileString);
+        reporter.endFile(check->errors);
+      } else if(options.isQuick()) {
+        reporter.beginFile(check->filePath, check->fileString);
+        reporter.endUnreadFile(check->task.isSizeNeedsChecking());
+      } else if(check->dateTime > checkSumDateTime) {
+        changedChecks.add(check);
+      } else {
+        unchangedChecks.add(check);
+      }
+    }
+    FOREACH(boost::shared_ptr<FileCheck> check, unchangedChecks)
+      changedChecks.add(check);
+    checks = changedChecks;
+
+    if(scheduler && checks.size() > 1) {
+      checkParallel(checks, reporter, cache, *scheduler);
+    } else {
+      FOREACH(boost::shared_ptr<FileCheck> check, checks) {
+        reporter.beginFile(check->filePath, check->fileString);
+        verify(*check, cache, DelegatingHasherCallBack(reporter));
+        reporter.endFile(check->errors);
       }
-      reporter.endFile(errors);
     }
 
     reporter.end();
@@ -563,14 +899,24 @@ class Checker::CheckerImpl {
 private:
   CheckResultReporter reporter;
   FileChecker checker;
+  optional<HashCache> cache;
+  optional<Scheduler> scheduler;
 
 public:
   CheckerImpl(CheckResultReporter reporter): reporter(reporter) {
     return;
   }
 
+  void setCache(optional<HashCache> cache) {
+    this->cache = cache;
+  }
+
+  void setScheduler(optional<Scheduler> scheduler) {
+    this->scheduler = scheduler;
+  }
+
   void check(path filePath) {
-    checker.check(filePath, reporter);
+    checker.check(filePath, reporter, cache, scheduler);
   }
 };
 
@@ -585,3 +931,11 @@ void Checker::check(boost::filesystem::path filePath)  {
   this->impl->check(filePath);
 }
 
+void Checker::setCache(boost::optional<HashCache> cache) {
+  this->impl->setCache(cache);
+}
+
+void Checker::setScheduler(boost::optional<Scheduler> scheduler) {
+  this->impl->setScheduler(scheduler);
+}
+
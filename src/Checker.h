@@ -8,6 +8,7 @@
 #include "ArrayList.h"
 #include "Hash.h"
 #include "Hasher.h"
+#include "Scheduler.h"
 
 // -------------------------------------------------------------------------- //
 // CheckError
@@ -54,7 +55,7 @@ namespace detail {
 
 class CheckResultReporter {
 private:
-  boost::shared_ptr<::detail::CheckResultReporterImpl> impl;
+  boost::shared_ptr< ::detail::CheckResultReporterImpl> impl;
 
 protected:
   CheckResultReporter(::detail::CheckResultReporterImpl* impl);
@@ -68,6 +69,12 @@ public:
   void beginFile(const boost::filesystem::path& filePath, const std::wstring& fileString);
   void update(uint64 justProcessed);
   void endFile(ArrayList<CheckError> errors);
+
+  /**
+   * Ends a file that was found, and was of the right size if sizeChecked, 
+   * but whose data was not read, as with --quick.
+   */
+  void endUnreadFile(bool sizeChecked);
   void end();
 };
 
@@ -89,6 +96,18 @@ private:
 public:
   Checker(CheckResultReporter reporter = CheckResultReporter());
   void check(boost::filesystem::path filePath);
+
+  /**
+   * Sets the cache consulted when hashing the files being checked.
+   */
+  void setCache(boost::optional<HashCache> cache);
+
+  /**
+   * Sets the scheduler the files being checked are verified on. Several files
+   * of a checksum file are then verified at once, and are reported in the
+   * order they are listed, or as they are finished with --stream.
+   */
+  void setScheduler(boost::optional<Scheduler> scheduler);
 };
 
 
@@ -0,0 +1,210 @@
+#include "config.h"
+#include "DirectoryWalker.h"
+#include <string>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/algorithm/string.hpp>
+
+#ifdef ARX_LINUX
+#  include <sys/syscall.h>
+#  include <sys/stat.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#  include <dirent.h>
+#endif
+
+using namespace std;
+using namespace boost;
+using namespace boost::algorithm;
+using namespace boost::filesystem;
+
+namespace detail {
+// -------------------------------------------------------------------------- //
+// DirectoryWalkerImpl
+// -------------------------------------------------------------------------- //
+  class DirectoryWalkerImpl {
+  private:
+    struct FoundFile {
+      wstring path;
+      uint64 size;
+      time_t dateTime;
+
+      FoundFile(const wstring& path, uint64 size, time_t dateTime): path(path), size(size), dateTime(dateTime) {}
+    };
+
+    FileTable fileList;
+    optional<Scheduler> scheduler;
+    mutex fileListMutex;
+
+    static wstring makeFilePath(const wstring& dir, const wstring& name) {
+      wstring filePath = dir;
+      if(!filePath.empty() && filePath[filePath.size() - 1] != path::preferred_separator)
+        filePath += path::preferred_separator;
+      filePath += name;
+      if(starts_with(filePath, ".") && !starts_with(filePath, ".."))
+        filePath = filePath.substr(2);
+      return filePath;
+    }
+
+    void addFiles(const vector<FoundFile>& files) {
+      mutex::scoped_lock lock(this->fileListMutex);
+      FOREACH(const FoundFile& file, files)
+        this->fileList.add(file.path, file.size, file.dateTime);
+    }
+
+    void enterDirectory(path dir, FileMask fileNameMask, optional<JobGroup> group) {
+      if(group)
+        group->run(bind(&DirectoryWalkerImpl::walkDirectory, this, dir, fileNameMask, true, group));
+      else
+        walkDirectory(dir, fileNameMask, true, group);
+    }
+
+#ifdef ARX_LINUX
+    struct LinuxDirent64 {
+      uint64 d_ino;
+      int64 d_off;
+      unsigned short d_reclen;
+      unsigned char d_type;
+      char d_name[1];
+    };
+
+    class DirectoryHandle: private noncopyable {
+    public:
+      int fd;
+      explicit DirectoryHandle(const char* name): fd(open(name, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) {}
+      ~DirectoryHandle() {
+        if(this->fd >= 0)
+          close(this->fd);
+      }
+    };
+
+    struct FileStatus {
+      bool isDirectory;
+      bool isRegular;
+      uint64 size;
+      time_t dateTime;
+    };
+
+    /** Follows symlinks, just like boost::filesystem::status. */
+    static bool statAt(int dirFd, const char* name, FileStatus& status) {
+#ifdef STATX_SIZE
+      struct statx st;
+      if(statx(dirFd, name, AT_STATX_SYNC_AS_STAT, STATX_TYPE | STATX_SIZE | STATX_MTIME, &st) != 0)
+        return false;
+      status.isDirectory = S_ISDIR(st.stx_mode);
+      status.isRegular = S_ISREG(st.stx_mode);
+      status.size = st.stx_size;
+      status.dateTime = (time_t) st.stx_mtime.tv_sec;
+#else
+      struct stat st;
+      if(fstatat(dirFd, name, &st, 0) != 0)
+        return false;
+      status.isDirectory = S_ISDIR(st.st_mode);
+      status.isRegular = S_ISREG(st.st_mode);
+      status.size = st.st_size;
+      status.dateTime = st.st_mtime;
+#endif
+      return true;
+    }
+
+    void walkDirectory(path dir, FileMask fileNameMask, bool isRecursive, optional<JobGroup> group) {
+      vector<FoundFile> files;
+      try {
+        DirectoryHandle handle(dir.string().c_str());
+        if(handle.fd < 0)
+          return;
+        wstring wideDir = dir.wstring();
+        scoped_array<char> buffer(new char[DIRBUFSIZE]);
+        long bytesRead;
+        while((bytesRead = syscall(SYS_getdents64, handle.fd, buffer.get(), DIRBUFSIZE)) > 0) {
+          for(long pos = 0; pos < bytesRead;) {
+            LinuxDirent64* dirent = (LinuxDirent64*) (buffer.get() + pos);
+            pos += dirent->d_reclen;
+            const char* name = dirent->d_name;
+            unsigned char type = dirent->d_type;
+            if(name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0)))
+              continue;
+            if(type == DT_DIR) {
+              if(isRecursive)
+                enterDirectory(dir / name, fileNameMask, group);
+              continue;
+            }
+            if(type != DT_REG && type != DT_LNK && type != DT_UNKNOWN)
+              continue;
+
+            /* Names are matched before stat'ing, unless it's not yet known what the entry is. */
+            wstring wideName = path(name).wstring();
+            bool matches = fileNameMask.matches(wideName);
+            if(type == DT_REG && !matches)
+              continue;
+            FileStatus status;
+            if(!statAt(handle.fd, name, status))
+              continue;
+            if(status.isDirectory) {
+              if(isRecursive)
+                enterDirectory(dir / name, fileNameMask, group);
+            } else if(status.isRegular && matches) {
+              files.push_back(FoundFile(makeFilePath(wideDir, wideName), status.size, status.dateTime));
+            }
+          }
+        }
+      } catch (std::exception &) {
+        // cout << e.what() << endl;
+      }
+      addFiles(files);
+    }
+#else
+    void walkDirectory(path dir, FileMask fileNameMask, bool isRecursive, optional<JobGroup> group) {
+      vector<FoundFile> files;
+      directory_iterator end;
+      try {
+        wstring wideDir = dir.wstring();
+        for(directory_iterator itr(dir); itr != end; itr++) {
+          file_status status = itr->status();
+          if(is_directory(status)) {
+            if(isRecursive)
+              enterDirectory(*itr, fileNameMask, group);
+          } else if(is_regular(status)) {
+            wstring wideName = itr->path().filename().wstring();
+            if(fileNameMask.matches(wideName))
+              files.push_back(FoundFile(makeFilePath(wideDir, wideName), file_size(itr->path()), last_write_time(itr->path())));
+          }
+        }
+      } catch (std::exception &) {
+        // cout << e.what() << endl;
+      }
+      addFiles(files);
+    }
+#endif
+
+  public:
+    DirectoryWalkerImpl(FileTable fileList, optional<Scheduler> scheduler): fileList(fileList), scheduler(scheduler) {
+      return;
+    }
+
+    void walk(path dir, FileMask fileNameMask, bool isRecursive) {
+      if(!this->scheduler) {
+        walkDirectory(dir, fileNameMask, isRecursive, none);
+        return;
+      }
+      JobGroup group(*this->scheduler);
+      walkDirectory(dir, fileNameMask, isRecursive, group);
+      group.wait();
+    }
+  };
+}
+
+// -------------------------------------------------------------------------- //
+// DirectoryWalker
+// -------------------------------------------------------------------------- //
+DirectoryWalker::DirectoryWalker(FileTable fileList, optional<Scheduler> scheduler): impl(new ::detail::DirectoryWalkerImpl(fileList, scheduler)) {
+  return;
+}
+
+void DirectoryWalker::walk(wpath dir, FileMask fileNameMask, bool isRecursive) {
+  this->impl->walk(dir, fileNameMask, isRecursive);
+}
@@ -0,0 +1,39 @@
+#ifndef __DIRECTORYWALKER_H__
+#define __DIRECTORYWALKER_H__
+
+#include "config.h"
+#include "FileEntry.h"
+#include "Scheduler.h"
+#include <boost/shared_ptr.hpp>
+#include <boost/optional.hpp>
+#include <boost/filesystem.hpp>
+#include "FileMask.h"
+
+// -------------------------------------------------------------------------- //
+// DirectoryWalker
+// -------------------------------------------------------------------------- //
+namespace detail {
+  class DirectoryWalkerImpl;
+}
+
+/**
+ * DirectoryWalker adds the regular files of a directory that match a mask to
+ * a file table, together with their sizes and modification times. On linux
+ * directory entries are read in bulk with getdents64, entry types are taken
+ * from the directory itself, and only the matching files are stat'ed.
+ *
+ * Given a scheduler, every directory is read as a separate job, so that
+ * several directories are read at once. Files are then added to the table in
+ * no particular order.
+ */
+class DirectoryWalker {
+private:
+  boost::shared_ptr< ::detail::DirectoryWalkerImpl> impl;
+
+public:
+  DirectoryWalker(FileTable fileList, boost::optional<Scheduler> scheduler = boost::none);
+
+  void walk(boost::filesystem::wpath dir, FileMask fileNameMask, bool isRecursive);
+};
+
+#endif
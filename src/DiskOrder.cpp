@@ -0,0 +1,156 @@
+#include "config.h"
+#include "DiskOrder.h"
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <fstream>
+#include <boost/thread/mutex.hpp>
+
+#ifdef ARX_LINUX
+#  include <sys/ioctl.h>
+#  include <sys/stat.h>
+#  include <sys/sysmacros.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#  include <linux/fs.h>
+#  include <linux/fiemap.h>
+#endif
+
+using namespace std;
+using namespace boost;
+
+namespace detail {
+// -------------------------------------------------------------------------- //
+// DiskLocation
+// -------------------------------------------------------------------------- //
+  struct DiskLocation {
+    enum {
+      L_EXTENT,
+      L_INODE,
+      L_UNKNOWN
+    };
+
+    uint64 device;
+    uint32 kind;
+    uint64 offset;
+    uint32 row;
+
+    bool operator< (const DiskLocation& that) const {
+      if(this->kind == L_UNKNOWN || that.kind == L_UNKNOWN)
+        return this->kind < that.kind;
+      if(this->device != that.device)
+        return this->device < that.device;
+      if(this->kind != that.kind)
+        return this->kind < that.kind;
+      return this->offset < that.offset;
+    }
+  };
+
+#ifdef ARX_LINUX
+  DiskLocation locate(FileEntry entry, uint32 row) {
+    DiskLocation location;
+    location.device = 0;
+    location.kind = DiskLocation::L_UNKNOWN;
+    location.offset = 0;
+    location.row = row;
+    if(entry.isFailed())
+      return location;
+
+    int fd = open(entry.getPath().string().c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+      return location;
+    struct stat st;
+    if(fstat(fd, &st) == 0) {
+      location.device = st.st_dev;
+      location.kind = DiskLocation::L_INODE;
+      location.offset = st.st_ino;
+
+      /* Only the first extent is needed, files are read from the start. */
+      union {
+        struct fiemap map;
+        char space[sizeof(struct fiemap) + sizeof(struct fiemap_extent)];
+      } request;
+      memset(&request, 0, sizeof(request));
+      request.map.fm_start = 0;
+      request.map.fm_length = FIEMAP_MAX_OFFSET;
+      request.map.fm_extent_count = 1;
+      if(ioctl(fd, FS_IOC_FIEMAP, &request.map) == 0 && request.map.fm_mapped_extents > 0 &&
+         !(request.map.fm_extents[0].fe_flags & (FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_NOT_ALIGNED))) {
+        location.kind = DiskLocation::L_EXTENT;
+        location.offset = request.map.fm_extents[0].fe_physical;
+      }
+    }
+    close(fd);
+    return location;
+  }
+
+  /** Maps a partition to the disk it belongs to using sysfs. */
+  uint64 getWholeDisk(dev_t device) {
+    static map<dev_t, uint64> disks;
+    static mutex disksMutex;
+    mutex::scoped_lock lock(disksMutex);
+    map<dev_t, uint64>::iterator i = disks.find(device);
+    if(i != disks.end())
+      return i->second;
+
+    uint64 result = device;
+    char name[64];
+    sprintf(name, "/sys/dev/block/%u:%u", major(device), minor(device));
+    char* realName = realpath(name, NULL);
+    if(realName != NULL) {
+      string dir = realName;
+      free(realName);
+      if(access((dir + "/partition").c_str(), F_OK) == 0) {
+        ifstream file((dir + "/../dev").c_str());
+        unsigned int diskMajor, diskMinor;
+        char colon;
+        if(file >> diskMajor >> colon >> diskMinor)
+          result = makedev(diskMajor, diskMinor);
+      }
+    }
+    disks[device] = result;
+    return result;
+  }
+#endif
+}
+
+// -------------------------------------------------------------------------- //
+// getDiskOrder
+// -------------------------------------------------------------------------- //
+vector<uint32> getDiskOrder(FileTable table) {
+  vector<uint32> result(table.size());
+#ifdef ARX_LINUX
+  vector< ::detail::DiskLocation> locations;
+  locations.reserve(table.size());
+  for(uint32 row = 0; row < table.size(); row++)
+    locations.push_back(::detail::locate(table[row], row));
+  stable_sort(locations.begin(), locations.end());
+  for(uint32 i = 0; i < locations.size(); i++)
+    result[i] = locations[i].row;
+#else
+  for(uint32 row = 0; row < table.size(); row++)
+    result[row] = row;
+#endif
+  return result;
+}
+
+// -------------------------------------------------------------------------- //
+// getDiskId
+// -------------------------------------------------------------------------- //
+uint64 getDiskId(FileEntry entry) {
+  return entry.isFailed() ? 0 : getDiskId(entry.getPath());
+}
+
+uint64 getDiskId(const boost::filesystem::wpath& path) {
+#ifdef ARX_LINUX
+  struct stat st;
+  if(stat(path.string().c_str(), &st) != 0)
+    return 0;
+  return ::detail::getWholeDisk(st.st_dev);
+#else
+  return 0;
+#endif
+}
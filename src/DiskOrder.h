@@ -0,0 +1,38 @@
+#ifndef __DISKORDER_H__
+#define __DISKORDER_H__
+
+#include "config.h"
+#include <vector>
+#include "FileEntry.h"
+
+// -------------------------------------------------------------------------- //
+// getDiskOrder
+// -------------------------------------------------------------------------- //
+/**
+ * Orders the rows of a file table the way their data lies on disk, so that
+ * reading the files one after another doesn't make a hard disk seek back and
+ * forth. On linux files are ordered by device and by the physical offset of
+ * their first extent, as reported by FIEMAP. Files the filesystem can't map
+ * go after them, ordered by inode number. Failed rows come last. Elsewhere
+ * the table order is kept.
+ *
+ * @returns indices of the rows in the order they should be read.
+ */
+std::vector<uint32> getDiskOrder(FileTable table);
+
+// -------------------------------------------------------------------------- //
+// getDiskId
+// -------------------------------------------------------------------------- //
+/**
+ * Identifies the disk a file is stored on. On linux partitions are mapped to
+ * the disk they belong to, other devices are identified by their number.
+ * Elsewhere, and for files that cannot be stat'ed, 0 is returned.
+ */
+uint64 getDiskId(FileEntry entry);
+
+/**
+ * Identifies the disk a file or a directory is stored on, see above.
+ */
+uint64 getDiskId(const boost::filesystem::wpath& path);
+
+#endif
@@ -1,6 +1,13 @@
 #include "config.h"
 #include "FileEntry.h"
+#include "Task.h"
 
+#include <map>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cstring>
+#include <cwchar>
 #include <boost/filesystem.hpp>
 #include <boost/array.hpp>
 
@@ -8,81 +15,339 @@ using namespace std;
 using namespace boost;
 using namespace boost::filesystem;
 
-class FileEntry::FileEntryImpl {
-private:
-  boost::filesystem::wpath name;
-  boost::array<Digest, H_COUNT> digest;
-  unsigned long long size;
-  time_t dateTime;
-  bool failed;
-public:
-  FileEntryImpl(wpath name) : name(name), failed(false) {};
-  FileEntryImpl(wstring name): name(boost::filesystem::wpath(name)), failed(false) {};
-  FileEntryImpl(wchar_t* name): name(boost::filesystem::wpath(name)), failed(false) {};
-  bool isFailed() const {
-    return this->failed;
-  }
-  void setFailed(bool failed) {
-    this->failed = failed;
-  }
-  wpath getPath() const {
-    return this->name;
-  }
-  void setSize(uint64 size) {
-    this->size = size;
-  }
-  uint64 getSize() const {
-    return this->size;
-  }
-  void setDateTime(time_t dateTime) {
-    this->dateTime = dateTime;
-  }
-  time_t getDateTime() const {
-    return this->dateTime;
-  }
-  void setDigest(uint32 id, Digest digestString) {
-    digest[id] = digestString;
-  }
-  Digest getDigest(uint32 id) const {
-    return digest[id];
-  }
-  bool operator< (const FileEntryImpl& that) const {
-    return this->name < that.name;
-  }
-};
+namespace detail {
+// -------------------------------------------------------------------------- //
+// FileTableImpl
+// -------------------------------------------------------------------------- //
+  class FileTableImpl {
+  public:
+    enum {
+      NO_PARENT = 0xFFFFFFFF
+    };
+
+    enum {
+      F_FAILED = 1,
+      F_STATUS_KNOWN = 2
+    };
+
+    /* Names of files and directories, zero-terminated. Each name but the
+     * topmost ones starts with the separator that precedes it in the path. */
+    vector<wchar_t> names;
+
+    /* Directories. */
+    vector<uint32> dirParents;
+    vector<size_t> dirNames;
+    vector<uint32> dirDepths;
+    map<pair<uint32, wstring>, uint32> dirIndex;
+    wstring lastDir;
+    uint32 lastDirNode;
+
+    /* Files. */
+    vector<uint32> parents;
+    vector<size_t> leafNames;
+    vector<uint64> sizes;
+    vector<time_t> dateTimes;
+    vector<unsigned char> flags;
+
+    /* Digests, a column per hash, allocated once a hash is needed. Each 
+     * digest has a byte of its own telling whether it is set, so that 
+     * threads computing different hashes of a file never write to the same
+     * memory. */
+    array<vector<unsigned char>, H_COUNT> digests;
+    array<vector<unsigned char>, H_COUNT> digestsSet;
+
+    FileTableImpl(): lastDirNode(NO_PARENT) {}
+
+    static size_t findLastSeparator(const wstring& path) {
+#ifdef ARX_WIN
+      return path.find_last_of(_T("/\\"));
+#else
+      return path.find_last_of(_T('/'));
+#endif
+    }
+
+    size_t addName(const wstring& name) {
+      size_t offset = this->names.size();
+      this->names.insert(this->names.end(), name.begin(), name.end());
+      this->names.push_back(0);
+      return offset;
+    }
+
+    /** Returns the name of a file or a directory without the separator. */
+    const wchar_t* getName(uint32 parent, size_t name) const {
+      return &this->names[name] + (parent == NO_PARENT ? 0 : 1);
+    }
+
+    uint32 addDirectory(const wstring& dir) {
+      size_t pos = findLastSeparator(dir);
+      uint32 parent = (pos == wstring::npos) ? (uint32) NO_PARENT : addDirectory(dir.substr(0, pos));
+      pair<uint32, wstring> key(parent, (pos == wstring::npos) ? dir : dir.substr(pos));
+      map<pair<uint32, wstring>, uint32>::iterator i = this->dirIndex.find(key);
+      if(i != this->dirIndex.end())
+        return i->second;
+
+      uint32 node = (uint32) this->dirParents.size();
+      this->dirParents.push_back(parent);
+      this->dirNames.push_back(addName(key.second));
+      this->dirDepths.push_back(parent == NO_PARENT ? 0 : this->dirDepths[parent] + 1);
+      this->dirIndex[key] = node;
+      return node;
+    }
+
+    uint32 add(const wstring& path) {
+      size_t pos = findLastSeparator(path);
+      uint32 parent = NO_PARENT;
+      if(pos != wstring::npos) {
+        /* Files usually come directory after directory. */
+        if(this->lastDirNode == NO_PARENT || path.compare(0, pos, this->lastDir) != 0 || this->lastDir.size() != pos) {
+          this->lastDir = path.substr(0, pos);
+          this->lastDirNode = addDirectory(this->lastDir);
+        }
+        parent = this->lastDirNode;
+      }
+
+      uint32 row = (uint32) this->parents.size();
+      this->parents.push_back(parent);
+      this->leafNames.push_back(addName((pos == wstring::npos) ? path : path.substr(pos)));
+      this->sizes.push_back(0);
+      this->dateTimes.push_back(0);
+      this->flags.push_back(0);
+      for(uint32 i = 0; i < H_COUNT; i++) {
+        if(!this->digests[i].empty()) {
+          this->digests[i].resize(this->digests[i].size() + Hash::getDigestSize(i));
+          this->digestsSet[i].push_back(0);
+        }
+      }
+      return row;
+    }
 
-FileEntry::FileEntry(wpath name): impl(new FileEntryImpl(name)) {};
-FileEntry::FileEntry(wstring name): impl(new FileEntryImpl(name)) {};
-FileEntry::FileEntry(wchar_t* name): impl(new FileEntryImpl(name)) {};
+    void appendDirectory(uint32 dir, wstring& path) const {
+      if(dir == NO_PARENT)
+        return;
+      appendDirectory(this->dirParents[dir], path);
+      path += &this->names[this->dirNames[dir]];
+    }
+
+    wpath getPath(uint32 row) const {
+      wstring path;
+      appendDirectory(this->parents[row], path);
+      path += &this->names[this->leafNames[row]];
+      return wpath(path);
+    }
+
+    void allocateDigests(uint32 id) {
+      if(this->digests[id].empty()) {
+        this->digests[id].resize(this->parents.size() * Hash::getDigestSize(id));
+        this->digestsSet[id].resize(this->parents.size());
+      }
+    }
+
+    void setDigest(uint32 row, uint32 id, const Digest& digest) {
+      if(digest.size() != Hash::getDigestSize(id)) {
+        if(!this->digestsSet[id].empty())
+          this->digestsSet[id][row] = 0;
+        return;
+      }
+      allocateDigests(id);
+      memcpy(&this->digests[id][row * digest.size()], digest.get(), digest.size());
+      this->digestsSet[id][row] = 1;
+    }
+
+    Digest getDigest(uint32 row, uint32 id) const {
+      if(this->digestsSet[id].empty() || !this->digestsSet[id][row])
+        return Digest();
+      return Digest(&this->digests[id][row * Hash::getDigestSize(id)], Hash::getDigestSize(id));
+    }
+
+    /**
+     * Compares paths of two files element by element, the same way paths
+     * themselves are compared, without building them.
+     */
+    bool less(uint32 l, uint32 r) const {
+      uint32 lDir = this->parents[l], rDir = this->parents[r];
+      const wchar_t* lName = getName(lDir, this->leafNames[l]);
+      const wchar_t* rName = getName(rDir, this->leafNames[r]);
+      bool lIsFile = true, rIsFile = true;
+
+      /* Climb up to the children of the common ancestor. */
+      while(lDir != rDir) {
+        uint32 lDepth = (lDir == NO_PARENT) ? 0 : this->dirDepths[lDir] + 1;
+        uint32 rDepth = (rDir == NO_PARENT) ? 0 : this->dirDepths[rDir] + 1;
+        if(lDepth >= rDepth) {
+          lName = getName(this->dirParents[lDir], this->dirNames[lDir]);
+          lDir = this->dirParents[lDir];
+          lIsFile = false;
+        }
+        if(rDepth >= lDepth) {
+          rName = getName(this->dirParents[rDir], this->dirNames[rDir]);
+          rDir = this->dirParents[rDir];
+          rIsFile = false;
+        }
+      }
+
+      int cmp = wcscmp(lName, rName);
+      if(cmp != 0)
+        return cmp < 0;
+      /* Same name, the one that ends here goes first. */
+      return lIsFile && !rIsFile;
+    }
+
+    template<class T> static void permute(vector<T>& column, const vector<uint32>& order) {
+      vector<T> result;
+      result.reserve(column.size());
+      for(size_t i = 0; i < order.size(); i++)
+        result.push_back(column[order[i]]);
+      column.swap(result);
+    }
+
+    struct RowLess {
+      const FileTableImpl* table;
+      RowLess(const FileTableImpl* table): table(table) {}
+      bool operator() (uint32 l, uint32 r) const {
+        return table->less(l, r);
+      }
+    };
+
+    void sort() {
+      vector<uint32> order(this->parents.size());
+      for(uint32 i = 0; i < order.size(); i++)
+        order[i] = i;
+      std::stable_sort(order.begin(), order.end(), RowLess(this));
+
+      permute(this->parents, order);
+      permute(this->leafNames, order);
+      permute(this->sizes, order);
+      permute(this->dateTimes, order);
+      permute(this->flags, order);
+      for(uint32 id = 0; id < H_COUNT; id++) {
+        if(this->digests[id].empty())
+          continue;
+        permute(this->digestsSet[id], order);
+        size_t digestSize = Hash::getDigestSize(id);
+        vector<unsigned char> result(this->digests[id].size());
+        for(size_t i = 0; i < order.size(); i++)
+          memcpy(&result[i * digestSize], &this->digests[id][order[i] * digestSize], digestSize);
+        this->digests[id].swap(result);
+      }
+    }
+  };
+}
+
+// -------------------------------------------------------------------------- //
+// FileEntry
+// -------------------------------------------------------------------------- //
+FileEntry::FileEntry(boost::shared_ptr< ::detail::FileTableImpl> table, uint32 row): table(table), row(row) {};
+FileEntry::FileEntry(wpath name): table(new ::detail::FileTableImpl()) {
+  row = table->add(name.wstring());
+};
+FileEntry::FileEntry(wstring name): table(new ::detail::FileTableImpl()) {
+  row = table->add(name);
+};
+FileEntry::FileEntry(wchar_t* name): table(new ::detail::FileTableImpl()) {
+  row = table->add(name);
+};
+bool FileEntry::isStatusKnown() const {
+  return (table->flags[row] & ::detail::FileTableImpl::F_STATUS_KNOWN) != 0;
+}
 bool FileEntry::isFailed() const {
-  return impl->isFailed();
+  return (table->flags[row] & ::detail::FileTableImpl::F_FAILED) != 0;
 }
 void FileEntry::setFailed(bool failed) {
-  impl->setFailed(failed);
+  if(failed)
+    table->flags[row] |= ::detail::FileTableImpl::F_FAILED;
+  else
+    table->flags[row] &= ~::detail::FileTableImpl::F_FAILED;
 }
 wpath FileEntry::getPath() const {
-  return impl->getPath();
+  return table->getPath(row);
 }
 void FileEntry::setSize(uint64 size) {
-  impl->setSize(size);
+  table->sizes[row] = size;
 }
 uint64 FileEntry::getSize() const {
-  return impl->getSize();
+  return table->sizes[row];
 }
 void FileEntry::setDateTime(time_t dateTime) {
-  impl->setDateTime(dateTime);
+  table->dateTimes[row] = dateTime;
 }
 time_t FileEntry::getDateTime() const {
-  return impl->getDateTime();
+  return table->dateTimes[row];
 }
-void FileEntry::setDigest(uint32 id, Digest digestString) {
-  impl->setDigest(id, digestString);
+void FileEntry::setDigest(uint32 id, const Digest& digest) {
+  table->setDigest(row, id, digest);
 }
 Digest FileEntry::getDigest(uint32 id) const {
-  return impl->getDigest(id);
+  return table->getDigest(row, id);
 }
 bool FileEntry::operator< (const FileEntry& that) const {
-  return impl->operator< (*that.impl);
+  if(table == that.table)
+    return table->less(row, that.row);
+  return getPath() < that.getPath();
+}
+
+// -------------------------------------------------------------------------- //
+// FileTable
+// -------------------------------------------------------------------------- //
+FileTable::FileTable(): impl(new ::detail::FileTableImpl()) {
+  return;
+}
+
+uint32 FileTable::add(const wstring& path) {
+  return impl->add(path);
 }
 
+uint32 FileTable::add(const wstring& path, uint64 size, time_t dateTime) {
+  uint32 row = impl->add(path);
+  impl->sizes[row] = size;
+  impl->dateTimes[row] = dateTime;
+  impl->flags[row] |= ::detail::FileTableImpl::F_STATUS_KNOWN;
+  return row;
+}
+
+uint32 FileTable::size() const {
+  return (uint32) impl->parents.size();
+}
+
+bool FileTable::empty() const {
+  return impl->parents.empty();
+}
+
+FileEntry FileTable::operator[] (uint32 row) const {
+  return FileEntry(impl, row);
+}
 
+FileTable::iterator FileTable::begin() const {
+  return iterator(impl, 0);
+}
+
+FileTable::iterator FileTable::end() const {
+  return iterator(impl, size());
+}
+
+FileEntry FileTable::iterator::dereference() const {
+  return FileEntry(this->table, this->row);
+}
+
+ArrayList<FileEntry> FileTable::getEntries(uint32 first, uint32 count) const {
+  ArrayList<FileEntry> result;
+  for(uint32 i = first; i < first + count && i < size(); i++)
+    result.add(FileEntry(impl, i));
+  return result;
+}
+
+ArrayList<FileEntry> FileTable::getEntries(const vector<uint32>& rows, uint32 first, uint32 count) const {
+  ArrayList<FileEntry> result;
+  for(uint32 i = first; i < first + count && i < rows.size(); i++)
+    result.add(FileEntry(impl, rows[i]));
+  return result;
+}
+
+void FileTable::allocateDigests(HashTask task) {
+  for(uint32 i = 0; i < task.size(); i++)
+    if(task.isSet(i))
+      impl->allocateDigests(i);
+}
+
+void FileTable::sort() {
+  impl->sort();
+}
@@ -3,14 +3,30 @@
 
 #include "config.h"
 #include <string>
+#include <vector>
 #include <boost/filesystem.hpp>
 #include <boost/array.hpp>
+#include <boost/iterator/iterator_facade.hpp>
 #include "Hash.h"
+#include "ArrayList.h"
 
+class HashTask;
+
+namespace detail {
+  class FileTableImpl;
+}
+
+/**
+ * FileEntry is a handle to a row of a FileTable. Entries constructed from a
+ * path get a table of their own.
+ */
 class FileEntry {
 private:
-  class FileEntryImpl;
-  boost::shared_ptr<FileEntryImpl> impl;
+  friend class FileTable;
+  boost::shared_ptr< ::detail::FileTableImpl> table;
+  uint32 row;
+
+  FileEntry(boost::shared_ptr< ::detail::FileTableImpl> table, uint32 row);
 public:
   FileEntry() {};
   explicit FileEntry(boost::filesystem::wpath name);
@@ -18,6 +34,12 @@ public:
   explicit FileEntry(wchar_t* name);
 
   bool isFailed() const;
+
+  /**
+   * @returns true if the size and the modification time of the file were 
+   *   filled in when it was added to the table.
+   */
+  bool isStatusKnown() const;
   boost::filesystem::wpath getPath() const;
   uint64 getSize() const;
   time_t getDateTime() const;
@@ -26,9 +48,95 @@ public:
   void setFailed(bool failed);
   void setSize(uint64 size);
   void setDateTime(time_t dateTime);
-  void setDigest(uint32 id, Digest digest);
+  void setDigest(uint32 id, const Digest& digest);
 
   bool operator< (const FileEntry& that) const;
 };
 
+/**
+ * FileTable is a list of files stored column by column. Paths are kept as a
+ * leaf name and an index of the parent directory, names of all the files and
+ * directories are stored in a single arena. Sizes, times, flags and digests
+ * are packed into arrays, digests of a hash are only allocated once a digest
+ * of that hash is set.
+ *
+ * FileTable has a reference-counted pointer semantics, just like ArrayList.
+ */
+class FileTable {
+private:
+  boost::shared_ptr< ::detail::FileTableImpl> impl;
+public:
+  class iterator: public boost::iterator_facade<iterator, FileEntry, boost::random_access_traversal_tag, FileEntry> {
+  private:
+    friend class boost::iterator_core_access;
+    friend class FileTable;
+    boost::shared_ptr< ::detail::FileTableImpl> table;
+    uint32 row;
+
+    iterator(boost::shared_ptr< ::detail::FileTableImpl> table, uint32 row): table(table), row(row) {}
+    FileEntry dereference() const;
+    bool equal(const iterator& that) const {
+      return this->row == that.row;
+    }
+    void increment() {
+      this->row++;
+    }
+    void decrement() {
+      this->row--;
+    }
+    void advance(std::ptrdiff_t n) {
+      this->row += (uint32) n;
+    }
+    std::ptrdiff_t distance_to(const iterator& that) const {
+      return (std::ptrdiff_t) that.row - (std::ptrdiff_t) this->row;
+    }
+  public:
+    iterator(): row(0) {}
+  };
+  typedef iterator const_iterator;
+
+  FileTable();
+
+  /**
+   * Appends a file to the table.
+   * @returns index of the new row.
+   */
+  uint32 add(const std::wstring& path);
+
+  /**
+   * Appends a file whose size and modification time are already known.
+   * @returns index of the new row.
+   */
+  uint32 add(const std::wstring& path, uint64 size, time_t dateTime);
+
+  uint32 size() const;
+  bool empty() const;
+
+  FileEntry operator[] (uint32 row) const;
+  iterator begin() const;
+  iterator end() const;
+
+  /**
+   * Returns handles to count rows starting at the given one.
+   */
+  ArrayList<FileEntry> getEntries(uint32 first, uint32 count) const;
+
+  /**
+   * Returns handles to the rows listed in the given order, taking count of
+   * them starting at the given position of the list.
+   */
+  ArrayList<FileEntry> getEntries(const std::vector<uint32>& rows, uint32 first, uint32 count) const;
+
+  /**
+   * Allocates digests of the hashes of the given task for all the rows, so
+   * that they can be set from several threads at once.
+   */
+  void allocateDigests(HashTask task);
+
+  /**
+   * Sorts the rows by path.
+   */
+  void sort();
+};
+
 #endif
@@ -0,0 +1,142 @@
+#include "config.h"
+#include "FileMask.h"
+#include <set>
+#include <vector>
+#include <boost/foreach.hpp>
+#include <boost/algorithm/string.hpp>
+
+using namespace std;
+using namespace boost;
+using namespace boost::algorithm;
+
+namespace detail {
+// -------------------------------------------------------------------------- //
+// FileMaskImpl
+// -------------------------------------------------------------------------- //
+  class FileMaskImpl {
+  private:
+    enum PatternKind {
+      P_LITERAL,
+      P_PREFIX,
+      P_SUFFIX,
+      P_INFIX,
+      P_GLOB
+    };
+
+    struct Pattern {
+      PatternKind kind;
+      wstring text;
+
+      Pattern(PatternKind kind, const wstring& text): kind(kind), text(text) {}
+    };
+
+    vector<Pattern> patterns;
+    set<wstring> extensions;
+    bool matchesAll;
+
+    /**
+     * Matches a name against a glob, backtracking to the last '*' only, so it
+     * takes linear time for most of the patterns.
+     */
+    static bool matchGlob(const wchar_t* pattern, const wchar_t* name) {
+      const wchar_t* starPattern = NULL;
+      const wchar_t* starName = NULL;
+      while(*name != 0) {
+        if(*pattern == _T('*')) {
+          while(*pattern == _T('*'))
+            pattern++;
+          if(*pattern == 0)
+            return true;
+          starPattern = pattern;
+          starName = name;
+        } else if(*pattern == _T('?') || *pattern == *name) {
+          pattern++;
+          name++;
+        } else if(starPattern != NULL) {
+          pattern = starPattern;
+          name = ++starName;
+        } else {
+          return false;
+        }
+      }
+      while(*pattern == _T('*'))
+        pattern++;
+      return *pattern == 0;
+    }
+
+    bool matches(const Pattern& pattern, const wstring& name) const {
+      switch(pattern.kind) {
+      case P_LITERAL:
+        return name == pattern.text;
+      case P_PREFIX:
+        return starts_with(name, pattern.text);
+      case P_SUFFIX:
+        return ends_with(name, pattern.text);
+      case P_INFIX:
+        return name.find(pattern.text) != wstring::npos;
+      default:
+        return matchGlob(pattern.text.c_str(), name.c_str());
+      }
+    }
+
+  public:
+    FileMaskImpl(): matchesAll(false) {
+      return;
+    }
+
+    void add(const wstring& pattern) {
+      size_t stars = count(pattern.begin(), pattern.end(), _T('*'));
+      if(pattern.find(_T('?')) != wstring::npos)
+        this->patterns.push_back(Pattern(P_GLOB, pattern));
+      else if(stars == 0)
+        this->patterns.push_back(Pattern(P_LITERAL, pattern));
+      else if(stars == pattern.size())
+        this->matchesAll = true;
+      else if(stars == 1 && pattern[0] == _T('*')) {
+        wstring suffix = pattern.substr(1);
+        if(suffix[0] == _T('.') && suffix.find(_T('.'), 1) == wstring::npos)
+          this->extensions.insert(suffix.substr(1));
+        else
+          this->patterns.push_back(Pattern(P_SUFFIX, suffix));
+      } else if(stars == 1 && pattern[pattern.size() - 1] == _T('*'))
+        this->patterns.push_back(Pattern(P_PREFIX, pattern.substr(0, pattern.size() - 1)));
+      else if(stars == 2 && pattern[0] == _T('*') && pattern[pattern.size() - 1] == _T('*'))
+        this->patterns.push_back(Pattern(P_INFIX, pattern.substr(1, pattern.size() - 2)));
+      else
+        this->patterns.push_back(Pattern(P_GLOB, pattern));
+    }
+
+    bool matches(const wstring& name) const {
+      if(this->matchesAll)
+        return true;
+      if(!this->extensions.empty()) {
+        size_t pos = name.rfind(_T('.'));
+        if(pos != wstring::npos && this->extensions.find(name.substr(pos + 1)) != this->extensions.end())
+          return true;
+      }
+      FOREACH(const Pattern& pattern, this->patterns)
+        if(matches(pattern, name))
+          return true;
+      return false;
+    }
+  };
+}
+
+// -------------------------------------------------------------------------- //
+// FileMask
+// -------------------------------------------------------------------------- //
+FileMask::FileMask(): impl(new ::detail::FileMaskImpl()) {
+  return;
+}
+
+FileMask::FileMask(const wstring& pattern): impl(new ::detail::FileMaskImpl()) {
+  this->impl->add(pattern);
+}
+
+void FileMask::add(const wstring& pattern) {
+  this->impl->add(pattern);
+}
+
+bool FileMask::matches(const wstring& name) const {
+  return this->impl->matches(name);
+}
@@ -0,0 +1,38 @@
+#ifndef __FILEMASK_H__
+#define __FILEMASK_H__
+
+#include "config.h"
+#include <string>
+#include <boost/shared_ptr.hpp>
+
+// -------------------------------------------------------------------------- //
+// FileMask
+// -------------------------------------------------------------------------- //
+namespace detail {
+  class FileMaskImpl;
+}
+
+/**
+ * FileMask is a set of glob patterns of file names, where '*' stands for any
+ * number of characters and '?' for a single one. Patterns are compiled once:
+ * the common ones like "*.ext", "name*" or plain names are matched with simple
+ * comparisons, and "*.ext" patterns are looked up all at once by the extension
+ * of the name. Name matches a mask if it matches any of its patterns.
+ *
+ * FileMask has a reference-counted pointer semantics, matching doesn't change
+ * it and can be done from several threads at once.
+ */
+class FileMask {
+private:
+  boost::shared_ptr< ::detail::FileMaskImpl> impl;
+
+public:
+  FileMask();
+  explicit FileMask(const std::wstring& pattern);
+
+  void add(const std::wstring& pattern);
+
+  bool matches(const std::wstring& name) const;
+};
+
+#endif
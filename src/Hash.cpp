@@ -2,10 +2,25 @@
 #include "Hash.h"
 #include <string>
 #include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <utility>
+#include <map>
 #include <boost/lexical_cast.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/shared_array.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include "ArrayList.h"
+#include "hash/crc/crc32.h"
 #include "hash/md4/md4.h"
+#include "hash/md5/md5_mb.h"
 #include "hash/md5/md5.h"
+#include "hash/sha/sha1_mb.h"
 #include "hash/sha/sha.h"
 #include "hash/tth/TigerTree.h"
 
@@ -22,6 +37,37 @@ Digest calculateHash(const void* data, size_t len, uint32 hashId) {
   return hash.finalize();
 }
 
+ArrayList<Digest> calculateHashes(const ArrayList<const unsigned char*>& data, const ArrayList<size_t>& sizes, uint32 hashId) {
+  ArrayList<Digest> result;
+  if(data.empty())
+    return result;
+  if(hashId == H_MD5 || hashId == H_SHA1) {
+    size_t digestLength = (hashId == H_MD5) ? MD5_DIGEST_LENGTH : SHA_DIGEST_LENGTH;
+    scoped_array<unsigned char> digests(new unsigned char[digestLength * data.size()]);
+    ArrayList<unsigned char*> mds;
+    for(size_t i = 0; i < data.size(); i++)
+      mds.add(digests.get() + i * digestLength);
+    if(hashId == H_MD5)
+      MD5_MB(&data[0], &sizes[0], &mds[0], data.size());
+    else
+      SHA1_MB(&data[0], &sizes[0], &mds[0], data.size());
+    FOREACH(unsigned char* md, mds)
+      result.add(Digest(md, (unsigned int) digestLength));
+  } else {
+    for(size_t i = 0; i < data.size(); i++)
+      result.add(calculateHash(data[i], sizes[i], hashId));
+  }
+  return result;
+}
+
+bool isMultiBufferHash(uint32 hashId) {
+  if(hashId == H_MD5)
+    return MD5_MB_Lanes() != 0;
+  if(hashId == H_SHA1)
+    return SHA1_MB_Lanes() != 0;
+  return false;
+}
+
 unsigned char hexUnDump(char a) {
   if(a >= '0' && a <= '9')
     return (a - '0');
@@ -86,157 +132,23 @@ namespace detail {
 // ------------------------------------------------------------------------- //
 // CRC
 // ------------------------------------------------------------------------- //
-  static const uint32 s_crc32Table[256] = {
-    0x00000000, 0x77073096, 0xEE0E612C, 0x990951BA,
-    0x076DC419, 0x706AF48F, 0xE963A535, 0x9E6495A3,
-    0x0EDB8832, 0x79DCB8A4, 0xE0D5E91E, 0x97D2D988,
-    0x09B64C2B, 0x7EB17CBD, 0xE7B82D07, 0x90BF1D91,
-    0x1DB71064, 0x6AB020F2, 0xF3B97148, 0x84BE41DE,
-    0x1ADAD47D, 0x6DDDE4EB, 0xF4D4B551, 0x83D385C7,
-    0x136C9856, 0x646BA8C0, 0xFD62F97A, 0x8A65C9EC,
-    0x14015C4F, 0x63066CD9, 0xFA0F3D63, 0x8D080DF5,
-    0x3B6E20C8, 0x4C69105E, 0xD56041E4, 0xA2677172,
-    0x3C03E4D1, 0x4B04D447, 0xD20D85FD, 0xA50AB56B,
-    0x35B5A8FA, 0x42B2986C, 0xDBBBC9D6, 0xACBCF940,
-    0x32D86CE3, 0x45DF5C75, 0xDCD60DCF, 0xABD13D59,
-    0x26D930AC, 0x51DE003A, 0xC8D75180, 0xBFD06116,
-    0x21B4F4B5, 0x56B3C423, 0xCFBA9599, 0xB8BDA50F,
-    0x2802B89E, 0x5F058808, 0xC60CD9B2, 0xB10BE924,
-    0x2F6F7C87, 0x58684C11, 0xC1611DAB, 0xB6662D3D,
-
-    0x76DC4190, 0x01DB7106, 0x98D220BC, 0xEFD5102A,
-    0x71B18589, 0x06B6B51F, 0x9FBFE4A5, 0xE8B8D433,
-    0x7807C9A2, 0x0F00F934, 0x9609A88E, 0xE10E9818,
-    0x7F6A0DBB, 0x086D3D2D, 0x91646C97, 0xE6635C01,
-    0x6B6B51F4, 0x1C6C6162, 0x856530D8, 0xF262004E,
-    0x6C0695ED, 0x1B01A57B, 0x8208F4C1, 0xF50FC457,
-    0x65B0D9C6, 0x12B7E950, 0x8BBEB8EA, 0xFCB9887C,
-    0x62DD1DDF, 0x15DA2D49, 0x8CD37CF3, 0xFBD44C65,
-    0x4DB26158, 0x3AB551CE, 0xA3BC0074, 0xD4BB30E2,
-    0x4ADFA541, 0x3DD895D7, 0xA4D1C46D, 0xD3D6F4FB,
-    0x4369E96A, 0x346ED9FC, 0xAD678846, 0xDA60B8D0,
-    0x44042D73, 0x33031DE5, 0xAA0A4C5F, 0xDD0D7CC9,
-    0x5005713C, 0x270241AA, 0xBE0B1010, 0xC90C2086,
-    0x5768B525, 0x206F85B3, 0xB966D409, 0xCE61E49F,
-    0x5EDEF90E, 0x29D9C998, 0xB0D09822, 0xC7D7A8B4,
-    0x59B33D17, 0x2EB40D81, 0xB7BD5C3B, 0xC0BA6CAD,
-
-    0xEDB88320, 0x9ABFB3B6, 0x03B6E20C, 0x74B1D29A,
-    0xEAD54739, 0x9DD277AF, 0x04DB2615, 0x73DC1683,
-    0xE3630B12, 0x94643B84, 0x0D6D6A3E, 0x7A6A5AA8,
-    0xE40ECF0B, 0x9309FF9D, 0x0A00AE27, 0x7D079EB1,
-    0xF00F9344, 0x8708A3D2, 0x1E01F268, 0x6906C2FE,
-    0xF762575D, 0x806567CB, 0x196C3671, 0x6E6B06E7,
-    0xFED41B76, 0x89D32BE0, 0x10DA7A5A, 0x67DD4ACC,
-    0xF9B9DF6F, 0x8EBEEFF9, 0x17B7BE43, 0x60B08ED5,
-    0xD6D6A3E8, 0xA1D1937E, 0x38D8C2C4, 0x4FDFF252,
-    0xD1BB67F1, 0xA6BC5767, 0x3FB506DD, 0x48B2364B,
-    0xD80D2BDA, 0xAF0A1B4C, 0x36034AF6, 0x41047A60,
-    0xDF60EFC3, 0xA867DF55, 0x316E8EEF, 0x4669BE79,
-    0xCB61B38C, 0xBC66831A, 0x256FD2A0, 0x5268E236,
-    0xCC0C7795, 0xBB0B4703, 0x220216B9, 0x5505262F,
-    0xC5BA3BBE, 0xB2BD0B28, 0x2BB45A92, 0x5CB36A04,
-    0xC2D7FFA7, 0xB5D0CF31, 0x2CD99E8B, 0x5BDEAE1D,
-
-    0x9B64C2B0, 0xEC63F226, 0x756AA39C, 0x026D930A,
-    0x9C0906A9, 0xEB0E363F, 0x72076785, 0x05005713,
-    0x95BF4A82, 0xE2B87A14, 0x7BB12BAE, 0x0CB61B38,
-    0x92D28E9B, 0xE5D5BE0D, 0x7CDCEFB7, 0x0BDBDF21,
-    0x86D3D2D4, 0xF1D4E242, 0x68DDB3F8, 0x1FDA836E,
-    0x81BE16CD, 0xF6B9265B, 0x6FB077E1, 0x18B74777,
-    0x88085AE6, 0xFF0F6A70, 0x66063BCA, 0x11010B5C,
-    0x8F659EFF, 0xF862AE69, 0x616BFFD3, 0x166CCF45,
-    0xA00AE278, 0xD70DD2EE, 0x4E048354, 0x3903B3C2,
-    0xA7672661, 0xD06016F7, 0x4969474D, 0x3E6E77DB,
-    0xAED16A4A, 0xD9D65ADC, 0x40DF0B66, 0x37D83BF0,
-    0xA9BCAE53, 0xDEBB9EC5, 0x47B2CF7F, 0x30B5FFE9,
-    0xBDBDF21C, 0xCABAC28A, 0x53B39330, 0x24B4A3A6,
-    0xBAD03605, 0xCDD70693, 0x54DE5729, 0x23D967BF,
-    0xB3667A2E, 0xC4614AB8, 0x5D681B02, 0x2A6F2B94,
-    0xB40BBE37, 0xC30C8EA1, 0x5A05DF1B, 0x2D02EF8D
-  };
-
   class CRC: public HashImpl {
   private:
-    uint32 crc32;
+    CRC32_CTX ctx;
 
   public:
     CRC() {
-      this->crc32 = 0xFFFFFFFF;
+      CRC32_Init(&this->ctx);
     }
 
     void update(const void *data, size_t len) {
-    #ifdef CRC_ASM
-      if(len == 0)
-        return;
-      // There is a bug in the Microsoft compilers where inline assembly
-      // code cannot access static member variables.  This is a work around
-      // for that bug.  For more info see Knowledgebase article Q88092
-      void* crc32Table = (void*) s_crc32Table;
-      uint32* c = &(this->crc32); //pointer to crc32
-
-      // Register use:
-      //    eax - CRC32 value
-      //    ebx - a lot of things
-      //    ecx - CRC32 value
-      //    edx - address of end of buffer
-      //    esi - address of start of buffer
-      //    edi - CRC32 table
-      //
-      // assembly part by Brian Friesen. Visit CodeGuru.com
-      __asm {
-        // Save the esi and edi registers
-        push esi
-        push edi
-
-        mov eax, c            // Load the pointer to c
-        mov ecx, [eax]        // Dereference the pointer to load Crc32
-
-        mov edi, crc32Table    // Load the CRC32 table
-
-        mov esi, data          // Load buffer
-        mov ebx, len          // Load dwBytesRead
-        lea edx, [esi + ebx]  // Calculate the end of the buffer
-
-
-        crc32loop:
-        xor eax, eax          // Clear the eax register
-        mov bl, byte ptr [esi]// Load the current source byte
-
-        mov al, cl            // Copy crc value into eax
-        inc esi                // Advance the source pointer
-
-        xor al, bl            // Create the index into the CRC32 table
-        shr ecx, 8
-
-        mov ebx, [edi + eax * 4]  // Get the value out of the table
-        xor ecx, ebx          // xor with the current byte
-
-        cmp edx, esi          // Have we reached the end of the buffer?
-        jne crc32loop
-
-        // Restore the edi and esi registers
-        pop edi
-        pop esi
-
-        mov eax, c            // Load the pointer to c
-        mov [eax], ecx        // Write the result
-      }
-    #else
-      unsigned char* buf = (unsigned char*) data;
-      while(len--)
-        crc32 = (crc32 >> 8) ^ s_crc32Table[(crc32 ^ *buf++) & 0xff];
-    #endif
+      CRC32_Update(&this->ctx, data, len);
     }
 
     Digest finalize() {
-      this->crc32 = ~(this->crc32);
-      byte md[4];
-      md[0] = ((byte*) &this->crc32)[3];
-      md[1] = ((byte*) &this->crc32)[2];
-      md[2] = ((byte*) &this->crc32)[1];
-      md[3] = ((byte*) &this->crc32)[0];
-      return Digest(md, 4);
+      byte md[CRC32_DIGEST_LENGTH];
+      CRC32_Final(md, &this->ctx);
+      return Digest(md, CRC32_DIGEST_LENGTH);
     }
 
     std::string getName() {
@@ -263,7 +175,7 @@ namespace detail {
       MD4_Update(&this->ctx, data, len);
     }
 
-    Digest MD4::finalize() {
+    Digest finalize() {
       byte md[SHA_DIGEST_LENGTH];
       MD4_Final(md, &this->ctx);
       return Digest(md, MD4_DIGEST_LENGTH);
@@ -282,9 +194,10 @@ namespace detail {
     MD4 mainMD4, finMD4;
     uint64 pos;
     uint32 blockPos;
-    static const uint32 ed2kBorder = 9728000;
   
   public:
+    static const uint32 ed2kBorder = 9728000;
+
     ED2K() {
       this->pos = 0;
       this->blockPos = 0;
@@ -306,7 +219,7 @@ namespace detail {
       }
     }
 
-    Digest ED2K::finalize() {
+    Digest finalize() {
       // Elric [1/14/2007]:
       // I've just found out that there are 2 different ways of dealing with files,
       // which size is the multiple of 9728000.
@@ -467,11 +380,266 @@ namespace detail {
     }
   };
 
+// ------------------------------------------------------------------------- //
+// ShardBudget
+// ------------------------------------------------------------------------- //
+  /**
+   * ShardBudget limits the bytes of large files handed to the threads they
+   * are split between and not yet hashed. All the files hashed at once share
+   * it, so that memory grows with the number of threads only. Buffers given
+   * back are kept for reuse as long as they fit in the budget, data is then
+   * not freed by other threads than the ones that allocated it, which malloc
+   * would hold on to.
+   */
+  class ShardBudget: private noncopyable {
+  private:
+    mutex budgetMutex;
+    condition_variable released;
+    uint64 size;
+    uint64 used;
+    uint64 freeSize;
+    std::map<uint32, ArrayList<shared_array<unsigned char> > > freeBuffers;
+
+  public:
+    ShardBudget(uint64 size): size(size), used(0), freeSize(0) {}
+
+    /**
+     * Blocks until the given number of bytes is available, a request larger 
+     * than the whole budget takes all of it.
+     */
+    void acquire(uint32 capacity) {
+      uint64 len = min((uint64) capacity, this->size);
+      mutex::scoped_lock lock(this->budgetMutex);
+      while(this->used + len > this->size)
+        this->released.wait(lock);
+      this->used += len;
+    }
+
+    /**
+     * Gives back the bytes taken by acquire along with the data that held them.
+     */
+    void release(shared_array<unsigned char> data, uint32 capacity) {
+      uint64 len = min((uint64) capacity, this->size);
+      mutex::scoped_lock lock(this->budgetMutex);
+      this->used -= len;
+      if(this->used + this->freeSize + capacity <= this->size) {
+        this->freeBuffers[capacity].add(data);
+        this->freeSize += capacity;
+      }
+      this->released.notify_all();
+    }
+
+    /**
+     * @returns a buffer to be filled, it does not count against the budget 
+     *   until acquire is called for it.
+     */
+    shared_array<unsigned char> allocate(uint32 capacity) {
+      {
+        mutex::scoped_lock lock(this->budgetMutex);
+        ArrayList<shared_array<unsigned char> >& buffers = this->freeBuffers[capacity];
+        if(!buffers.empty()) {
+          shared_array<unsigned char> data = buffers[buffers.size() - 1];
+          buffers.resize(buffers.size() - 1);
+          this->freeSize -= capacity;
+          return data;
+        }
+      }
+      return shared_array<unsigned char>(new unsigned char[capacity]);
+    }
+  };
+
+  /**
+   * Data of a single job, it's given back to the budget once the job is done.
+   */
+  class ShardData: private noncopyable {
+  private:
+    boost::shared_ptr<ShardBudget> budget;
+    uint32 capacity;
+
+  public:
+    shared_array<unsigned char> data;
+
+    ShardData(boost::shared_ptr<ShardBudget> budget, shared_array<unsigned char> data, uint32 capacity): 
+      budget(budget), capacity(capacity), data(data) {}
+
+    ~ShardData() {
+      this->budget->release(this->data, this->capacity);
+    }
+  };
+
+// ------------------------------------------------------------------------- //
+// ParallelTTH
+// ------------------------------------------------------------------------- //
+  /**
+   * ParallelTTH splits the data into shards of PARALLELHASHSHARDSIZE bytes and
+   * hashes each shard as a separate job. Shards are cut on subtree boundaries,
+   * so every shard yields a few complete subtrees, which are then added to the 
+   * tree in file order. Shards being hashed count against the shared budget.
+   */
+  class ParallelTTH: public HashImpl {
+  private:
+    typedef std::pair<shared_array<uint64>, uint32> ShardRoots;
+
+    CTigerTree ctx;
+    JobGroup group;
+    boost::shared_ptr<ShardBudget> budget;
+    DWORD subtreeLeafCount;
+    uint32 subtreeSize;
+    shared_array<unsigned char> shard;
+    uint32 shardPos;
+    ArrayList<ShardRoots> shardRoots;
+
+    static void hashShard(CTigerTree* ctx, boost::shared_ptr<ShardData> shard, uint32 shardSize, uint32 subtreeSize, shared_array<uint64> roots) {
+      for(uint32 pos = 0, i = 0; pos < shardSize; pos += subtreeSize, i++)
+        ctx->HashLeaves(shard->data.get() + pos, min(subtreeSize, shardSize - pos), roots.get() + 3 * i);
+    }
+
+    void flushShard() {
+      if(this->shardPos == 0)
+        return;
+      this->budget->acquire(PARALLELHASHSHARDSIZE);
+      boost::shared_ptr<ShardData> shard(new ShardData(this->budget, this->shard, PARALLELHASHSHARDSIZE));
+      uint32 subtreeCount = (this->shardPos + this->subtreeSize - 1) / this->subtreeSize;
+      shared_array<uint64> roots(new uint64[3 * subtreeCount]);
+      this->shardRoots.add(ShardRoots(roots, subtreeCount));
+      this->group.run(boost::bind(&ParallelTTH::hashShard, &this->ctx, shard, this->shardPos, this->subtreeSize, roots));
+      this->shard = this->budget->allocate(PARALLELHASHSHARDSIZE);
+      this->shardPos = 0;
+    }
+
+  public:
+    ParallelTTH(unsigned long long fileSize, Scheduler scheduler, boost::shared_ptr<ShardBudget> budget): group(scheduler), budget(budget) {
+      this->ctx.BeginFile(9, fileSize);
+      this->subtreeLeafCount = min(this->ctx.GetBlockLength(), (DWORD) PARALLELHASHSHARDSIZE) / 1024;
+      this->subtreeSize = this->subtreeLeafCount * 1024;
+      this->shard = this->budget->allocate(PARALLELHASHSHARDSIZE);
+      this->shardPos = 0;
+    }
+
+    void update(const void* data, size_t len) {
+      const byte* pData = (const byte*) data;
+      while(len > 0) {
+        size_t dlen = min(len, (size_t) (PARALLELHASHSHARDSIZE - this->shardPos));
+        memcpy(this->shard.get() + this->shardPos, pData, dlen);
+        this->shardPos += (uint32) dlen;
+        pData += dlen;
+        len -= dlen;
+        if(this->shardPos == PARALLELHASHSHARDSIZE)
+          flushShard();
+      }
+    }
+
+    Digest finalize() {
+      flushShard();
+      this->group.wait();
+      FOREACH(ShardRoots& roots, this->shardRoots)
+        for(uint32 i = 0; i < roots.second; i++)
+          this->ctx.AddNodeToFile(roots.first.get() + 3 * i, this->subtreeLeafCount);
+
+      byte md[24];
+      this->ctx.FinishFile();
+      this->ctx.GetRoot(md);
+      return Digest(md, 24);
+    }
+
+    std::string getName() {
+      return "TTH";
+    }
+  };
+
+// ------------------------------------------------------------------------- //
+// ParallelED2K
+// ------------------------------------------------------------------------- //
+  /**
+   * ParallelED2K computes md4 of every ed2k block as a separate job. Block 
+   * digests are then hashed in file order, the same way ED2K does it. Blocks
+   * being hashed count against the shared budget.
+   */
+  class ParallelED2K: public HashImpl {
+  private:
+    JobGroup group;
+    boost::shared_ptr<ShardBudget> budget;
+    uint64 pos;
+    shared_array<unsigned char> block;
+    uint32 blockPos;
+    ArrayList<shared_array<unsigned char> > blockDigests;
+
+    static void hashBlock(boost::shared_ptr<ShardData> block, uint32 blockSize, shared_array<unsigned char> md) {
+      ::MD4(block->data.get(), blockSize, md.get());
+    }
+
+    void flushBlock() {
+      this->budget->acquire(ED2K::ed2kBorder);
+      boost::shared_ptr<ShardData> block(new ShardData(this->budget, this->block, ED2K::ed2kBorder));
+      shared_array<unsigned char> md(new unsigned char[MD4_DIGEST_LENGTH]);
+      this->blockDigests.add(md);
+      this->group.run(boost::bind(&ParallelED2K::hashBlock, block, this->blockPos, md));
+      this->block = this->budget->allocate(ED2K::ed2kBorder);
+      this->blockPos = 0;
+    }
+
+  public:
+    ParallelED2K(Scheduler scheduler, boost::shared_ptr<ShardBudget> budget): group(scheduler), budget(budget) {
+      this->pos = 0;
+      this->block = this->budget->allocate(ED2K::ed2kBorder);
+      this->blockPos = 0;
+    }
+
+    void update(const void* data, size_t len) {
+      const byte* pData = (const byte*) data;
+      this->pos += len;
+      while(len > 0) {
+        size_t dlen = min(len, (size_t) (ED2K::ed2kBorder - this->blockPos));
+        memcpy(this->block.get() + this->blockPos, pData, dlen);
+        this->blockPos += (uint32) dlen;
+        pData += dlen;
+        len -= dlen;
+        if(this->blockPos == ED2K::ed2kBorder)
+          flushBlock();
+      }
+    }
+
+    Digest finalize() {
+      // See ED2K::finalize for the handling of files which size is the multiple 
+      // of 9728000 - the last (possibly empty) block is always hashed.
+      if(this->pos < ED2K::ed2kBorder) {
+        byte md[MD4_DIGEST_LENGTH];
+        ::MD4(this->block.get(), this->blockPos, md);
+        return Digest(md, MD4_DIGEST_LENGTH);
+      }
+
+      flushBlock();
+      this->group.wait();
+      MD4 finMD4;
+      FOREACH(shared_array<unsigned char>& md, this->blockDigests)
+        finMD4.update(md.get(), MD4_DIGEST_LENGTH);
+      return finMD4.finalize();
+    }
+
+    std::string getName() {
+      return "ED2K";
+    }
+  };
+
 }; // namespace hashes
 
 // ------------------------------------------------------------------------- //
 // Hash class
 // ------------------------------------------------------------------------- //
+static boost::optional<Scheduler> hashScheduler;
+static boost::shared_ptr< ::detail::ShardBudget> hashBudget;
+
+void Hash::setScheduler(boost::optional<Scheduler> scheduler) {
+  hashScheduler = scheduler;
+  hashBudget.reset();
+  if(scheduler)
+    hashBudget.reset(new ::detail::ShardBudget(Hash::getShardBudget(*scheduler)));
+}
+
+uint64 Hash::getShardBudget(Scheduler scheduler) {
+  return (uint64) PARALLELHASHQUEUESIZE * scheduler.getWorkerCount();
+}
+
 Hash::Hash(uint32 hashId, uint64 totalLen): hashId(hashId) {
   switch(hashId) {
   case H_CRC:
@@ -481,7 +649,10 @@ Hash::Hash(uint32 hashId, uint64 totalLen): hashId(hashId) {
     impl.reset(new ::detail::MD4());
     break;
   case H_ED2K:
-    impl.reset(new ::detail::ED2K());
+    if(hashScheduler && totalLen >= PARALLELHASHMINSIZE)
+      impl.reset(new ::detail::ParallelED2K(*hashScheduler, hashBudget));
+    else
+      impl.reset(new ::detail::ED2K());
     break;
   case H_MD5:
     impl.reset(new ::detail::MD5());
@@ -496,7 +667,10 @@ Hash::Hash(uint32 hashId, uint64 totalLen): hashId(hashId) {
     impl.reset(new ::detail::SHA512());
     break;
   case H_TTH:
-    impl.reset(new ::detail::TTH(totalLen));
+    if(hashScheduler && totalLen >= PARALLELHASHMINSIZE)
+      impl.reset(new ::detail::ParallelTTH(totalLen, *hashScheduler, hashBudget));
+    else
+      impl.reset(new ::detail::TTH(totalLen));
     break;
   default:
     throw new std::runtime_error("Unknowh Hash Id: " + lexical_cast<string>(hashId));
@@ -548,69 +722,49 @@ uint32 Hash::getId(std::string name) {
     return H_UNKNOWN;
 }
 
-
-
-// -------------------------------------------------------------------------- //
-// Digest class
-// -------------------------------------------------------------------------- //
-class Digest::DigestImpl {
-public:
-  unsigned int len;
-  unsigned char* data;
-
-  DigestImpl(const unsigned char* data, unsigned int len) {
-    this->len = len;
-    this->data = new unsigned char[this->len];
-    memcpy(this->data, data, this->len);
-  }
-
-  DigestImpl() {
-    return;
-  }
-
-  ~DigestImpl() {
-    delete[] this->data;
-  }
-
-  static DigestImpl* fromHexString(const std::string& hex) {
-    DigestImpl* result = new DigestImpl();
-    result->len = (unsigned int) hex.size() / 2;
-    result->data = new unsigned char[result->len];
-    hexUnDump(hex, result->data);
-    return result;
-  }
+static const unsigned int digestSizes[H_COUNT] = {
+  CRC32_DIGEST_LENGTH,  /* H_CRC */
+  MD4_DIGEST_LENGTH,    /* H_MD4 */
+  MD4_DIGEST_LENGTH,    /* H_ED2K */
+  MD5_DIGEST_LENGTH,    /* H_MD5 */
+  SHA_DIGEST_LENGTH,    /* H_SHA1 */
+  SHA256_DIGEST_LENGTH, /* H_SHA256 */
+  SHA512_DIGEST_LENGTH, /* H_SHA512 */
+  24                    /* H_TTH */
 };
 
-Digest::Digest(const unsigned char* data, unsigned int len): impl(new DigestImpl(data, len)) {
-  return;
-}
-
-Digest::Digest() {
-  return;
+unsigned int Hash::getDigestSize(uint32 hashId) {
+  return digestSizes[hashId];
 }
 
-bool Digest::operator== (const Digest& that) const {
-  return (this->impl->len == that.impl->len && memcmp(this->impl->data, that.impl->data, this->impl->len) == 0);
+unsigned int Hash::getDigestOffset(uint32 hashId) {
+  unsigned int offset = 0;
+  for(uint32 i = 0; i < hashId; i++)
+    offset += digestSizes[i];
+  return offset;
 }
 
-bool Digest::operator!= (const Digest& that) const {
-  return !this->operator== (that);
-}
 
-unsigned int Digest::size() const {
-  return this->impl->len;
-}
 
-const unsigned char* Digest::get() const {
-  return this->impl->data;
+// -------------------------------------------------------------------------- //
+// Digest class
+// -------------------------------------------------------------------------- //
+Digest::Digest(const unsigned char* data, unsigned int len) {
+  if(len > DIGEST_MAX_SIZE)
+    throw runtime_error("Digest is too long");
+  this->len = (unsigned char) len;
+  memcpy(this->data, data, len);
 }
 
 const std::string Digest::toHexString() const {
-  return hexDump(this->impl->data, this->impl->len);
+  return hexDump(this->data, this->len);
 }
 
 Digest Digest::fromHexString(const std::string& hex) {
+  if(hex.size() > 2 * DIGEST_MAX_SIZE)
+    throw runtime_error("Digest is too long");
   Digest result;
-  result.impl.reset(DigestImpl::fromHexString(hex));
+  result.len = (unsigned char) (hex.size() / 2);
+  hexUnDump(hex, result.data);
   return result;
 }
\ No newline at end of file
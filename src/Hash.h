@@ -3,7 +3,11 @@
 
 #include "config.h"
 #include <string>
+#include <cstring>
 #include <boost/shared_ptr.hpp>
+#include <boost/optional.hpp>
+#include "Scheduler.h"
+#include "ArrayList.h"
 
 enum {
   H_CRC,
@@ -18,17 +22,39 @@ enum {
   H_UNKNOWN = 0xFFFFFFFF
 };
 
+enum {
+  DIGEST_MAX_SIZE = 64,
+  DIGEST_TOTAL_SIZE = 4 + 16 + 16 + 16 + 20 + 32 + 64 + 24 /**< Sum of the digest sizes of all the hashes. */
+};
+
+/**
+ * Digest is a value type, the data is stored inline, so digests can be copied
+ * and kept in arrays without any allocations. Default-constructed digest is 
+ * empty.
+ */
 class Digest {
 private:
-  class DigestImpl;
-  boost::shared_ptr<DigestImpl> impl;
+  unsigned char data[DIGEST_MAX_SIZE];
+  unsigned char len;
 public:
-  Digest();
+  Digest(): len(0) {}
   Digest(const unsigned char* data, unsigned int len);
-  std::size_t size() const;
-  const unsigned char* get() const;
-  bool operator== (const Digest& that) const;
-  bool operator!= (const Digest& that) const;
+
+  std::size_t size() const {
+    return this->len;
+  }
+
+  const unsigned char* get() const {
+    return this->data;
+  }
+
+  bool operator== (const Digest& that) const {
+    return this->len == that.len && memcmp(this->data, that.data, this->len) == 0;
+  }
+
+  bool operator!= (const Digest& that) const {
+    return !this->operator== (that);
+  }
 
   const std::string toHexString() const; 
   static Digest fromHexString(const std::string& hex);
@@ -50,8 +76,53 @@ public:
   uint32 getId();
   static std::string getName(uint32 hashId);
   static uint32 getId(std::string name);
+
+  /**
+   * @returns size of the digests of the given hash.
+   */
+  static unsigned int getDigestSize(uint32 hashId);
+
+  /**
+   * @returns offset of the digest of the given hash when the digests of all 
+   * the hashes are laid out one after another in hash id order, 
+   * DIGEST_TOTAL_SIZE bytes in total.
+   */
+  static unsigned int getDigestOffset(uint32 hashId);
+
+  /**
+   * Sets the scheduler used to split hashing of large files between several 
+   * threads. Hashes created afterwards will use it, pass an empty value to 
+   * hash everything in the calling thread.
+   *
+   * A hash waiting for its shards runs other jobs of this scheduler on the 
+   * waiting thread, so it must be a scheduler of its own, not the one files
+   * are hashed on.
+   *
+   * Data handed to the scheduler and not yet hashed is limited by a budget
+   * shared by all the hashes, see getShardBudget.
+   */
+  static void setScheduler(boost::optional<Scheduler> scheduler);
+
+  /**
+   * @returns number of bytes of large files that may wait for the threads of
+   * the given scheduler at once, whatever the number of files.
+   */
+  static uint64 getShardBudget(Scheduler scheduler);
 };
 
 Digest calculateHash(const void* data, size_t len, uint32 hashId);
 
+/**
+ * Calculates hashes of several buffers at once. For md5 and sha1 the buffers 
+ * are hashed in parallel in the lanes of the vector registers if the cpu 
+ * supports it, other hashes are calculated one buffer after another.
+ */
+ArrayList<Digest> calculateHashes(const ArrayList<const unsigned char*>& data, const ArrayList<size_t>& sizes, uint32 hashId);
+
+/**
+ * @returns true if calculateHashes is faster than hashing the buffers one 
+ *   by one for the given hash on this cpu.
+ */
+bool isMultiBufferHash(uint32 hashId);
+
 #endif
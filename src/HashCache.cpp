@@ -0,0 +1,579 @@
+#include "config.h"
+#include "HashCache.h"
+#include "Streams.h"
+#include "hash/crc/crc32.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include <sstream>
+#include <map>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/array.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#ifdef ARX_WIN
+#  include <windows.h>
+#endif
+#ifdef ARX_LINUX
+#  include <sys/stat.h>
+#  include <sys/xattr.h>
+#endif
+
+using namespace std;
+using namespace boost;
+using namespace boost::filesystem;
+using namespace boost::algorithm;
+using namespace arx;
+
+#define CACHEMAGIC "ARXSUMC1"
+#define CACHEVERSION 2
+
+namespace detail {
+// -------------------------------------------------------------------------- //
+// Cache file layout
+// -------------------------------------------------------------------------- //
+  /**
+   * Identity of a file and its state at the time it was looked up. Records of
+   * the cache file are keys followed by a digest.
+   */
+  struct FileKey {
+    uint64 device;
+    uint64 inode;
+    uint64 size;
+    uint64 mtime;
+  };
+
+  struct CacheHeader {
+    char magic[8];
+    uint32 version;
+    uint32 reserved;
+  };
+
+  /**
+   * Follows the records, which are written before their counts are known.
+   * Records of every hash are sorted by device and inode, and lie one after 
+   * another in hash id order.
+   */
+  struct CacheTrailer {
+    uint64 recordCounts[H_COUNT];
+    uint32 digestSizes[H_COUNT];
+    uint32 hashCount;
+    uint32 recordsCrc;
+  };
+
+  /** Digest stored in this run, not yet written to the cache file. */
+  struct CacheRecord {
+    FileKey key;
+    uint32 hashId;
+    unsigned char digest[DIGEST_MAX_SIZE];
+  };
+
+  static bool isKeyLess(const FileKey& l, const FileKey& r) {
+    if(l.device != r.device)
+      return l.device < r.device;
+    return l.inode < r.inode;
+  }
+
+  /** Orders records by hash id, device and inode, which is the order of the records in the file. */
+  struct CacheRecordLess {
+    bool operator() (const CacheRecord& l, const CacheRecord& r) const {
+      if(l.hashId != r.hashId)
+        return l.hashId < r.hashId;
+      return isKeyLess(l.key, r.key);
+    }
+  };
+
+  static uint32 crc32(const void* data, size_t len) {
+    CRC32_CTX ctx;
+    unsigned char md[CRC32_DIGEST_LENGTH];
+    CRC32_Init(&ctx);
+    CRC32_Update(&ctx, data, len);
+    CRC32_Final(md, &ctx);
+    return (md[0] << 24) | (md[1] << 16) | (md[2] << 8) | md[3];
+  }
+
+  /**
+   * Fills in the key of a file, the modification time is taken in the finest
+   * resolution the os provides.
+   * @returns false if the file cannot be accessed.
+   */
+  static bool getFileKey(const wpath& path, FileKey& key) {
+#ifdef ARX_LINUX
+    struct stat fileStat;
+    if(stat(path.string().c_str(), &fileStat) != 0 || !S_ISREG(fileStat.st_mode))
+      return false;
+    key.device = fileStat.st_dev;
+    key.inode = fileStat.st_ino;
+    key.size = fileStat.st_size;
+    key.mtime = (uint64) fileStat.st_mtim.tv_sec * 1000000000 + fileStat.st_mtim.tv_nsec;
+    return true;
+#endif
+#ifdef ARX_WIN
+    HANDLE handle = CreateFileW(path.wstring().c_str(), FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, 0, NULL);
+    if(handle == INVALID_HANDLE_VALUE)
+      return false;
+    BY_HANDLE_FILE_INFORMATION info;
+    BOOL status = GetFileInformationByHandle(handle, &info);
+    CloseHandle(handle);
+    if(status == 0 || (info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+      return false;
+    key.device = info.dwVolumeSerialNumber;
+    key.inode = ((uint64) info.nFileIndexHigh << 32) | info.nFileIndexLow;
+    key.size = ((uint64) info.nFileSizeHigh << 32) | info.nFileSizeLow;
+    key.mtime = (((uint64) info.ftLastWriteTime.dwHighDateTime << 32) | info.ftLastWriteTime.dwLowDateTime) * 100;
+    return true;
+#endif
+  }
+
+// -------------------------------------------------------------------------- //
+// KeyedHashCacheImpl
+// -------------------------------------------------------------------------- //
+  /**
+   * Base for the caches that trust a digest as long as the file has the same
+   * size and modification time as when the digest was stored.
+   */
+  class KeyedHashCacheImpl: public HashCacheImpl {
+  private:
+    bool rehash;
+    mutex pendingMutex;
+
+    /* Entries looked up but not yet stored, by the thread that looked them up. */
+    std::map<thread::id, ArrayList<std::pair<FileEntry, FileKey> > > pending;
+
+  protected:
+    /**
+     * Looks up the digest of the given file, it must be discarded if the key
+     * does not match the one it was stored with. Called from several threads
+     * at once.
+     */
+    virtual bool find(FileEntry entry, const FileKey& key, uint32 hashId, Digest& digest) = 0;
+
+    /**
+     * Stores the digest of the given file. Called from several threads at once,
+     * so that the slow stores are not serialized, implementations lock what 
+     * they share.
+     */
+    virtual void add(FileEntry entry, const FileKey& key, uint32 hashId, Digest digest) = 0;
+
+    /**
+     * Called for every file looked up, from several threads at once.
+     */
+    virtual void keep(const FileKey& key) {}
+
+  public:
+    KeyedHashCacheImpl(bool rehash): rehash(rehash) {}
+
+    ArrayList<FileEntry> lookup(ArrayList<FileEntry> entries, HashTask task) {
+      ArrayList<FileEntry> misses;
+      ArrayList<std::pair<FileEntry, FileKey> > pending;
+      FOREACH(FileEntry entry, entries) {
+        FileKey key = FileKey();
+        if(entry.isFailed() || entry.getPath() == _T("-") || !getFileKey(entry.getPath(), key)) {
+          misses.add(entry);
+          continue;
+        }
+        keep(key);
+
+        array<Digest, H_COUNT> digests;
+        bool hit = !this->rehash;
+        for(uint32 i = 0; hit && i < task.size(); i++)
+          if(task.isSet(i) && !find(entry, key, i, digests[i]))
+            hit = false;
+
+        if(hit) {
+          for(uint32 i = 0; i < task.size(); i++)
+            if(task.isSet(i))
+              entry.setDigest(i, digests[i]);
+          entry.setSize(key.size);
+        } else {
+          pending.add(std::make_pair(entry, key));
+          misses.add(entry);
+        }
+      }
+      mutex::scoped_lock lock(this->pendingMutex);
+      this->pending[this_thread::get_id()] = pending;
+      return misses;
+    }
+
+    void store(HashTask task) {
+      ArrayList<std::pair<FileEntry, FileKey> > pending;
+      {
+        mutex::scoped_lock lock(this->pendingMutex);
+        pending = this->pending[this_thread::get_id()];
+        this->pending.erase(this_thread::get_id());
+      }
+      for(uint32 j = 0; j < pending.size(); j++) {
+        FileEntry entry = pending[j].first;
+        const FileKey& key = pending[j].second;
+        if(entry.isFailed() || entry.getSize() != key.size)
+          continue;
+        for(uint32 i = 0; i < task.size(); i++)
+          if(task.isSet(i))
+            add(entry, key, i, entry.getDigest(i));
+      }
+    }
+  };
+
+// -------------------------------------------------------------------------- //
+// CacheWriter
+// -------------------------------------------------------------------------- //
+  /**
+   * Writes the cache file through a buffer, keeping a crc32 of the records.
+   */
+  class CacheWriter {
+  private:
+    OutputStream stream;
+    std::vector<unsigned char> buf;
+    size_t used;
+    CRC32_CTX ctx;
+
+  public:
+    CacheWriter(wpath fileName): stream(createOutputStream(fileName)), buf(FILEBUFSIZE), used(0) {
+      CRC32_Init(&this->ctx);
+    }
+
+    void write(const void* data, size_t len) {
+      const unsigned char* bytes = (const unsigned char*) data;
+      while(len > 0) {
+        size_t count = min(len, this->buf.size() - this->used);
+        memcpy(&this->buf[this->used], bytes, count);
+        this->used += count;
+        bytes += count;
+        len -= count;
+        if(this->used == this->buf.size())
+          flush();
+      }
+    }
+
+    void writeRecord(const void* data, size_t len) {
+      CRC32_Update(&this->ctx, data, len);
+      write(data, len);
+    }
+
+    uint32 getRecordsCrc() {
+      CRC32_CTX ctx = this->ctx;
+      unsigned char md[CRC32_DIGEST_LENGTH];
+      CRC32_Final(md, &ctx);
+      return (md[0] << 24) | (md[1] << 16) | (md[2] << 8) | md[3];
+    }
+
+    void flush() {
+      if(this->used != 0)
+        this->stream.write(&this->buf[0], (unsigned int) this->used);
+      this->used = 0;
+    }
+
+    void close() {
+      flush();
+      this->stream.close();
+    }
+  };
+
+// -------------------------------------------------------------------------- //
+// FileHashCacheImpl
+// -------------------------------------------------------------------------- //
+  class FileHashCacheImpl: public KeyedHashCacheImpl {
+  private:
+    wpath cacheFile;
+    bool prune;
+
+    scoped_ptr<interprocess::mapped_region> region;
+    const unsigned char* sections[H_COUNT];
+    uint64 recordCounts[H_COUNT];
+
+    /* Index of the first record of every hash among all the records. */
+    uint64 firstRecords[H_COUNT];
+
+    mutex updateMutex;
+    ArrayList<CacheRecord> added;
+
+    /* With prune, whether each record is of a file looked up in this run. */
+    std::vector<char> kept;
+
+    static uint32 getRecordSize(uint32 hashId) {
+      return (uint32) sizeof(FileKey) + Hash::getDigestSize(hashId);
+    }
+
+    const unsigned char* getRecord(uint32 hashId, uint64 index) const {
+      return this->sections[hashId] + (size_t) index * getRecordSize(hashId);
+    }
+
+    /* Records are not aligned, keys are copied out of them. */
+    FileKey getKey(uint32 hashId, uint64 index) const {
+      FileKey key;
+      memcpy(&key, getRecord(hashId, index), sizeof(key));
+      return key;
+    }
+
+    /**
+     * @returns index of the record of the given file, or the count of records
+     *   of the hash if there is none.
+     */
+    uint64 findRecord(uint32 hashId, const FileKey& key) const {
+      uint64 first = 0, count = this->recordCounts[hashId];
+      while(count > 0) {
+        uint64 step = count / 2;
+        if(isKeyLess(getKey(hashId, first + step), key)) {
+          first += step + 1;
+          count -= step + 1;
+        } else
+          count = step;
+      }
+      if(first != this->recordCounts[hashId] && isKeyLess(key, getKey(hashId, first)))
+        return this->recordCounts[hashId];
+      return first;
+    }
+
+    void unload() {
+      this->region.reset();
+      for(uint32 i = 0; i < H_COUNT; i++) {
+        this->sections[i] = NULL;
+        this->recordCounts[i] = 0;
+        this->firstRecords[i] = 0;
+      }
+      this->kept = std::vector<char>();
+    }
+
+    /**
+     * Maps the cache file into memory. Files that do not pass the checks are
+     * ignored, they are overwritten on save.
+     */
+    void load() {
+      unload();
+      if(!exists(this->cacheFile))
+        return;
+
+      try {
+        interprocess::file_mapping mapping(this->cacheFile.string().c_str(), interprocess::read_only);
+        this->region.reset(new interprocess::mapped_region(mapping, interprocess::read_only));
+      } catch(...) {
+        this->region.reset();
+        wCout << "[warning] cannot read hash cache: " << this->cacheFile.wstring() << endl;
+        return;
+      }
+
+      const unsigned char* data = (const unsigned char*) this->region->get_address();
+      size_t size = this->region->get_size();
+      CacheHeader header;
+      CacheTrailer trailer;
+      bool valid = size >= sizeof(CacheHeader) + sizeof(CacheTrailer);
+      if(valid) {
+        memcpy(&header, data, sizeof(header));
+        memcpy(&trailer, data + size - sizeof(trailer), sizeof(trailer));
+        valid = memcmp(header.magic, CACHEMAGIC, sizeof(header.magic)) == 0 && header.version == CACHEVERSION && trailer.hashCount == H_COUNT;
+      }
+      uint64 recordsSize = 0, recordCount = 0;
+      for(uint32 i = 0; valid && i < H_COUNT; i++) {
+        uint64 available = size - sizeof(CacheHeader) - sizeof(CacheTrailer) - recordsSize;
+        valid = trailer.digestSizes[i] == Hash::getDigestSize(i) && trailer.recordCounts[i] <= available / getRecordSize(i);
+        this->sections[i] = data + sizeof(CacheHeader) + recordsSize;
+        this->recordCounts[i] = trailer.recordCounts[i];
+        this->firstRecords[i] = recordCount;
+        recordsSize += trailer.recordCounts[i] * getRecordSize(i);
+        recordCount += trailer.recordCounts[i];
+      }
+      if(!valid || sizeof(CacheHeader) + recordsSize + sizeof(CacheTrailer) != size || 
+        trailer.recordsCrc != crc32(data + sizeof(CacheHeader), (size_t) recordsSize)) {
+        unload();
+        wCout << "[warning] hash cache is damaged, ignoring: " << this->cacheFile.wstring() << endl;
+        return;
+      }
+
+      if(this->prune)
+        this->kept.resize((size_t) recordCount);
+    }
+
+  protected:
+    bool find(FileEntry entry, const FileKey& key, uint32 hashId, Digest& digest) {
+      uint64 index = findRecord(hashId, key);
+      if(index == this->recordCounts[hashId])
+        return false;
+      FileKey stored = getKey(hashId, index);
+      if(stored.size != key.size || stored.mtime != key.mtime)
+        return false;
+      digest = Digest(getRecord(hashId, index) + sizeof(FileKey), Hash::getDigestSize(hashId));
+      return true;
+    }
+
+    void add(FileEntry entry, const FileKey& key, uint32 hashId, Digest digest) {
+      CacheRecord record;
+      memset(&record, 0, sizeof(record));
+      record.key = key;
+      record.hashId = hashId;
+      memcpy(record.digest, digest.get(), min((size_t) digest.size(), sizeof(record.digest)));
+      mutex::scoped_lock lock(this->updateMutex);
+      this->added.add(record);
+    }
+
+    void keep(const FileKey& key) {
+      if(!this->prune)
+        return;
+      uint64 indices[H_COUNT];
+      uint32 count = 0;
+      for(uint32 i = 0; i < H_COUNT; i++) {
+        uint64 index = findRecord(i, key);
+        if(index != this->recordCounts[i])
+          indices[count++] = this->firstRecords[i] + index;
+      }
+      mutex::scoped_lock lock(this->updateMutex);
+      for(uint32 i = 0; i < count; i++)
+        this->kept[(size_t) indices[i]] = 1;
+    }
+
+  public:
+    FileHashCacheImpl(wpath cacheFile, bool rehash, bool prune): KeyedHashCacheImpl(rehash), cacheFile(cacheFile), prune(prune) {
+      load();
+    }
+
+    /**
+     * Merges the new records into the mapped ones as they are written to a 
+     * temporary file, which then replaces the cache file. Nothing but the new
+     * records is held in memory.
+     */
+    void save() {
+      if(this->added.empty() && !this->prune)
+        return;
+
+      /* Of the records stored for the same file, the last one wins. */
+      stable_sort(this->added.begin(), this->added.end(), CacheRecordLess());
+
+      wpath tmpFile = this->cacheFile.wstring() + _T(".tmp");
+      CacheWriter writer(tmpFile);
+      CacheHeader header;
+      memset(&header, 0, sizeof(header));
+      memcpy(header.magic, CACHEMAGIC, sizeof(header.magic));
+      header.version = CACHEVERSION;
+      writer.write(&header, sizeof(header));
+
+      CacheTrailer trailer;
+      memset(&trailer, 0, sizeof(trailer));
+      trailer.hashCount = H_COUNT;
+      size_t next = 0;
+      for(uint32 hashId = 0; hashId < H_COUNT; hashId++) {
+        uint32 digestSize = Hash::getDigestSize(hashId);
+        trailer.digestSizes[hashId] = digestSize;
+        size_t end = next;
+        while(end < this->added.size() && this->added[end].hashId == hashId)
+          end++;
+
+        uint64 index = 0, count = this->recordCounts[hashId];
+        while(index < count || next < end) {
+          if(next == end || (index < count && isKeyLess(getKey(hashId, index), this->added[next].key))) {
+            if(!this->prune || this->kept[(size_t) (this->firstRecords[hashId] + index)]) {
+              writer.writeRecord(getRecord(hashId, index), getRecordSize(hashId));
+              trailer.recordCounts[hashId]++;
+            }
+            index++;
+            continue;
+          }
+
+          while(next + 1 < end && !isKeyLess(this->added[next].key, this->added[next + 1].key))
+            next++;
+          if(index < count && !isKeyLess(this->added[next].key, getKey(hashId, index)))
+            index++; /* Replaced by the new record. */
+          writer.writeRecord(&this->added[next].key, sizeof(FileKey));
+          writer.writeRecord(this->added[next].digest, digestSize);
+          trailer.recordCounts[hashId]++;
+          next++;
+        }
+      }
+      trailer.recordsCrc = writer.getRecordsCrc();
+      writer.write(&trailer, sizeof(trailer));
+      writer.close();
+
+      /* Mapped file cannot be replaced on windows. */
+      unload();
+      rename(tmpFile, this->cacheFile);
+
+      this->added = ArrayList<CacheRecord>();
+      load();
+    }
+  };
+
+// -------------------------------------------------------------------------- //
+// XattrHashCacheImpl
+// -------------------------------------------------------------------------- //
+  /**
+   * Keeps digests in the user.arxsum.<hash> extended attributes of the files 
+   * themselves. The value is "<size> <mtime in ns> <hex digest>", so that it 
+   * can be inspected with getfattr.
+   */
+  class XattrHashCacheImpl: public KeyedHashCacheImpl {
+  private:
+    static string getAttributeName(uint32 hashId) {
+      return "user.arxsum." + to_lower_copy(Hash::getName(hashId));
+    }
+
+  protected:
+    bool find(FileEntry entry, const FileKey& key, uint32 hashId, Digest& digest) {
+#ifdef ARX_LINUX
+      char value[256];
+      ssize_t length = getxattr(entry.getPath().string().c_str(), getAttributeName(hashId).c_str(), value, sizeof(value) - 1);
+      if(length <= 0)
+        return false;
+      value[length] = 0;
+
+      istringstream stream(value);
+      uint64 size, mtime;
+      string hex;
+      if(!(stream >> size >> mtime >> hex) || size != key.size || mtime != key.mtime)
+        return false;
+      try {
+        digest = Digest::fromHexString(hex);
+      } catch(...) {
+        return false;
+      }
+      return digest.size() == Hash::getDigestSize(hashId);
+#else
+      return false;
+#endif
+    }
+
+    void add(FileEntry entry, const FileKey& key, uint32 hashId, Digest digest) {
+#ifdef ARX_LINUX
+      ostringstream stream;
+      stream << key.size << " " << key.mtime << " " << digest.toHexString();
+      string value = stream.str();
+      /* Read-only files and file systems without xattrs just don't get cached. */
+      setxattr(entry.getPath().string().c_str(), getAttributeName(hashId).c_str(), value.data(), value.size(), 0);
+#endif
+    }
+
+  public:
+    XattrHashCacheImpl(bool rehash): KeyedHashCacheImpl(rehash) {}
+  };
+}
+
+// -------------------------------------------------------------------------- //
+// HashCache
+// -------------------------------------------------------------------------- //
+HashCache::HashCache(::detail::HashCacheImpl* impl): impl(impl) {
+  return;
+}
+
+HashCache::HashCache(wpath cacheFile, bool rehash, bool prune): impl(new ::detail::FileHashCacheImpl(cacheFile, rehash, prune)) {
+  return;
+}
+
+ArrayList<FileEntry> HashCache::lookup(ArrayList<FileEntry> entries, HashTask task) {
+  return this->impl->lookup(entries, task);
+}
+
+void HashCache::store(HashTask task) {
+  this->impl->store(task);
+}
+
+void HashCache::save() {
+  this->impl->save();
+}
+
+// -------------------------------------------------------------------------- //
+// XattrHashCache
+// -------------------------------------------------------------------------- //
+XattrHashCache::XattrHashCache(bool rehash): HashCache(new ::detail::XattrHashCacheImpl(rehash)) {
+  return;
+}
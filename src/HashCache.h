@@ -0,0 +1,85 @@
+#ifndef __HASHCACHE_H__
+#define __HASHCACHE_H__
+
+#include "config.h"
+#include "ArrayList.h"
+#include "FileEntry.h"
+#include "Task.h"
+#include <boost/shared_ptr.hpp>
+#include <boost/filesystem.hpp>
+
+// -------------------------------------------------------------------------- //
+// HashCache
+// -------------------------------------------------------------------------- //
+namespace detail {
+  class HashCacheImpl {
+  public:
+    virtual ~HashCacheImpl() {}
+    virtual ArrayList<FileEntry> lookup(ArrayList<FileEntry> entries, HashTask task) = 0;
+    virtual void store(HashTask task) = 0;
+    virtual void save() {return;};
+  };
+}
+
+/**
+ * HashCache is an on-disk store of the digests computed in the previous runs.
+ * Digests are keyed by device, inode and hash, and are trusted as long as the
+ * size and the modification time of the file are the same as when they were
+ * computed.
+ *
+ * The cache file holds an array of records sorted by key for every hash, each
+ * record only as large as the digests of its hash, so that it can be mapped
+ * into memory and searched without parsing. It's protected by a crc32 of the
+ * records, a damaged file is ignored and rewritten.
+ *
+ * Lookups and stores can be made from several threads at once, store() then
+ * stores the entries returned by the last lookup made by the same thread.
+ */
+class HashCache {
+private:
+  boost::shared_ptr< ::detail::HashCacheImpl> impl;
+
+protected:
+  HashCache(::detail::HashCacheImpl* impl);
+
+public:
+  /**
+   * Opens the cache file, it's created on save() if it doesn't exist.
+   * @param rehash if true, cached digests are never used, but still updated.
+   * @param prune if true, files that were not looked up are dropped on save().
+   */
+  HashCache(boost::filesystem::wpath cacheFile, bool rehash, bool prune);
+
+  /**
+   * Fills in the digests of the entries that are found in the cache.
+   * @returns the entries that have to be hashed.
+   */
+  ArrayList<FileEntry> lookup(ArrayList<FileEntry> entries, HashTask task);
+
+  /**
+   * Stores the digests of the entries returned by the last call to lookup.
+   * Entries that failed or changed in size while being hashed are not stored.
+   */
+  void store(HashTask task);
+
+  /**
+   * Writes the cache file, merging the stored digests into it as it's written.
+   */
+  void save();
+};
+
+// -------------------------------------------------------------------------- //
+// XattrHashCache
+// -------------------------------------------------------------------------- //
+/**
+ * XattrHashCache keeps the digests in extended attributes of the hashed files,
+ * so that they travel along with the files when those are copied with 
+ * rsync -X or tar --xattrs. Extended attributes are supported on linux only,
+ * elsewhere nothing is cached.
+ */
+class XattrHashCache: public HashCache {
+public:
+  explicit XattrHashCache(bool rehash);
+};
+
+#endif
@@ -3,14 +3,22 @@
 #include "Hash.h"
 #include "FileEntry.h"
 #include "Streams.h"
+#include "AsyncReader.h"
+#include "DiskOrder.h"
 #include "Task.h"
 #include "arx/Exception.h"
 #include <boost/array.hpp>
 #include <boost/thread.hpp>
-#include <boost/thread/barrier.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
 #include <boost/scoped_ptr.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/shared_array.hpp>
 #include <boost/bind.hpp>
 #include <algorithm>
+#include <map>
+#include <deque>
+#include <vector>
 #include <iostream>
 #include <iomanip>
 
@@ -19,58 +27,327 @@ using namespace boost;
 using namespace boost::filesystem;
 using namespace arx;
 
-array<unsigned char, FILEBUFSIZE> buf, buf_;
-
 namespace detail {
   class HasherImpl {
   protected:
     HashTask task;
     HasherCallBack callBack;
+    optional<HashCache> cache;
+    bool diskOrdered;
   public:
-    HasherImpl(HashTask task, HasherCallBack callBack) : task(task), callBack(callBack) {}
+    HasherImpl(HashTask task, HasherCallBack callBack) : task(task), callBack(callBack), diskOrdered(false) {}
+    virtual ~HasherImpl() {}
     virtual void hash(FileEntry entry) = 0;
+
+    void setCache(optional<HashCache> cache) {
+      this->cache = cache;
+    }
+
+    void setDiskOrdered(bool diskOrdered) {
+      this->diskOrdered = diskOrdered;
+    }
+
+    /**
+     * Takes the digests of unchanged files from the cache and hashes the rest.
+     */
+    void hashCached(ArrayList<FileEntry> entries) {
+      hashAll(lookupCached(entries));
+      if(this->cache)
+        this->cache->store(this->task);
+    }
+
+    /**
+     * Takes the digests of unchanged files from the cache, they are reported as
+     * finished right away.
+     * @returns the entries that have to be hashed.
+     */
+    ArrayList<FileEntry> lookupCached(ArrayList<FileEntry> entries) {
+      if(!this->cache)
+        return entries;
+
+      ArrayList<FileEntry> misses = this->cache->lookup(entries, this->task);
+      uint64 cachedSize = 0, missedSize = 0;
+      FOREACH(FileEntry entry, entries)
+        if(!entry.isFailed())
+          cachedSize += entry.getSize();
+      FOREACH(FileEntry entry, misses)
+        if(!entry.isFailed())
+          missedSize += entry.getSize();
+      callBack(cachedSize - missedSize);
+      for(uint32 i = 0, j = 0; i < entries.size(); i++) {
+        if(j < misses.size() && !(entries[i] < misses[j]) && !(misses[j] < entries[i]))
+          j++;
+        else
+          callBack.finished(entries[i]);
+      }
+      return misses;
+    }
+
+    virtual void hashTable(FileTable table) {
+      table.allocateDigests(this->task);
+      if(this->diskOrdered) {
+        vector<uint32> rows = getDiskOrder(table);
+        for(uint32 first = 0; first < rows.size(); first += HASHERWINDOWSIZE)
+          hashCached(table.getEntries(rows, first, HASHERWINDOWSIZE));
+      } else {
+        for(uint32 first = 0; first < table.size(); first += HASHERWINDOWSIZE)
+          hashCached(table.getEntries(first, HASHERWINDOWSIZE));
+      }
+    }
+
+    /**
+     * Hashes the given files one after another, reading of a file may start 
+     * while the previous one is still being hashed.
+     */
+    virtual void hashFiles(ArrayList<FileEntry> entries) {
+      FOREACH(FileEntry entry, entries)
+        hash(entry);
+    }
+
+    virtual void hashAll(ArrayList<FileEntry> entries) {
+      ArrayList<FileEntry> rest;
+      FOREACH(ArrayList<FileEntry> batch, splitBatches(entries, rest))
+        hashBatch(batch);
+      hashFiles(rest);
+    }
+
+  protected:
+    /**
+     * Groups small files into batches, if there is a hash in the task that 
+     * benefits from it.
+     * @param rest receives the entries that are to be hashed one by one.
+     */
+    ArrayList<ArrayList<FileEntry> > splitBatches(ArrayList<FileEntry> entries, ArrayList<FileEntry>& rest) {
+      ArrayList<ArrayList<FileEntry> > batches;
+      bool batching = false;
+      for(uint32 i = 0; i < task.size(); i++)
+        if(task.isSet(i) && isMultiBufferHash(i))
+          batching = true;
+
+      ArrayList<FileEntry> batch;
+      uint64 batchSize = 0;
+      FOREACH(FileEntry entry, entries) {
+        if(entry.isFailed())
+          continue;
+        if(!batching || entry.getSize() > BATCHMAXFILESIZE || entry.getPath() == _T("-")) {
+          rest.add(entry);
+          continue;
+        }
+        if(batch.size() == BATCHMAXFILES || batchSize + entry.getSize() > BATCHMAXSIZE) {
+          batches.add(batch);
+          batch = ArrayList<FileEntry>();
+          batchSize = 0;
+        }
+        batch.add(entry);
+        batchSize += entry.getSize();
+      }
+      if(!batch.empty())
+        batches.add(batch);
+      return batches;
+    }
+
+    /**
+     * Files of a batch read whole into a single buffer.
+     */
+    struct BatchData {
+      shared_array<unsigned char> buf;
+      ArrayList<FileEntry> loaded;
+      ArrayList<const unsigned char*> data;
+      ArrayList<size_t> sizes;
+    };
+
+    /**
+     * Reads the files of a batch whole and hashes them together. Files that 
+     * have grown since their size was taken are hashed one by one.
+     */
+    void hashBatch(ArrayList<FileEntry> batch) {
+      ArrayList<FileEntry> grown;
+      hashBatchData(readBatch(batch, grown));
+      FOREACH(FileEntry entry, grown)
+        hash(entry);
+    }
+
+    /**
+     * Reads the files of a batch whole.
+     * @param grown receives the files that have grown since their size was 
+     *   taken, they have to be hashed one by one.
+     */
+    BatchData readBatch(ArrayList<FileEntry> batch, ArrayList<FileEntry>& grown) {
+      uint64 batchSize = 0;
+      FOREACH(FileEntry entry, batch)
+        batchSize += entry.getSize();
+      BatchData result;
+      result.buf.reset(new unsigned char[(size_t) batchSize + 1]);
+
+      unsigned char* pos = result.buf.get();
+      FOREACH(FileEntry entry, batch) {
+        InputStream stream;
+        try {
+          stream = createInputStream(entry.getPath());
+        } catch(...) {
+          entry.setFailed(true);
+          continue;
+        }
+        uint32 size = (uint32) entry.getSize(), totalRead = 0;
+        int read;
+        while(totalRead < size && (read = stream.read(pos + totalRead, size - totalRead)) != EOF)
+          totalRead += (uint32) read;
+        unsigned char probe;
+        if(totalRead == size && stream.read(&probe, 1) != EOF) {
+          grown.add(entry);
+          continue;
+        }
+        callBack(size);
+        entry.setSize(totalRead);
+        result.loaded.add(entry);
+        result.data.add(pos);
+        result.sizes.add(totalRead);
+        pos += totalRead;
+      }
+      return result;
+    }
+
+    /**
+     * Hashes the files of a batch read by readBatch together.
+     */
+    void hashBatchData(BatchData batch) {
+      for(uint32 i = 0; i < task.size(); i++) {
+        if(!task.isSet(i))
+          continue;
+        ArrayList<Digest> digests = calculateHashes(batch.data, batch.sizes, i);
+        for(uint32 j = 0; j < batch.loaded.size(); j++)
+          batch.loaded[j].setDigest(i, digests[j]);
+      }
+      FOREACH(FileEntry entry, batch.loaded)
+        callBack.finished(entry);
+    }
   };
 
   class SimpleHasher: public HasherImpl {
   private:
+    scoped_array<unsigned char> bufStorage;
+    unsigned char* buf;
+    AsyncReader reader;
+
   public:
-    SimpleHasher(HashTask task, HasherCallBack callBack): HasherImpl(task, callBack) {}
+    SimpleHasher(HashTask task, HasherCallBack callBack): HasherImpl(task, callBack), reader(HASHERQUEUEDEPTH) {
+      this->buf = allocateAligned(this->bufStorage, FILEBUFSIZE);
+    }
+
     void hash(FileEntry entry) {
-      InputStream stream;
-      try {
-        stream = createInputStream(entry.getPath(), true);
-      } catch(...) {
-        entry.setFailed(true);
-        return;
-      }
-      ArrayList<Hash> hashList = task.createHashList(entry.getSize());
+      ArrayList<FileEntry> entries;
+      entries.add(entry);
+      hashFiles(entries);
+    }
+
+    void hashFiles(ArrayList<FileEntry> entries) {
+      ArrayList<Hash> hashList;
       uint64 totalRead = 0;
-      callBack(0);
-      uint32 read;
-      while((read = stream.read(buf.c_array(), (unsigned int) buf.size())) != EOF) {
-        totalRead += read;
-        callBack(read);
-        FOREACH(Hash hash, hashList)
-          hash.update(buf.c_array(), read);
-      }
-      if(totalRead < entry.getSize())
-        callBack(entry.getSize() - totalRead);
-      entry.setSize(totalRead);
-      FOREACH(Hash hash, hashList)
-        entry.setDigest(hash.getId(), hash.finalize());
+      AsyncReader::Block block;
+      this->reader.start(entries);
+      while(this->reader.read(block, this->buf)) {
+        if(!block.mapping)
+          this->buf = block.data;
+        if(block.fileStart) {
+          hashList = task.createHashList(block.entry.getSize());
+          totalRead = 0;
+          callBack(0);
+        }
+        if(block.size != 0) {
+          totalRead += block.size;
+          callBack(block.size);
+          FOREACH(Hash hash, hashList)
+            hash.update(block.data, block.size);
+        }
+        if(block.fileEnd) {
+          if(totalRead < block.entry.getSize())
+            callBack(block.entry.getSize() - totalRead);
+          block.entry.setSize(totalRead);
+          FOREACH(Hash hash, hashList)
+            block.entry.setDigest(hash.getId(), hash.finalize());
+          callBack.finished(block.entry);
+        }
+      }
     }
   };
 
   class MultiThreadedHasher: public HasherImpl {
   private:
-    bool fileEnd;
+    /**
+     * Chunk is a piece of file data passed from the reading thread to the hashing 
+     * threads. A chunk cannot be reused until all of the hashing threads are done 
+     * with it, which is tracked with a reference count.
+     */
+    struct Chunk {
+      unsigned char* buffer;
+      unsigned char* data;
+      boost::shared_ptr<void> mapping;
+      uint32 size;
+      uint32 refCount;
+      bool fileEnd;
+      uint64 fileSize;
+      FileEntry entry;
+    };
+
     bool terminating;
-    unsigned char* bufToHash;
-    uint32 bufToHashSize;
-    barrier* beginBarrier;
-    barrier* readBarrier;
-    barrier* hashBarrier;
-    FileEntry currentEntry;
+    uint32 numThreads;
+    uint64 chunksRead;
+    uint32 chunksInUse;
+    scoped_array<unsigned char> bufStorage;
+    array<Chunk, HASHERBUFCOUNT> chunks;
+    mutex chunkMutex;
+    condition_variable chunkRead;
+    condition_variable chunkReleased;
+
+    Chunk* waitForChunk(uint64 chunkIndex) {
+      mutex::scoped_lock lock(this->chunkMutex);
+      while(this->chunksRead <= chunkIndex && !this->terminating)
+        this->chunkRead.wait(lock);
+      if(this->chunksRead <= chunkIndex)
+        return NULL;
+      return &this->chunks[chunkIndex % HASHERBUFCOUNT];
+    }
+
+    void releaseChunk(Chunk* chunk) {
+      FileEntry finishedEntry;
+      bool finished = false;
+      {
+        mutex::scoped_lock lock(this->chunkMutex);
+        chunk->refCount--;
+        if(chunk->refCount == 0) {
+          if(chunk->fileEnd) {
+            finishedEntry = chunk->entry;
+            finished = true;
+          }
+          this->chunksInUse--;
+          this->chunkReleased.notify_all();
+        }
+      }
+      if(finished)
+        callBack.finished(finishedEntry);
+    }
+
+    Chunk* acquireChunk() {
+      Chunk* chunk = &this->chunks[this->chunksRead % HASHERBUFCOUNT];
+      mutex::scoped_lock lock(this->chunkMutex);
+      while(chunk->refCount != 0)
+        this->chunkReleased.wait(lock);
+      return chunk;
+    }
+
+    void publishChunk(Chunk* chunk) {
+      mutex::scoped_lock lock(this->chunkMutex);
+      chunk->refCount = this->numThreads;
+      this->chunksInUse++;
+      this->chunksRead++;
+      this->chunkRead.notify_all();
+    }
+
+    void waitForAllChunks() {
+      mutex::scoped_lock lock(this->chunkMutex);
+      while(this->chunksInUse != 0)
+        this->chunkReleased.wait(lock);
+    }
 
     class ThreadClass {
     private:
@@ -79,79 +356,482 @@ namespace detail {
     public:
       ThreadClass(MultiThreadedHasher* owner, uint32 hashId): owner(owner), hashId(hashId) {}
       void operator() () {
-        while(true) {
-          owner->beginBarrier->wait(); // wait for new file
-          if(owner->terminating)
+        scoped_ptr<Hash> hash;
+        for(uint64 chunkIndex = 0; ; chunkIndex++) {
+          Chunk* chunk = owner->waitForChunk(chunkIndex);
+          if(chunk == NULL)
             return;
-          Hash hash(this->hashId, owner->currentEntry.getSize());
-          owner->hashBarrier->wait(); // let owner pass
-          while(!owner->fileEnd) {
-            owner->readBarrier->wait(); // wait for owner to read
-            hash.update(owner->bufToHash, owner->bufToHashSize);
-            owner->hashBarrier->wait(); // let owner pass
+          if(!hash)
+            hash.reset(new Hash(this->hashId, chunk->fileSize));
+          if(chunk->size != 0)
+            hash->update(chunk->data, chunk->size);
+          if(chunk->fileEnd) {
+            chunk->entry.setDigest(hash->getId(), hash->finalize());
+            hash.reset();
           }
-          owner->currentEntry.setDigest(hash.getId(), hash.finalize());
-          owner->beginBarrier->wait(); // notify owner about end of work
+          owner->releaseChunk(chunk);
         }
       }
     };
 
     thread_group threadGroup;
     ArrayList<ThreadClass> threads;
+    AsyncReader reader;
 
   public:
-    MultiThreadedHasher(HashTask task, HasherCallBack callBack): HasherImpl(task, callBack) {
+    MultiThreadedHasher(HashTask task, HasherCallBack callBack): HasherImpl(task, callBack), reader(HASHERQUEUEDEPTH) {
       this->terminating = false;
-      uint32 numThreads = 0;
+      this->chunksRead = 0;
+      this->chunksInUse = 0;
+      this->numThreads = 0;
       for(uint32 i = 0; i < task.size(); i++) {
         if(task.isSet(i)) {
-          numThreads++;
+          this->numThreads++;
           this->threads.add(ThreadClass(this, i));
         }
       }
-      this->beginBarrier = new barrier(numThreads + 1);
-      this->readBarrier = new barrier(numThreads + 1);
-      this->hashBarrier = new barrier(numThreads + 1);
+
+      unsigned char* alignedBuf = allocateAligned(this->bufStorage, HASHERBUFCOUNT * FILEBUFSIZE);
+      for(uint32 i = 0; i < HASHERBUFCOUNT; i++) {
+        this->chunks[i].buffer = this->chunks[i].data = alignedBuf + i * FILEBUFSIZE;
+        this->chunks[i].size = 0;
+        this->chunks[i].refCount = 0;
+        this->chunks[i].fileEnd = false;
+        this->chunks[i].fileSize = 0;
+      }
+
       FOREACH(ThreadClass& singleThread, threads)
         this->threadGroup.create_thread(boost::bind(&ThreadClass::operator(), &singleThread));
     }
+
+    ~MultiThreadedHasher() {
+      {
+        mutex::scoped_lock lock(this->chunkMutex);
+        this->terminating = true;
+        this->chunkRead.notify_all();
+      }
+      this->threadGroup.join_all();
+    }
+
     void hash(FileEntry entry) {
-      InputStream stream;
+      ArrayList<FileEntry> entries;
+      entries.add(entry);
+      hashFiles(entries);
+    }
+
+    void hashFiles(ArrayList<FileEntry> entries) {
+      uint64 totalRead = 0;
+      AsyncReader::Block block;
+      this->reader.start(entries);
+      while(true) {
+        Chunk* chunk = acquireChunk();
+        if(!this->reader.read(block, chunk->buffer))
+          break;
+        if(!block.mapping)
+          chunk->buffer = block.data;
+        chunk->data = block.data;
+        chunk->mapping = block.mapping;
+        chunk->size = block.size;
+        chunk->fileEnd = block.fileEnd;
+        chunk->fileSize = block.entry.getSize();
+        chunk->entry = block.entry;
+        if(block.fileStart) {
+          totalRead = 0;
+          callBack(0);
+        }
+        /* Size is final before the hashing threads may report the file as finished. */
+        totalRead += block.size;
+        uint64 expectedSize = block.entry.getSize();
+        if(block.fileEnd)
+          block.entry.setSize(totalRead);
+        publishChunk(chunk);
+        if(block.size != 0)
+          callBack(block.size);
+        if(block.fileEnd && totalRead < expectedSize)
+          callBack(expectedSize - totalRead);
+      }
+      waitForAllChunks(); // wait for children to fill up digest fields
+      FOREACH(Chunk& chunk, this->chunks)
+        chunk.mapping.reset();
+    }
+  };
+
+  /**
+   * ParallelHasher hashes several files at once, one file per scheduler job. 
+   * Every file is hashed with a hasher of its own taken from a pool, so that 
+   * buffers and readers are never shared, not even when a thread that waits
+   * for other jobs picks up another file while its own is still being hashed.
+   */
+  class ParallelHasher: public HasherImpl {
+  private:
+    Scheduler scheduler;
+    bool isMultiThreaded;
+    mutex poolMutex;
+    vector<boost::shared_ptr<HasherImpl> > idleHashers;
+
+    boost::shared_ptr<HasherImpl> acquireHasher() {
+      {
+        mutex::scoped_lock lock(this->poolMutex);
+        if(!this->idleHashers.empty()) {
+          boost::shared_ptr<HasherImpl> hasher = this->idleHashers.back();
+          this->idleHashers.pop_back();
+          return hasher;
+        }
+      }
+      if(this->isMultiThreaded)
+        return boost::shared_ptr<HasherImpl>(new MultiThreadedHasher(task, callBack));
+      else
+        return boost::shared_ptr<HasherImpl>(new SimpleHasher(task, callBack));
+    }
+
+    void releaseHasher(boost::shared_ptr<HasherImpl> hasher) {
+      mutex::scoped_lock lock(this->poolMutex);
+      this->idleHashers.push_back(hasher);
+    }
+
+  public:
+    ParallelHasher(HashTask task, bool isMultiThreaded, Scheduler scheduler, HasherCallBack callBack): 
+      HasherImpl(task, SynchronizedHasherCallBack(callBack)), scheduler(scheduler), isMultiThreaded(isMultiThreaded) {
+      return;
+    }
+
+    void hash(FileEntry entry) {
+      boost::shared_ptr<HasherImpl> hasher = acquireHasher();
+      hasher->hash(entry);
+      releaseHasher(hasher);
+    }
+
+    void hashAll(ArrayList<FileEntry> entries) {
+      JobGroup group(this->scheduler);
+      ArrayList<FileEntry> rest;
+      FOREACH(ArrayList<FileEntry> batch, splitBatches(entries, rest))
+        group.run(boost::bind(&ParallelHasher::hashBatch, this, batch));
+      FOREACH(FileEntry entry, rest)
+        group.run(boost::bind(&ParallelHasher::hash, this, entry));
+      group.wait();
+    }
+  };
+
+  /**
+   * DeviceHasher reads files of different disks in parallel. The whole table 
+   * is split by disk up front, and every disk gets a reader thread with its 
+   * own reads in flight and buffers, so that the disks are read sequentially
+   * but all at once. The data read is hashed by scheduler jobs, so hashing
+   * takes no more threads than the scheduler has. Blocks of a file are hashed
+   * in order by a strand, a run of jobs of which only one is queued at a time.
+   * There is a strand per file, or a strand per hash with isMultiThreaded.
+   */
+  class DeviceHasher: public HasherImpl {
+  private:
+    struct FileState {
+      FileEntry entry;
+      uint32 unfinishedStrands;
+    };
+
+    struct Chunk {
+      unsigned char* buffer;
+      unsigned char* data;
+      boost::shared_ptr<void> mapping;
+      uint32 size;
+      bool fileEnd;
+      uint32 unfinishedStrands;
+      boost::shared_ptr<FileState> file;
+    };
+
+    struct Strand {
+      ArrayList<Hash> hashes;
+      deque<boost::shared_ptr<Chunk> > chunks;
+      bool scheduled;
+    };
+
+    /**
+     * Files of a single disk and the state of their reader. The buffers read
+     * are exchanged with the ones of the reader, so it lives as long as the
+     * disk and not only as long as the reading thread.
+     */
+    struct Disk: private noncopyable {
+      optional<FileTable> table;
+      vector<uint32> rows;
+      ArrayList<FileEntry> entries;
+      JobGroup* group;
+      string error;
+
+      AsyncReader reader;
+      mutex diskMutex;
+      condition_variable released;
+      scoped_array<unsigned char> bufferStorage;
+      vector<unsigned char*> freeBuffers;
+      uint32 batchCount;
+      uint32 busyCount;
+
+      Disk(): group(NULL), reader(HASHERQUEUEDEPTH), batchCount(0), busyCount(0) {
+        unsigned char* buffers = allocateAligned(this->bufferStorage, HASHERBUFCOUNT * FILEBUFSIZE);
+        for(uint32 i = 0; i < HASHERBUFCOUNT; i++)
+          this->freeBuffers.push_back(buffers + i * FILEBUFSIZE);
+      }
+
+      uint32 size() const {
+        return this->table ? (uint32) this->rows.size() : this->entries.size();
+      }
+    };
+
+    typedef map<uint64, boost::shared_ptr<Disk> > DiskMap;
+
+    Scheduler scheduler;
+    bool isMultiThreaded;
+
+    /** Files of a directory are on the disk of the directory, so that only directories are stat'ed. */
+    static Disk& getDisk(DiskMap& disks, map<wstring, uint64>& directoryDisks, FileEntry entry) {
+      uint64 diskId = 0;
+      if(!entry.isFailed()) {
+        wstring directory = entry.getPath().branch_path().wstring();
+        map<wstring, uint64>::iterator i = directoryDisks.find(directory);
+        if(i == directoryDisks.end())
+          i = directoryDisks.insert(make_pair(directory, getDiskId(directory.empty() ? wpath(L".") : wpath(directory)))).first;
+        diskId = i->second;
+      }
+      boost::shared_ptr<Disk>& disk = disks[diskId];
+      if(!disk)
+        disk.reset(new Disk());
+      return *disk;
+    }
+
+    void hashDisks(DiskMap& disks) {
+      JobGroup group(this->scheduler);
+      thread_group threads;
+      for(DiskMap::iterator i = disks.begin(); i != disks.end(); i++) {
+        i->second->group = &group;
+        threads.create_thread(boost::bind(&DeviceHasher::readDisk, this, i->second.get()));
+      }
+      threads.join_all();
+      group.wait();
+      for(DiskMap::iterator i = disks.begin(); i != disks.end(); i++)
+        if(!i->second->error.empty())
+          throw runtime_error(i->second->error);
+    }
+
+    void readDisk(Disk* disk) {
       try {
-        stream = createInputStream(entry.getPath(), true);
-      } catch(...) {
-        entry.setFailed(true);
-        return;
-      }
-      this->fileEnd = false;
-      this->currentEntry = entry;
-      unsigned char* buf0 = buf.c_array();
-      unsigned char* buf1 = buf_.c_array();
-      size_t bufSize = buf.size();
-      this->beginBarrier->wait(); // start hash thread execution
-  
+        for(uint32 first = 0; first < disk->size(); first += HASHERWINDOWSIZE) {
+          ArrayList<FileEntry> entries;
+          if(disk->table)
+            entries = disk->table->getEntries(disk->rows, first, HASHERWINDOWSIZE);
+          else
+            for(uint32 i = first; i < disk->size() && i < first + HASHERWINDOWSIZE; i++)
+              entries.add(disk->entries[i]);
+
+          ArrayList<FileEntry> rest;
+          FOREACH(ArrayList<FileEntry> batch, splitBatches(lookupCached(entries), rest))
+            readBatch(disk, batch, rest);
+          readFiles(disk, rest);
+
+          /* Cache stores the files looked up by this thread, once they are hashed. */
+          if(this->cache) {
+            mutex::scoped_lock lock(disk->diskMutex);
+            while(disk->busyCount != 0)
+              disk->released.wait(lock);
+            lock.unlock();
+            this->cache->store(this->task);
+          }
+        }
+      } catch(std::exception& e) {
+        disk->error = e.what();
+      }
+    }
+
+    void readBatch(Disk* disk, ArrayList<FileEntry> batch, ArrayList<FileEntry> rest) {
+      {
+        mutex::scoped_lock lock(disk->diskMutex);
+        while(disk->batchCount >= DEVICEBATCHCOUNT)
+          disk->released.wait(lock);
+        disk->batchCount++;
+        disk->busyCount++;
+      }
+      ArrayList<FileEntry> grown;
+      BatchData data = HasherImpl::readBatch(batch, grown);
+      FOREACH(FileEntry entry, grown)
+        rest.add(entry);
+      disk->group->run(boost::bind(&DeviceHasher::hashDiskBatch, this, disk, data));
+    }
+
+    void hashDiskBatch(Disk* disk, BatchData data) {
+      hashBatchData(data);
+      mutex::scoped_lock lock(disk->diskMutex);
+      disk->batchCount--;
+      disk->busyCount--;
+      disk->released.notify_all();
+    }
+
+    ArrayList<boost::shared_ptr<Strand> > createStrands(FileEntry entry) {
+      ArrayList<boost::shared_ptr<Strand> > strands;
+      ArrayList<Hash> hashes = this->task.createHashList(entry.getSize());
+      if(!this->isMultiThreaded || hashes.empty()) {
+        strands.add(boost::shared_ptr<Strand>(new Strand()));
+        strands[0]->hashes = hashes;
+        strands[0]->scheduled = false;
+        return strands;
+      }
+      FOREACH(Hash hash, hashes) {
+        boost::shared_ptr<Strand> strand(new Strand());
+        strand->hashes.add(hash);
+        strand->scheduled = false;
+        strands.add(strand);
+      }
+      return strands;
+    }
+
+    void readFiles(Disk* disk, ArrayList<FileEntry> entries) {
+      boost::shared_ptr<FileState> file;
+      ArrayList<boost::shared_ptr<Strand> > strands;
       uint64 totalRead = 0;
-      callBack(0);
-      uint32 read;
-      while((read = stream.read(buf0, (unsigned int) bufSize)) != EOF) {
-        totalRead += read;
-        callBack(read);
-        this->hashBarrier->wait(); // wait for end of hashing
-        this->bufToHash = buf0;
-        this->bufToHashSize = read;
-        this->readBarrier->wait(); // start hashing of a new chunk
-        swap(buf0, buf1);
-      }
-      fileEnd = true;
-      this->hashBarrier->wait(); // notify children about file end
-      if(totalRead < entry.getSize())
-        callBack(entry.getSize() - totalRead);
-      entry.setSize(totalRead);
-      this->beginBarrier->wait(); // wait for children to fill up digest fields
+      AsyncReader::Block block;
+      disk->reader.start(entries);
+      while(true) {
+        unsigned char* spare;
+        {
+          mutex::scoped_lock lock(disk->diskMutex);
+          while(disk->freeBuffers.empty())
+            disk->released.wait(lock);
+          spare = disk->freeBuffers.back();
+          disk->freeBuffers.pop_back();
+        }
+        if(!disk->reader.read(block, spare)) {
+          mutex::scoped_lock lock(disk->diskMutex);
+          disk->freeBuffers.push_back(spare);
+          break;
+        }
+
+        boost::shared_ptr<Chunk> chunk(new Chunk());
+        chunk->buffer = block.mapping ? spare : block.data;
+        chunk->data = block.data;
+        chunk->mapping = block.mapping;
+        chunk->size = block.size;
+        chunk->fileEnd = block.fileEnd;
+        if(block.fileStart) {
+          file.reset(new FileState());
+          file->entry = block.entry;
+          strands = createStrands(block.entry);
+          file->unfinishedStrands = strands.size();
+          totalRead = 0;
+          callBack(0);
+        }
+        chunk->file = file;
+        chunk->unfinishedStrands = strands.size();
+
+        /* Size is final before the hashing jobs may report the file as finished. */
+        totalRead += block.size;
+        uint64 expectedSize = block.entry.getSize();
+        if(block.fileEnd)
+          block.entry.setSize(totalRead);
+
+        ArrayList<boost::shared_ptr<Strand> > idleStrands;
+        {
+          mutex::scoped_lock lock(disk->diskMutex);
+          disk->busyCount++;
+          FOREACH(boost::shared_ptr<Strand> strand, strands) {
+            strand->chunks.push_back(chunk);
+            if(!strand->scheduled) {
+              strand->scheduled = true;
+              idleStrands.add(strand);
+            }
+          }
+        }
+        FOREACH(boost::shared_ptr<Strand> strand, idleStrands)
+          disk->group->run(boost::bind(&DeviceHasher::hashStrand, this, disk, strand));
+
+        if(block.size != 0)
+          callBack(block.size);
+        if(block.fileEnd && totalRead < expectedSize)
+          callBack(expectedSize - totalRead);
+      }
+    }
+
+    void hashStrand(Disk* disk, boost::shared_ptr<Strand> strand) {
+      while(true) {
+        boost::shared_ptr<Chunk> chunk;
+        {
+          mutex::scoped_lock lock(disk->diskMutex);
+          if(strand->chunks.empty()) {
+            strand->scheduled = false;
+            return;
+          }
+          chunk = strand->chunks.front();
+          strand->chunks.pop_front();
+        }
+
+        FOREACH(Hash hash, strand->hashes) {
+          if(chunk->size != 0)
+            hash.update(chunk->data, chunk->size);
+          if(chunk->fileEnd)
+            chunk->file->entry.setDigest(hash.getId(), hash.finalize());
+        }
+
+        bool fileFinished;
+        {
+          mutex::scoped_lock lock(disk->diskMutex);
+          fileFinished = chunk->fileEnd && --chunk->file->unfinishedStrands == 0;
+        }
+        if(fileFinished)
+          callBack.finished(chunk->file->entry);
+
+        mutex::scoped_lock lock(disk->diskMutex);
+        if(--chunk->unfinishedStrands == 0) {
+          disk->freeBuffers.push_back(chunk->buffer);
+          disk->busyCount--;
+          disk->released.notify_all();
+        }
+      }
+    }
+
+  public:
+    DeviceHasher(HashTask task, bool isMultiThreaded, Scheduler scheduler, HasherCallBack callBack): 
+      HasherImpl(task, SynchronizedHasherCallBack(callBack)), scheduler(scheduler), isMultiThreaded(isMultiThreaded) {
+      return;
+    }
+
+    void hash(FileEntry entry) {
+      ArrayList<FileEntry> entries;
+      entries.add(entry);
+      hashAll(entries);
+    }
+
+    void hashAll(ArrayList<FileEntry> entries) {
+      DiskMap disks;
+      map<wstring, uint64> directoryDisks;
+      FOREACH(FileEntry entry, entries)
+        getDisk(disks, directoryDisks, entry).entries.add(entry);
+      hashDisks(disks);
+    }
+
+    /**
+     * Groups the whole table by disk before anything is read, cache lookups 
+     * are then done by the disk readers.
+     */
+    void hashTable(FileTable table) {
+      table.allocateDigests(this->task);
+      vector<uint32> rows;
+      if(this->diskOrdered)
+        rows = getDiskOrder(table);
+      else
+        for(uint32 row = 0; row < table.size(); row++)
+          rows.push_back(row);
+
+      DiskMap disks;
+      map<wstring, uint64> directoryDisks;
+      FOREACH(uint32 row, rows) {
+        Disk& disk = getDisk(disks, directoryDisks, table[row]);
+        disk.table = table;
+        disk.rows.push_back(row);
+      }
+      hashDisks(disks);
     }
   };
 };
 
+Hasher::Hasher(::detail::HasherImpl* impl): impl(impl) {
+  return;
+}
+
 Hasher::Hasher(HashTask task, bool isMultiThreaded, HasherCallBack callBack) {
   if(isMultiThreaded)
     impl.reset(new ::detail::MultiThreadedHasher(task, callBack));
@@ -159,10 +839,30 @@ Hasher::Hasher(HashTask task, bool isMultiThreaded, HasherCallBack callBack) {
     impl.reset(new ::detail::SimpleHasher(task, callBack));
 }
 
+Hasher::Hasher(HashTask task, bool isMultiThreaded, Scheduler scheduler, HasherCallBack callBack) {
+  impl.reset(new ::detail::ParallelHasher(task, isMultiThreaded, scheduler, callBack));
+}
+
 void Hasher::hash(FileEntry entry) {
   impl->hash(entry);
 }
 
+void Hasher::hash(ArrayList<FileEntry> entries) {
+  impl->hashCached(entries);
+}
+
+void Hasher::hash(FileTable table) {
+  impl->hashTable(table);
+}
+
+void Hasher::setCache(optional<HashCache> cache) {
+  impl->setCache(cache);
+}
+
+void Hasher::setDiskOrdered(bool diskOrdered) {
+  impl->setDiskOrdered(diskOrdered);
+}
+
 Digest Hasher::hash(uint32 hashId, wpath filePath, HasherCallBack callBack) {
   HashTask task;
   task.add(hashId);
@@ -194,6 +894,56 @@ void HasherCallBack::clear() {
   this->impl->clear();
 }
 
+void HasherCallBack::finished(FileEntry entry) {
+  this->impl->finished(entry);
+}
+
+// -------------------------------------------------------------------------- //
+// DeviceHasher
+// -------------------------------------------------------------------------- //
+DeviceHasher::DeviceHasher(HashTask task, bool isMultiThreaded, HasherCallBack callBack): Hasher(new ::detail::DeviceHasher(task, isMultiThreaded, Scheduler(1), callBack)) {
+  return;
+}
+
+DeviceHasher::DeviceHasher(HashTask task, bool isMultiThreaded, Scheduler scheduler, HasherCallBack callBack): Hasher(new ::detail::DeviceHasher(task, isMultiThreaded, scheduler, callBack)) {
+  return;
+}
+
+// -------------------------------------------------------------------------- //
+// SynchronizedHasherCallBack
+// -------------------------------------------------------------------------- //
+namespace detail {
+  class SynchronizedHasherCallBackImpl: public HasherCallBackImpl {
+  private:
+    HasherCallBack callBack;
+    mutex callBackMutex;
+
+  public:
+    SynchronizedHasherCallBackImpl(HasherCallBack callBack): callBack(callBack) {
+      return;
+    }
+
+    virtual void operator() (uint64 justProcessed) {
+      mutex::scoped_lock lock(this->callBackMutex);
+      this->callBack(justProcessed);
+    }
+
+    virtual void clear() {
+      mutex::scoped_lock lock(this->callBackMutex);
+      this->callBack.clear();
+    }
+
+    virtual void finished(FileEntry entry) {
+      mutex::scoped_lock lock(this->callBackMutex);
+      this->callBack.finished(entry);
+    }
+  };
+}
+
+SynchronizedHasherCallBack::SynchronizedHasherCallBack(HasherCallBack callBack): HasherCallBack(new ::detail::SynchronizedHasherCallBackImpl(callBack)) {
+  return;
+}
+
 // -------------------------------------------------------------------------- //
 // PrinterHasherCallBackImpl
 // -------------------------------------------------------------------------- //
@@ -245,5 +995,38 @@ PrinterHasherCallBack::PrinterHasherCallBack(uint64 sumSize, arx::Printer* print
   return;
 }
 
+// -------------------------------------------------------------------------- //
+// OutputHasherCallBack
+// -------------------------------------------------------------------------- //
+namespace detail {
+  class OutputHasherCallBackImpl: public HasherCallBackImpl {
+  private:
+    HasherCallBack progress;
+    OutputTask outputTask;
+    HashTask hashTask;
 
+  public:
+    OutputHasherCallBackImpl(HasherCallBack progress, OutputTask outputTask, HashTask hashTask): progress(progress), outputTask(outputTask), hashTask(hashTask) {
+      return;
+    }
+
+    virtual void operator() (uint64 justProcessed) {
+      this->progress(justProcessed);
+    }
+
+    virtual void clear() {
+      this->progress.clear();
+    }
 
+    virtual void finished(FileEntry entry) {
+      /* Records may go to the console, so the progress line is cleared first. */
+      this->progress.clear();
+      this->outputTask.write(this->hashTask, entry);
+      this->progress.finished(entry);
+    }
+  };
+}
+
+OutputHasherCallBack::OutputHasherCallBack(HasherCallBack progress, OutputTask outputTask, HashTask hashTask): HasherCallBack(new ::detail::OutputHasherCallBackImpl(progress, outputTask, hashTask)) {
+  return;
+}
@@ -4,8 +4,11 @@
 #include "config.h"
 #include "Task.h"
 #include "FileEntry.h"
+#include "Scheduler.h"
+#include "HashCache.h"
 #include "arx/Streams.h"
 #include <boost/shared_ptr.hpp>
+#include <boost/optional.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/timer.hpp>
 #include <boost/filesystem.hpp>
@@ -18,12 +21,13 @@ namespace detail {
   public:
     virtual void operator() (uint64 justProcessed) {return;};
     virtual void clear() {return;};
+    virtual void finished(FileEntry entry) {return;};
   };
 }
 
 class HasherCallBack {
 private:
-  boost::shared_ptr<::detail::HasherCallBackImpl> impl;
+  boost::shared_ptr< ::detail::HasherCallBackImpl> impl;
 
 protected:
   HasherCallBack(::detail::HasherCallBackImpl* impl);
@@ -33,6 +37,12 @@ public:
 
   void operator() (uint64 justProcessed);
   void clear();
+
+  /**
+   * Is called once all the digests of a file are computed, in the order files
+   * are finished.
+   */
+  void finished(FileEntry entry);
 };
 
 // -------------------------------------------------------------------------- //
@@ -43,6 +53,30 @@ public:
   PrinterHasherCallBack(uint64 sumSize, arx::Printer* printer);
 };
 
+// -------------------------------------------------------------------------- //
+// SynchronizedHasherCallBack
+// -------------------------------------------------------------------------- //
+/**
+ * Serializes calls to the given callback, so that it can be used by several 
+ * hashing threads at once.
+ */
+class SynchronizedHasherCallBack: public HasherCallBack {
+public:
+  SynchronizedHasherCallBack(HasherCallBack callBack);
+};
+
+// -------------------------------------------------------------------------- //
+// OutputHasherCallBack
+// -------------------------------------------------------------------------- //
+/**
+ * Passes the progress on to the given callback and writes the records of the
+ * finished files using the given output task.
+ */
+class OutputHasherCallBack: public HasherCallBack {
+public:
+  OutputHasherCallBack(HasherCallBack progress, OutputTask outputTask, HashTask hashTask);
+};
+
 // -------------------------------------------------------------------------- //
 // Hasher
 // -------------------------------------------------------------------------- //
@@ -52,11 +86,64 @@ namespace detail {
 
 class Hasher {
 private:
-  boost::shared_ptr<::detail::HasherImpl> impl;
+  boost::shared_ptr< ::detail::HasherImpl> impl;
+
+protected:
+  Hasher(::detail::HasherImpl* impl);
+
 public:
   Hasher(HashTask task, bool isMultiThreaded, HasherCallBack callBack = HasherCallBack());
+
+  /**
+   * Creates a hasher that processes several files at once using the given 
+   * scheduler. Callback is then invoked from several threads, but never 
+   * concurrently.
+   */
+  Hasher(HashTask task, bool isMultiThreaded, Scheduler scheduler, HasherCallBack callBack = HasherCallBack());
+
   void hash(FileEntry entry);
+
+  /**
+   * Hashes all the given entries that are not marked as failed.
+   */
+  void hash(ArrayList<FileEntry> entries);
+
+  /**
+   * Hashes all the files of the table that are not marked as failed, taking
+   * HASHERWINDOWSIZE rows at a time.
+   */
+  void hash(FileTable table);
+
+  /**
+   * Sets the cache consulted before hashing a list of entries. Digests of the
+   * files found in the cache are taken from it, the rest are stored there once
+   * hashed.
+   */
+  void setCache(boost::optional<HashCache> cache);
+
+  /**
+   * If set, files of a table are read in the order they lie on disk rather 
+   * than in the table order, see getDiskOrder.
+   */
+  void setDiskOrdered(bool diskOrdered);
   static Digest hash(uint32 hashId, boost::filesystem::wpath filePath, HasherCallBack callBack);
 };
 
+// -------------------------------------------------------------------------- //
+// DeviceHasher
+// -------------------------------------------------------------------------- //
+/**
+ * DeviceHasher groups files by the disk they are stored on and reads every 
+ * disk in a thread of its own, each with its own reads in flight. Files of a
+ * single disk are read one after another, so that a disk doesn't have to seek
+ * between several files. The data read is hashed by the jobs of the given 
+ * scheduler, or of a single worker without one, never by the reading threads.
+ * Callback is invoked from several threads, but never concurrently.
+ */
+class DeviceHasher: public Hasher {
+public:
+  DeviceHasher(HashTask task, bool isMultiThreaded, HasherCallBack callBack = HasherCallBack());
+  DeviceHasher(HashTask task, bool isMultiThreaded, Scheduler scheduler, HasherCallBack callBack = HasherCallBack());
+};
+
 #endif
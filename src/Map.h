@@ -16,7 +16,6 @@ private:
 public:
   typedef typename container_type::key_type key_type;
   typedef typename container_type::mapped_type mapped_type;
-  typedef typename container_type::referent_type referent_type;
   typedef typename container_type::key_compare key_compare;
   typedef typename container_type::value_compare value_compare;
   typedef typename container_type::allocator_type allocator_type;
@@ -102,7 +101,7 @@ public:
     return this->impl->find(key);
   }
 
-  const_iterator find(const key_type& _Keyval) const {
+  const_iterator find(const key_type& key) const {
     return this->impl->find(key);
   }
 };
@@ -2,9 +2,9 @@
 #include "Options.h"
 
 #include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
 #include "arx/Converter.h"
 #include "arx/Streams.h"
-#include "Test.h"
 #include "Hash.h"
 #include "Output.h"
 
@@ -35,6 +35,15 @@ bool isOption(wstring cmdLine, wstring option) {
   return true;
 }
 
+uint32 parseJobCount(wstring arg, wstring value) {
+  try {
+    return lexical_cast<uint32>(value);
+  } catch (bad_lexical_cast &) {
+    reportParseError(arg, _T("number of jobs expected"));
+    return 0;
+  }
+}
+
 wstring extractArgument(ArrayList<wstring> cmdLine, unsigned int& i) {
   wstring::size_type pos = cmdLine[i].find_first_of(_T('='));
   if(pos != wstring::npos)
@@ -55,9 +64,20 @@ namespace detail {
     bool recursive;
     bool multiThreaded;
     bool checkMode;
+    bool quick;
     bool usingFileList;
     bool quiet;
     bool upperCase;
+    bool streaming;
+    uint32 jobCount;
+    bool memoryMapped;
+    bool diskOrdered;
+    bool perDevice;
+    wstring cacheFile;
+    bool usingXattrs;
+    bool rehashing;
+    bool pruning;
+    bool testing;
 
     string inputEncoding;
     string outputEncoding;
@@ -71,9 +91,19 @@ namespace detail {
       this->recursive = false;
       this->multiThreaded = false;
       this->checkMode = false;
+      this->quick = false;
       this->usingFileList = false;
       this->quiet = false;
       this->upperCase = false;
+      this->streaming = false;
+      this->jobCount = 1;
+      this->memoryMapped = false;
+      this->diskOrdered = false;
+      this->perDevice = false;
+      this->usingXattrs = false;
+      this->rehashing = false;
+      this->pruning = false;
+      this->testing = false;
       outputEncoding = inputEncoding = "utf-8";
     }
   };
@@ -102,15 +132,34 @@ void Options::parse(ArrayList<wstring> cmdLine) {
         exit(0);
       } else if(arg == _T("--check")) {
         this->impl->checkMode = true;
+      } else if(arg == _T("--quick")) {
+        this->impl->quick = true;
       } else if(arg == _T("--quiet")) {
         this->impl->quiet = true;
       } else if(arg == _T("--recursive")) {
         this->impl->recursive = true;
       } else if(arg == _T("--multithreaded")) {
         this->impl->multiThreaded = true;
+      } else if(isOption(arg, _T("--jobs"))) {
+        this->impl->jobCount = parseJobCount(arg, extractArgument(cmdLine, i));
+      } else if(arg == _T("--mmap")) {
+        this->impl->memoryMapped = true;
+      } else if(arg == _T("--disk-order")) {
+        this->impl->diskOrdered = true;
+      } else if(arg == _T("--per-device")) {
+        this->impl->perDevice = true;
+      } else if(isOption(arg, _T("--cache"))) {
+        this->impl->cacheFile = extractArgument(cmdLine, i);
+      } else if(arg == _T("--xattr")) {
+        this->impl->usingXattrs = true;
+      } else if(arg == _T("--rehash")) {
+        this->impl->rehashing = true;
+      } else if(arg == _T("--prune")) {
+        this->impl->pruning = true;
+      } else if(arg == _T("--stream")) {
+        this->impl->streaming = true;
       } else if(arg == _T("--test")) {
-        testHashSpeed();
-        exit(0);
+        this->impl->testing = true;
       } else if(arg == _T("--crc32")) {
         this->impl->hashTask.add(H_CRC);
       } else if(arg == _T("--md5")) {
@@ -167,9 +216,14 @@ void Options::parse(ArrayList<wstring> cmdLine) {
           this->impl->recursive = true;
         } else if(c == 'm') {
           this->impl->multiThreaded = true;
+        } else if(c == 'j') {
+          if(j + 1 < arg.size())
+            this->impl->jobCount = parseJobCount(arg, arg.substr(j + 1));
+          else
+            this->impl->jobCount = parseJobCount(arg, extractArgument(cmdLine, i));
+          break;
         } else if(c == 't') {
-          testHashSpeed();
-          exit(0);
+          this->impl->testing = true;
         } else if(c == 'C') {
           this->impl->hashTask.add(H_CRC);
         } else if(c == '4') {
@@ -192,6 +246,11 @@ void Options::parse(ArrayList<wstring> cmdLine) {
     } else 
       this->impl->fileMasks.add(arg);
   }
+
+  if(this->impl->usingXattrs && !this->impl->cacheFile.empty())
+    reportParseError(_T("--xattr"), _T("--xattr and --cache cannot be used together"));
+  if(this->impl->pruning && this->impl->cacheFile.empty())
+    reportParseError(_T("--prune"), _T("--prune requires --cache"));
   
   // If nothing is specified - output in .md5 format
   uint32 sum = 0;
@@ -227,10 +286,28 @@ void Options::printSynopsis() {
   wCout << "  -V, --version Print arxsum version and exit." << endl;
   wCout << "  -h, --help    Print this help screen." << endl;
   wCout << "  -c, --check   Check mode - treat all input files as checksum files." << endl;
+  wCout << "      --quick   Only check that files exist and have the right size, do not" << endl;
+  wCout << "                read them. Sizes are known for .ed2k and .torrent files." << endl;
+  wCout << "                Such files are reported as [size ok] or [exists], not [ok]." << endl;
   wCout << "  -q, --quiet   Do not output progress." << endl;
   wCout << "  -r, --recursive  Process directories recursively." << endl;
   wCout << "  -m, --multithreaded  Calculate each hash in a separate thread." << endl;
-  wCout << "  -t, --test    Do not hash anything, just test hash speed." << endl;
+  wCout << "  -j, --jobs N  Hash up to N files at once, 0 means one per CPU core." << endl;
+  wCout << "      --mmap    Read files through memory mapping, faster for cached files." << endl;
+  wCout << "                Files must not be truncated while being hashed." << endl;
+  wCout << "      --disk-order  Read files in the order they lie on disk, much faster on" << endl;
+  wCout << "                hard disks. Output order is not affected." << endl;
+  wCout << "      --per-device  Read files of different disks in parallel, each disk" << endl;
+  wCout << "                sequentially. With -j N the data read is hashed by N" << endl;
+  wCout << "                threads, whatever the number of disks." << endl;
+  wCout << "      --cache FILE  Keep digests in the given cache file, files that did not" << endl;
+  wCout << "                change since they were hashed are not read again." << endl;
+  wCout << "      --xattr   Keep digests in extended attributes of the files instead." << endl;
+  wCout << "      --rehash  Hash all the files anyway, updating the cache." << endl;
+  wCout << "      --prune   Drop the files that were not hashed or checked in this run" << endl;
+  wCout << "                from the cache file, deleted files are kept there otherwise." << endl;
+  wCout << "  -t, --test    Do not hash anything, just test hash speed. With -j also" << endl;
+  wCout << "                check that large files hashed at once get the right digests." << endl;
   wCout << endl;
   wCout << "Checksum options:" << endl;
   wCout << "  -C, --crc32   Calculate crc32 hash." << endl;
@@ -246,6 +323,9 @@ void Options::printSynopsis() {
   wCout << "Output options:" << endl;
   wCout << "  -u, --uppercase  Output hash in uppercase." << endl;
   wCout << "      --oenc ENCODING  Output using given character encoding." << endl;
+  wCout << "      --stream  Write each file as soon as it is hashed, in the order files" << endl;
+  wCout << "                are finished. File sizes and times are not written then." << endl;
+  wCout << "                In check mode with -j, report files as they are verified." << endl;
   wCout << "      --omd5 FILE  Output in .md5 format (adds --md5)." << endl;
   wCout << "      --osfv FILE  Output in .sfv format (adds --crc)." << endl;
   wCout << "      --oed2k FILE  Output in .ed2k format (adds --ed2k)." << endl;
@@ -272,10 +352,54 @@ bool Options::isMultiThreaded() {
   return this->impl->multiThreaded;
 }
 
+uint32 Options::getJobCount() {
+  return this->impl->jobCount;
+}
+
+bool Options::isMemoryMapped() {
+  return this->impl->memoryMapped;
+}
+
+bool Options::isDiskOrdered() {
+  return this->impl->diskOrdered;
+}
+
+bool Options::isPerDevice() {
+  return this->impl->perDevice;
+}
+
+wstring Options::getCacheFile() {
+  return this->impl->cacheFile;
+}
+
+bool Options::isUsingXattrs() {
+  return this->impl->usingXattrs;
+}
+
+bool Options::isRehashing() {
+  return this->impl->rehashing;
+}
+
+bool Options::isPruning() {
+  return this->impl->pruning;
+}
+
+bool Options::isStreaming() {
+  return this->impl->streaming;
+}
+
 bool Options::isInCheckMode() {
   return this->impl->checkMode;
 }
 
+bool Options::isQuick() {
+  return this->impl->quick;
+}
+
+bool Options::isTesting() {
+  return this->impl->testing;
+}
+
 bool Options::isUsingFileList() {
   return this->impl->usingFileList;
 }
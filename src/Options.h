@@ -30,10 +30,21 @@ public:
 
   bool isRecursive();
   bool isMultiThreaded();
+  uint32 getJobCount();
+  bool isMemoryMapped();
+  bool isDiskOrdered();
+  bool isPerDevice();
+  std::wstring getCacheFile();
+  bool isUsingXattrs();
+  bool isRehashing();
+  bool isPruning();
   bool isInCheckMode();
+  bool isQuick();
   bool isUsingFileList();
   bool isQuiet();
   bool isUpperCase();
+  bool isStreaming();
+  bool isTesting();
 
   const char* getInputEncoding();
   const char* getOutputEncoding();
@@ -34,13 +34,13 @@ namespace detail {
     *printer << commentStart << " (c) Alexander 'Elric' Fokin, [ArX] Team, 2007" << "\n";
   }
 
-  void writeTimesAndSizes(string commentStart, ArrayList<FileEntry> data, Printer* printer) {
+  void writeTimesAndSizes(string commentStart, FileTable data, Printer* printer) {
     FOREACH(FileEntry file, data) {
       if(!file.isFailed()) {
         ptime fileTime = from_time_t(file.getDateTime());
         *printer << commentStart << " " << setw(12) << file.getSize() << "  " << 
            to_simple_string(fileTime.time_of_day()) << " " << 
-           to_iso_extended_string(fileTime.date()) << " " << file.getPath() << "\n";
+           to_iso_extended_string(fileTime.date()) << " " << file.getPath().wstring() << "\n";
       }
     }
   }
@@ -48,28 +48,38 @@ namespace detail {
   class OutputFormatImpl {
   private:
   public:
-    virtual void output(HashTask task, ArrayList<FileEntry> data, Printer* printer) = 0;
+    virtual void output(HashTask task, FileTable data, Printer* printer) {
+      FOREACH(FileEntry file, data)
+        if(!file.isFailed())
+          outputEntry(task, file, printer);
+    }
+    virtual void begin(HashTask task, Printer* printer) {return;};
+    virtual void outputEntry(HashTask task, FileEntry file, Printer* printer) = 0;
     virtual string getName() = 0;
   };
 
   class MD5OutputFormat: public OutputFormatImpl {
   private:
   public:
-    void output(HashTask task, ArrayList<FileEntry> data, Printer* printer) {
-      writeHeader(";", printer);
-      *printer << ";" << "\n";
+    void output(HashTask task, FileTable data, Printer* printer) {
+      begin(task, printer);
       writeTimesAndSizes(";", data, printer);
       for(uint32 n = 0; n < H_COUNT; n++) {
         if(task.isSet(n) && n != H_MD5) {
           *printer << ";" << "\n" << "; * " << Hash::getName(n) << " Block *" << "\n";
           FOREACH(FileEntry file, data)
             if(!file.isFailed())
-              *printer << "; " << conditionalUpperCase(file.getDigest(n).toHexString()) << " *" << file.getPath() << "\n";
+              *printer << "; " << conditionalUpperCase(file.getDigest(n).toHexString()) << " *" << file.getPath().wstring() << "\n";
         }
       }
-      FOREACH(FileEntry file, data)
-        if(!file.isFailed())
-          *printer << conditionalUpperCase(file.getDigest(H_MD5).toHexString()) << " *" << file.getPath() << "\n";
+      OutputFormatImpl::output(task, data, printer);
+    }
+    void begin(HashTask task, Printer* printer) {
+      writeHeader(";", printer);
+      *printer << ";" << "\n";
+    }
+    void outputEntry(HashTask task, FileEntry file, Printer* printer) {
+      *printer << conditionalUpperCase(file.getDigest(H_MD5).toHexString()) << " *" << file.getPath().wstring() << "\n";
     }
     string getName() {
       return "MD5";
@@ -79,13 +89,17 @@ namespace detail {
   class SHA1OutputFormat: public OutputFormatImpl {
   private:
   public:
-    void output(HashTask task, ArrayList<FileEntry> data, Printer* printer) {
+    void output(HashTask task, FileTable data, Printer* printer) {
+      begin(task, printer);
+      writeTimesAndSizes(";", data, printer);
+      OutputFormatImpl::output(task, data, printer);
+    }
+    void begin(HashTask task, Printer* printer) {
       writeHeader(";", printer);
       *printer << ";" << "\n";
-      writeTimesAndSizes(";", data, printer);
-      FOREACH(FileEntry file, data)
-        if(!file.isFailed())
-          *printer << conditionalUpperCase(file.getDigest(H_SHA1).toHexString()) << " *" << file.getPath() << "\n";
+    }
+    void outputEntry(HashTask task, FileEntry file, Printer* printer) {
+      *printer << conditionalUpperCase(file.getDigest(H_SHA1).toHexString()) << " *" << file.getPath().wstring() << "\n";
     }
     string getName() {
       return "SHA1";
@@ -95,10 +109,9 @@ namespace detail {
   class BSDOutputFormat: public OutputFormatImpl {
   private:
   public:
-    void output(HashTask task, ArrayList<FileEntry> data, Printer* printer) {
-      FOREACH(FileEntry file, data) if(!file.isFailed())
-        for(uint32 n = 0; n < H_COUNT; n++) if(task.isSet(n))
-          *printer << Hash::getName(n) << " (" << file.getPath() << ") = " << conditionalUpperCase(file.getDigest(n).toHexString()) << "\n";
+    void outputEntry(HashTask task, FileEntry file, Printer* printer) {
+      for(uint32 n = 0; n < H_COUNT; n++) if(task.isSet(n))
+        *printer << Hash::getName(n) << " (" << file.getPath().wstring() << ") = " << conditionalUpperCase(file.getDigest(n).toHexString()) << "\n";
     }
     string getName() {
       return "BSD";
@@ -108,13 +121,17 @@ namespace detail {
   class SFVOutputFormat: public OutputFormatImpl {
   private:
   public:
-    void output(HashTask task, ArrayList<FileEntry> data, Printer* printer) {
+    void output(HashTask task, FileTable data, Printer* printer) {
+      begin(task, printer);
+      writeTimesAndSizes(";", data, printer);
+      OutputFormatImpl::output(task, data, printer);
+    }
+    void begin(HashTask task, Printer* printer) {
       writeHeader(";", printer);
       *printer << ";" << "\n";
-      writeTimesAndSizes(";", data, printer);
-      FOREACH(FileEntry file, data)
-        if(!file.isFailed())
-          *printer << file.getPath() << " " << conditionalUpperCase(file.getDigest(H_CRC).toHexString()) << "\n";
+    }
+    void outputEntry(HashTask task, FileEntry file, Printer* printer) {
+      *printer << file.getPath().wstring() << " " << conditionalUpperCase(file.getDigest(H_CRC).toHexString()) << "\n";
     }
     string getName() {
       return "SFV";
@@ -124,12 +141,10 @@ namespace detail {
   class ED2KOutputFormat: public OutputFormatImpl {
   private:
   public:
-    void output(HashTask task, ArrayList<FileEntry> data, Printer* printer) {
+    void outputEntry(HashTask task, FileEntry file, Printer* printer) {
       //ed2k://|file|Amaenaide yo!! Katsu!! - 01 =Mendoi=.avi|244576256|bd4bffffc7664e11e85485383c984507|/
-      FOREACH(FileEntry file, data)
-        if(!file.isFailed())
-          *printer << "ed2k://|file|" << file.getPath().leaf() << "|" << 
-            file.getSize() << "|" << conditionalUpperCase(file.getDigest(H_ED2K).toHexString()) << "|/" << "\n";
+      *printer << "ed2k://|file|" << file.getPath().filename().wstring() << "|" << 
+        file.getSize() << "|" << conditionalUpperCase(file.getDigest(H_ED2K).toHexString()) << "|/" << "\n";
     }
     string getName() {
       return "ED2K";
@@ -159,10 +174,18 @@ OutputFormat::OutputFormat(uint32 ofId) {
   }
 }
 
-void OutputFormat::output(HashTask task, ArrayList<FileEntry> data, Printer* printer) {
+void OutputFormat::output(HashTask task, FileTable data, Printer* printer) {
   impl->output(task, data, printer);
 }
 
+void OutputFormat::begin(HashTask task, Printer* printer) {
+  impl->begin(task, printer);
+}
+
+void OutputFormat::output(HashTask task, FileEntry file, Printer* printer) {
+  impl->outputEntry(task, file, printer);
+}
+
 string OutputFormat::getName() {
   return impl->getName();
 }
@@ -27,11 +27,23 @@ namespace detail {
 
 class OutputFormat {
 private:
-  boost::shared_ptr<::detail::OutputFormatImpl> impl;
+  boost::shared_ptr< ::detail::OutputFormatImpl> impl;
   uint32 ofId;
 public:
   OutputFormat(uint32 ofId);
-  void output(HashTask task, ArrayList<FileEntry> data, arx::Printer* printer);
+  void output(HashTask task, FileTable data, arx::Printer* printer);
+
+  /**
+   * Writes the part of the output that precedes the records. Together with
+   * output(task, file, printer) it's used to write records one by one, blocks
+   * that need the whole file list are left out then.
+   */
+  void begin(HashTask task, arx::Printer* printer);
+
+  /**
+   * Writes the record of a single file.
+   */
+  void output(HashTask task, FileEntry file, arx::Printer* printer);
   std::string getName();
   uint32 getId();
   static std::string getName(uint32 ofId);
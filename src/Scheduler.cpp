@@ -0,0 +1,242 @@
+#include "config.h"
+#include "Scheduler.h"
+#include "ArrayList.h"
+#include <deque>
+#include <string>
+#include <stdexcept>
+#include <boost/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/tss.hpp>
+#include <boost/bind.hpp>
+#include <boost/noncopyable.hpp>
+
+using namespace std;
+using namespace boost;
+
+// -------------------------------------------------------------------------- //
+// SchedulerImpl
+// -------------------------------------------------------------------------- //
+namespace detail {
+  class SchedulerImpl: private noncopyable {
+  private:
+    struct Worker {
+      mutex queueMutex;
+      deque<function<void ()> > queue;
+    };
+
+    ArrayList<boost::shared_ptr<Worker> > workers;
+    thread_group threadGroup;
+    thread_specific_ptr<uint32> currentWorker;
+
+    mutex idleMutex;
+    condition_variable jobSubmitted;
+    uint32 queuedJobs;
+    uint32 nextQueue;
+    bool terminating;
+
+    bool popJob(uint32 workerIndex, bool fromBack, function<void ()>& job) {
+      Worker& worker = *this->workers[workerIndex];
+      mutex::scoped_lock lock(worker.queueMutex);
+      if(worker.queue.empty())
+        return false;
+      if(fromBack) {
+        job = worker.queue.back();
+        worker.queue.pop_back();
+      } else {
+        job = worker.queue.front();
+        worker.queue.pop_front();
+      }
+      return true;
+    }
+
+    void workerLoop(uint32 workerIndex) {
+      this->currentWorker.reset(new uint32(workerIndex));
+      while(true) {
+        if(runJob())
+          continue;
+        mutex::scoped_lock lock(this->idleMutex);
+        while(this->queuedJobs == 0 && !this->terminating)
+          this->jobSubmitted.wait(lock);
+        if(this->queuedJobs == 0 && this->terminating)
+          return;
+      }
+    }
+
+  public:
+    SchedulerImpl(uint32 workerCount): queuedJobs(0), nextQueue(0), terminating(false) {
+      if(workerCount == 0)
+        workerCount = max(thread::hardware_concurrency(), 1u);
+      for(uint32 i = 0; i < workerCount; i++)
+        this->workers.add(boost::shared_ptr<Worker>(new Worker()));
+      for(uint32 i = 0; i < workerCount; i++)
+        this->threadGroup.create_thread(boost::bind(&SchedulerImpl::workerLoop, this, i));
+    }
+
+    ~SchedulerImpl() {
+      {
+        mutex::scoped_lock lock(this->idleMutex);
+        this->terminating = true;
+        this->jobSubmitted.notify_all();
+      }
+      this->threadGroup.join_all();
+    }
+
+    uint32 getWorkerCount() const {
+      return (uint32) this->workers.size();
+    }
+
+    uint32 getCurrentWorker() const {
+      uint32* index = this->currentWorker.get();
+      return (index == NULL) ? getWorkerCount() : *index;
+    }
+
+    void submit(function<void ()> job) {
+      uint32 workerIndex = getCurrentWorker();
+      {
+        mutex::scoped_lock lock(this->idleMutex);
+        if(workerIndex == getWorkerCount())
+          workerIndex = this->nextQueue++ % getWorkerCount();
+      }
+      {
+        Worker& worker = *this->workers[workerIndex];
+        mutex::scoped_lock lock(worker.queueMutex);
+        worker.queue.push_back(job);
+      }
+      mutex::scoped_lock lock(this->idleMutex);
+      this->queuedJobs++;
+      this->jobSubmitted.notify_one();
+    }
+
+    /**
+     * Executes one job, taking it from the back of the calling worker's own queue
+     * or stealing it from the front of another worker's queue.
+     * @returns true if a job was executed, false if all queues were empty.
+     */
+    bool runJob() {
+      uint32 self = getCurrentWorker();
+      uint32 n = getWorkerCount();
+      function<void ()> job;
+      bool found = (self < n) && popJob(self, true, job);
+      for(uint32 i = 1; i <= n && !found; i++)
+        found = popJob((self + i) % n, false, job);
+      if(!found)
+        return false;
+      {
+        mutex::scoped_lock lock(this->idleMutex);
+        this->queuedJobs--;
+      }
+      job();
+      return true;
+    }
+  };
+
+// -------------------------------------------------------------------------- //
+// JobGroupImpl
+// -------------------------------------------------------------------------- //
+  class JobGroupImpl: private noncopyable {
+  private:
+    boost::shared_ptr<SchedulerImpl> scheduler;
+    mutex groupMutex;
+    condition_variable jobFinished;
+    uint32 runningJobs;
+    bool failed;
+    string errorMessage;
+
+    void execute(function<void ()> job) {
+      try {
+        job();
+      } catch (std::exception& e) {
+        setError(e.what());
+      } catch (...) {
+        setError("unknown error in a scheduled job");
+      }
+      mutex::scoped_lock lock(this->groupMutex);
+      this->runningJobs--;
+      this->jobFinished.notify_all();
+    }
+
+    void setError(const string& message) {
+      mutex::scoped_lock lock(this->groupMutex);
+      if(!this->failed) {
+        this->failed = true;
+        this->errorMessage = message;
+      }
+    }
+
+    bool hasAtMost(uint32 maxRunningJobs) {
+      mutex::scoped_lock lock(this->groupMutex);
+      return this->runningJobs <= maxRunningJobs;
+    }
+
+  public:
+    JobGroupImpl(boost::shared_ptr<SchedulerImpl> scheduler): scheduler(scheduler), runningJobs(0), failed(false) {
+      return;
+    }
+
+    ~JobGroupImpl() {
+      waitAll(0);
+    }
+
+    void run(function<void ()> job) {
+      {
+        mutex::scoped_lock lock(this->groupMutex);
+        this->runningJobs++;
+      }
+      this->scheduler->submit(boost::bind(&JobGroupImpl::execute, this, job));
+    }
+
+    void waitAll(uint32 maxRunningJobs) {
+      while(!hasAtMost(maxRunningJobs)) {
+        if(this->scheduler->runJob())
+          continue;
+        mutex::scoped_lock lock(this->groupMutex);
+        while(this->runningJobs > maxRunningJobs)
+          this->jobFinished.wait(lock);
+      }
+    }
+
+    void wait(uint32 maxRunningJobs) {
+      waitAll(maxRunningJobs);
+      mutex::scoped_lock lock(this->groupMutex);
+      if(this->failed) {
+        this->failed = false;
+        throw runtime_error(this->errorMessage);
+      }
+    }
+  };
+}
+
+// -------------------------------------------------------------------------- //
+// Scheduler
+// -------------------------------------------------------------------------- //
+Scheduler::Scheduler(uint32 workerCount): impl(new ::detail::SchedulerImpl(workerCount)) {
+  return;
+}
+
+uint32 Scheduler::getWorkerCount() const {
+  return this->impl->getWorkerCount();
+}
+
+uint32 Scheduler::getCurrentWorker() const {
+  return this->impl->getCurrentWorker();
+}
+
+// -------------------------------------------------------------------------- //
+// JobGroup
+// -------------------------------------------------------------------------- //
+JobGroup::JobGroup(Scheduler scheduler): impl(new ::detail::JobGroupImpl(scheduler.impl)) {
+  return;
+}
+
+void JobGroup::run(boost::function<void ()> job) {
+  this->impl->run(job);
+}
+
+void JobGroup::wait() {
+  this->impl->wait(0);
+}
+
+void JobGroup::wait(uint32 maxRunningJobs) {
+  this->impl->wait(maxRunningJobs);
+}
@@ -0,0 +1,72 @@
+#ifndef __SCHEDULER_H__
+#define __SCHEDULER_H__
+
+#include "config.h"
+#include <boost/shared_ptr.hpp>
+#include <boost/function.hpp>
+
+// -------------------------------------------------------------------------- //
+// Scheduler
+// -------------------------------------------------------------------------- //
+namespace detail {
+  class SchedulerImpl;
+  class JobGroupImpl;
+}
+
+/**
+ * Scheduler is a pool of worker threads with work stealing. Every worker has its
+ * own job queue, jobs submitted from a worker go to its own queue, and idle
+ * workers steal from the other ones.
+ */
+class Scheduler {
+private:
+  boost::shared_ptr< ::detail::SchedulerImpl> impl;
+  friend class JobGroup;
+
+public:
+  /**
+   * Creates a new scheduler.
+   * @param workerCount number of worker threads, 0 means one per hardware thread.
+   */
+  explicit Scheduler(uint32 workerCount = 0);
+
+  uint32 getWorkerCount() const;
+
+  /**
+   * @returns index of the calling worker thread, or getWorkerCount() if it is
+   *   called from a thread that doesn't belong to this scheduler.
+   */
+  uint32 getCurrentWorker() const;
+};
+
+// -------------------------------------------------------------------------- //
+// JobGroup
+// -------------------------------------------------------------------------- //
+/**
+ * JobGroup is a set of jobs that can be waited for. The waiting thread doesn't
+ * sleep while there are jobs in the queues - it executes them, so it's safe to
+ * wait for a group from inside another job.
+ */
+class JobGroup {
+private:
+  boost::shared_ptr< ::detail::JobGroupImpl> impl;
+
+public:
+  JobGroup(Scheduler scheduler);
+
+  void run(boost::function<void ()> job);
+
+  /**
+   * Waits for all the jobs of this group to finish. If any of the jobs has
+   * thrown, an exception is rethrown here.
+   */
+  void wait();
+
+  /**
+   * Waits until no more than maxRunningJobs jobs of this group are unfinished.
+   * Can be used to limit the amount of work queued by a producer.
+   */
+  void wait(uint32 maxRunningJobs);
+};
+
+#endif
@@ -1,17 +1,17 @@
 #include "Streams.h"
 
 arx::InputStream createInputStream(boost::filesystem::path path, bool unbuffered) {
-  if(path.native() == _T("-"))
+  if(path.wstring() == _T("-"))
     return arx::ConsoleInputStream();
   else
-    return arx::FileInputStream(path.native(), (unbuffered) ? (arx::OM_UNBUFFERED | arx::OM_SEQUENTIAL_SCAN) : (arx::OM_NONE));
+    return arx::FileInputStream(path.wstring(), (unbuffered) ? (arx::OM_UNBUFFERED | arx::OM_SEQUENTIAL_SCAN) : (arx::OM_NONE));
 }
 
 arx::OutputStream createOutputStream(boost::filesystem::path path, bool unbuffered) {
-  if(path.native() == _T("-"))
+  if(path.wstring() == _T("-"))
     return arx::ConsoleOutputStream();
   else
-    return arx::FileOutputStream(path.native(), (unbuffered) ? (arx::OM_UNBUFFERED | arx::OM_SEQUENTIAL_SCAN) : (arx::OM_NONE));
+    return arx::FileOutputStream(path.wstring(), (unbuffered) ? (arx::OM_UNBUFFERED | arx::OM_SEQUENTIAL_SCAN) : (arx::OM_NONE));
 }
 
 
@@ -30,3 +30,8 @@ arx::Reader createReader(boost::filesystem::path path, const char* encoding, boo
 arx::Writer createWriter(boost::filesystem::path path, const char* encoding, bool unbuffered) {
   return arx::OutputStreamWriter(createOutputStream(path, unbuffered), encoding);
 }
+
+unsigned char* allocateAligned(boost::scoped_array<unsigned char>& storage, size_t size) {
+  storage.reset(new unsigned char[size + ARX_UNBUFFERED_IO_ALIGN]);
+  return (unsigned char*) (((size_t) storage.get() + ARX_UNBUFFERED_IO_ALIGN - 1) & ~((size_t) ARX_UNBUFFERED_IO_ALIGN - 1));
+}
@@ -4,6 +4,7 @@
 #include "config.h"
 #include <string>
 #include <boost/filesystem.hpp>
+#include <boost/scoped_array.hpp>
 #include "arx/Streams.h"
 
 arx::Reader createReader(boost::filesystem::wpath path, bool unbuffered = false);
@@ -13,4 +14,9 @@ arx::Writer createWriter(boost::filesystem::wpath path, const char* encoding, bo
 arx::InputStream createInputStream(boost::filesystem::wpath path, bool unbuffered = false);
 arx::OutputStream createOutputStream(boost::filesystem::wpath path, bool unbuffered = false);
 
+/**
+ * Allocates a buffer that is suitably aligned for unbuffered reads.
+ */
+unsigned char* allocateAligned(boost::scoped_array<unsigned char>& storage, size_t size);
+
 #endif
\ No newline at end of file
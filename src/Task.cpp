@@ -59,6 +59,7 @@ class OutputTask::OutputTaskImpl {
 public:
   array<bool, O_COUNT> task;
   array<wstring, O_COUNT> fileNames;
+  array<boost::shared_ptr<Printer>, O_COUNT> printers;
 };
 
 OutputTask::OutputTask(): impl(new OutputTaskImpl()) {
@@ -87,21 +88,11 @@ void OutputTask::add(uint32 id, std::wstring fileName) {
   impl->fileNames[id] = fileName;
 }
 
-void OutputTask::perform(HashTask task, ArrayList<FileEntry> data) {
-  if(data.empty())
-    return;
-  bool needsName = false;
-  wstring starFileName;
-  for(uint32 i = 0; i < size(); i++) {
-    if(getFileName(i) == _T("*")) {
-      needsName = true;
-      break;
-    }
-  }
-  if(needsName) {
+namespace {
+  wstring getStarFileName(FileTable data) {
     wstring lastLeaf = data[0].getPath().filename().wstring();
     size_t nameLen = lastLeaf.size();
-    for(size_t i = 1; i < data.size(); i++) {
+    for(uint32 i = 1; i < data.size(); i++) {
       wstring leaf = data[i].getPath().filename().wstring();
       nameLen = min(nameLen, leaf.size());
       size_t newNameLen;
@@ -110,18 +101,28 @@ void OutputTask::perform(HashTask task, ArrayList<FileEntry> data) {
           break;
       nameLen = min(nameLen, newNameLen);
     }
-    starFileName = trim_copy(lastLeaf.substr(0, nameLen));
+    wstring starFileName = trim_copy(lastLeaf.substr(0, nameLen));
     if(starFileName.empty())
       starFileName = _T("sum");
+    return starFileName;
   }
+
+  Writer createOutputWriter(OutputTask outputTask, uint32 id, FileTable data) {
+    if(outputTask.getFileName(id) == _T("*"))
+      return createWriter(getStarFileName(data) + _T(".") + toWideString(to_lower_copy(OutputFormat::getName(id))), options.getOutputEncoding());
+    else 
+      return createWriter(outputTask.getFileName(id), options.getOutputEncoding());
+  }
+}
+
+void OutputTask::perform(HashTask task, FileTable data) {
+  if(data.empty())
+    return;
   for(uint32 i = 0; i < size(); i++)
     if(isSet(i)) {
       Writer writer;
       try {
-        if(getFileName(i) == _T("*"))
-          writer = createWriter(starFileName + _T(".") + toWideString(to_lower_copy(OutputFormat::getName(i))), options.getOutputEncoding());
-        else 
-          writer = createWriter(getFileName(i), options.getOutputEncoding());
+        writer = createOutputWriter(*this, i, data);
       } catch (...) {
         continue;
       }
@@ -130,6 +131,36 @@ void OutputTask::perform(HashTask task, ArrayList<FileEntry> data) {
     }
 }
 
+void OutputTask::begin(HashTask task, FileTable data) {
+  if(data.empty())
+    return;
+  for(uint32 i = 0; i < size(); i++)
+    if(isSet(i)) {
+      try {
+        impl->printers[i].reset(new Printer(createOutputWriter(*this, i, data)));
+      } catch (...) {
+        continue;
+      }
+      OutputFormat(i).begin(task, impl->printers[i].get());
+      impl->printers[i]->flush();
+    }
+}
+
+void OutputTask::write(HashTask task, FileEntry entry) {
+  if(entry.isFailed())
+    return;
+  for(uint32 i = 0; i < size(); i++)
+    if(impl->printers[i]) {
+      OutputFormat(i).output(task, entry, impl->printers[i].get());
+      impl->printers[i]->flush();
+    }
+}
+
+void OutputTask::end() {
+  FOREACH(boost::shared_ptr<Printer>& printer, impl->printers)
+    printer.reset();
+}
+
 // -------------------------------------------------------------------------- //
 // CheckTask
 // -------------------------------------------------------------------------- //
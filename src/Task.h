@@ -33,7 +33,16 @@ public:
   size_t size();
   std::wstring getFileName(uint32 id);
   void add(uint32 id, std::wstring fileName);
-  void perform(HashTask task, ArrayList<FileEntry> data);
+  void perform(HashTask task, FileTable data);
+
+  /**
+   * Opens the output files and writes everything that precedes the records.
+   * Records are then written by write() one file at a time, as soon as each
+   * file is hashed, and the files are closed by end().
+   */
+  void begin(HashTask task, FileTable data);
+  void write(HashTask task, FileEntry entry);
+  void end();
 };
 
 class CheckTask {
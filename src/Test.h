@@ -5,4 +5,12 @@
 
 void testHashSpeed();
 
+/**
+ * Hashes large files with the given number of jobs, with and without -m, and
+ * checks that the tth and ed2k digests match the ones computed in a single 
+ * thread. Test files are created in the temporary directory.
+ * @returns true if all the digests match.
+ */
+bool testParallelHashing(uint32 jobCount);
+
 #endif
\ No newline at end of file
@@ -1,164 +1,594 @@
 #include "config.h"
 #include "Torrent.h"
 #include <string>
+#include <vector>
+#include <cstring>
 #include <boost/shared_array.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/foreach.hpp>
 #include <boost/filesystem.hpp>
-#include "libtorrent/include/bencode.hpp"
+#include <boost/bind.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/noncopyable.hpp>
 #include "arx/Exception.h"
 #include "arx/Streams.h"
 #include "arx/Converter.h"
+#include "Bencode.h"
 #include "Hash.h"
+#include "Options.h"
+
+#ifdef ARX_LINUX
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
 
 using namespace std;
 using namespace boost;
 using namespace boost::filesystem;
 using namespace arx;
-using namespace libtorrent;
 
-class MemBuffer {
+// -------------------------------------------------------------------------- //
+// TorrentFileData
+// -------------------------------------------------------------------------- //
+/**
+ * Contents of a .torrent file. On linux the file is mapped into memory, 
+ * elsewhere it is read whole, up to MAX_TORRENT_FILE_SIZE bytes.
+ */
+class TorrentFileData: private noncopyable {
 private:
-  static const unsigned int align = 1024; // TODO: that's a hack, damn!
-  unsigned int pos;
-  unsigned int size;
-  unsigned int maxSize;
-  unsigned char *buf, *realBuf;
-
-  MemBuffer& operator= (const MemBuffer& that);
-  MemBuffer(const MemBuffer& that);
+  const char* data;
+  size_t size;
+#ifdef ARX_LINUX
+  void* mapping;
+#else
+  scoped_array<char> buf;
+#endif
 
 public:
-  MemBuffer(unsigned int size) {
-    this->pos = 0;
-    this->size = 0;
-    this->maxSize = size;
-    this->realBuf = new unsigned char[this->maxSize + this->align];
-    this->buf = (unsigned char*) (((intptr_t) this->realBuf + this->align - 1) & (-this->align));
+  TorrentFileData(wpath fileName): data(NULL), size(0) {
+#ifdef ARX_LINUX
+    this->mapping = MAP_FAILED;
+    int fd = open(fileName.string().c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+      throw runtime_error("Could not open torrent file");
+    struct stat st;
+    if(fstat(fd, &st) == 0 && st.st_size > 0)
+      this->mapping = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(this->mapping == MAP_FAILED)
+      throw runtime_error("Could not map torrent file");
+    this->data = (const char*) this->mapping;
+    this->size = (size_t) st.st_size;
+#else
+    uint64 fileSize = file_size(fileName);
+    if(fileSize > MAX_TORRENT_FILE_SIZE)
+      throw runtime_error("Torrent file too big");
+    this->buf.reset(new char[(size_t) fileSize]);
+    FileInputStream stream(fileName.wstring(), OM_SEQUENTIAL_SCAN);
+    while(this->size < fileSize) {
+      int read = stream.read((unsigned char*) this->buf.get() + this->size, (unsigned int) (fileSize - this->size));
+      if(read == EOF)
+        throw runtime_error("Torrent file truncated");
+      this->size += read;
+    }
+    this->data = this->buf.get();
+#endif
   }
 
-  ~MemBuffer() {
-    delete[] this->realBuf;
+  ~TorrentFileData() {
+#ifdef ARX_LINUX
+    munmap(this->mapping, this->size);
+#endif
   }
 
-  int updateFromStream(InputStream stream) {
-    unsigned int read = stream.read(this->buf + this->size, this->maxSize - this->size);
-    if(read == EOF)
-      return EOF;
-    this->size = read;
-    return read;
+  const char* getData() const {
+    return this->data;
   }
 
-  int fillFromStream(InputStream stream) {
-    unsigned int oldSize = this->size;
-    unsigned int read;
-    while(true) {
-      read = stream.read(this->buf + this->size, this->maxSize - this->size);
-      if(read == EOF || this->size == this->maxSize)
-        break;
-      this->size += read;
-    }
-    return (read == EOF) ? EOF : (this->size - oldSize);
+  size_t getSize() const {
+    return this->size;
   }
+};
 
-  const unsigned char* getBuf() const {
-    return this->buf;
+/**
+ * @returns length of a file of a torrent, given its dictionary.
+ */
+uint64 getLength(BencodeValue file) {
+  int64 length = file["length"].getInteger();
+  if(length < 0)
+    throw runtime_error("Negative file length");
+  return (uint64) length;
+}
+
+/** @returns number of pieces of the given length the given number of bytes take. */
+uint64 getPieceCount(uint64 size, uint32 pieceLength) {
+  return size / pieceLength + (size % pieceLength != 0 ? 1 : 0);
+}
+
+/**
+ * Checks that a torrent lists a digest for every piece of its files. The file
+ * sizes are only trusted after that, the digests take room in the torrent 
+ * file itself while the sizes do not.
+ */
+void checkPieceCount(uint32 pieceLength, ArrayList<uint64> fileSizes, bool isV2, BencodeValue pieces, ArrayList<BencodeValue> pieceRoots, BencodeValue pieceLayers) {
+  uint64 pieceCount = 0;
+  if(isV2) {
+    for(uint32 i = 0; i < fileSizes.size(); i++) {
+      uint64 filePieceCount = getPieceCount(fileSizes[i], pieceLength);
+      if(filePieceCount > 1 && pieceLayers[pieceRoots[i].getString()].getStringSize() != filePieceCount * 32)
+        throw runtime_error("Wrong piece layer size");
+      pieceCount += filePieceCount;
+    }
+  } else {
+    uint64 totalSize = 0;
+    for(uint32 i = 0; i < fileSizes.size(); i++) {
+      if(fileSizes[i] > (uint64) -1 - totalSize)
+        throw runtime_error("Torrent too large");
+      totalSize += fileSizes[i];
+    }
+    pieceCount = getPieceCount(totalSize, pieceLength);
+    if(pieces.getStringSize() != pieceCount * 20)
+      throw runtime_error("Wrong number of pieces");
   }
+  if(pieceCount > 0xFFFFFFFF)
+    throw runtime_error("Too many pieces");
+}
+
+ArrayList<CheckError> errorList(CheckError error) {
+  ArrayList<CheckError> result;
+  result.push_back(error);
+  return result;
+}
 
-  const unsigned char* getBufEnd() const {
-    return this->buf + this->size;
+// -------------------------------------------------------------------------- //
+// TorrentLayout
+// -------------------------------------------------------------------------- //
+/**
+ * Part of a file that a piece is made of.
+ */
+struct FileExtent {
+  uint32 fileIndex;
+  uint64 offset;
+  uint32 length;
+};
+
+/**
+ * TorrentLayout maps the pieces of a torrent to the file extents they are made
+ * of. Extents of piece i are extents[pieceExtents[i]] up to 
+ * extents[pieceExtents[i + 1]]. File i is covered by pieces fileFirstPieces[i]
+ * up to fileEndPieces[i], empty files are covered by none. In v2 torrents 
+ * pieces are aligned to files, so that each piece is a part of a single file.
+ */
+class TorrentLayout {
+public:
+  uint32 pieceLength;
+  uint32 pieceCount;
+  std::vector<FileExtent> extents;
+  std::vector<uint32> pieceExtents;
+  std::vector<uint32> fileFirstPieces;
+  std::vector<uint32> fileEndPieces;
+
+  TorrentLayout(uint32 pieceLength, ArrayList<uint64> fileSizes, bool isAlignedToFiles): pieceLength(pieceLength) {
+    if(isAlignedToFiles) {
+      this->pieceCount = 0;
+      for(uint32 i = 0; i < fileSizes.size(); i++) {
+        this->fileFirstPieces.push_back(this->pieceCount);
+        for(uint64 offset = 0; offset < fileSizes[i]; offset += pieceLength) {
+          this->pieceExtents.push_back(this->extents.size());
+          FileExtent extent;
+          extent.fileIndex = i;
+          extent.offset = offset;
+          extent.length = (uint32) min<uint64>(pieceLength, fileSizes[i] - offset);
+          this->extents.push_back(extent);
+          this->pieceCount++;
+        }
+        this->fileEndPieces.push_back(this->pieceCount);
+      }
+      this->pieceExtents.push_back(this->extents.size());
+      return;
+    }
+
+    uint64 totalSize = 0;
+    for(uint32 i = 0; i < fileSizes.size(); i++) {
+      this->fileFirstPieces.push_back((uint32) (totalSize / pieceLength));
+      totalSize += fileSizes[i];
+      this->fileEndPieces.push_back(fileSizes[i] == 0 ? this->fileFirstPieces.back() : (uint32) ((totalSize + pieceLength - 1) / pieceLength));
+    }
+    this->pieceCount = (uint32) ((totalSize + pieceLength - 1) / pieceLength);
+
+    uint32 fileIndex = 0;
+    uint64 fileOffset = 0;
+    for(uint32 piece = 0; piece < this->pieceCount; piece++) {
+      this->pieceExtents.push_back(this->extents.size());
+      uint64 left = min<uint64>(pieceLength, totalSize - (uint64) piece * pieceLength);
+      while(left > 0) {
+        while(fileOffset == fileSizes[fileIndex]) {
+          fileIndex++;
+          fileOffset = 0;
+        }
+        FileExtent extent;
+        extent.fileIndex = fileIndex;
+        extent.offset = fileOffset;
+        extent.length = (uint32) min(left, fileSizes[fileIndex] - fileOffset);
+        this->extents.push_back(extent);
+        fileOffset += extent.length;
+        left -= extent.length;
+      }
+    }
+    this->pieceExtents.push_back(this->extents.size());
   }
+};
 
-  unsigned int getPos() const {
-    return this->pos;
+// -------------------------------------------------------------------------- //
+// Merkle trees
+// -------------------------------------------------------------------------- //
+/** Size of the blocks hashed at the leaves of the merkle trees of v2 torrents. */
+const uint32 V2_BLOCK_SIZE = 16 * 1024;
+
+/** Largest piece length accepted, pieces are read into memory whole. */
+const int64 MAX_PIECE_LENGTH = 0x80000000LL;
+
+/** @returns smallest power of 2 not less than the given value, which must not exceed 2^63. */
+uint64 roundUpToPowerOf2(uint64 value) {
+  uint64 result = 1;
+  while(result < value)
+    result *= 2;
+  return result;
+}
+
+/** @returns digest of leaves past the end of a file. */
+Digest getZeroDigest() {
+  static const unsigned char zeros[32] = {0};
+  return Digest(zeros, 32);
+}
+
+/** @returns node of a v2 merkle tree, given its children. */
+Digest hashNodes(const Digest& left, const Digest& right) {
+  unsigned char buf[64];
+  memcpy(buf, left.get(), 32);
+  memcpy(buf + 32, right.get(), 32);
+  return calculateHash(buf, 64, H_SHA256);
+}
+
+/**
+ * @returns root of a merkle tree, given the nodes of one of its layers. The 
+ *   layer is padded with the given node up to nodeCount nodes, which must be
+ *   a power of 2.
+ */
+Digest getMerkleRoot(ArrayList<Digest> nodes, uint64 nodeCount, Digest padding) {
+  std::vector<Digest> layer(nodes.begin(), nodes.end());
+  for(; nodeCount > 1; nodeCount /= 2) {
+    std::vector<Digest> nextLayer;
+    for(uint32 i = 0; i < layer.size(); i += 2)
+      nextLayer.push_back(hashNodes(layer[i], i + 1 < layer.size() ? layer[i + 1] : padding));
+    layer.swap(nextLayer);
+    padding = hashNodes(padding, padding);
   }
+  return layer.empty() ? padding : layer[0];
+}
 
-  void setPos(unsigned int pos) {
-    this->pos = pos;
+/**
+ * Adds the files of a v2 file tree to the lists, in the order they are listed
+ * in, which is the order of their paths.
+ */
+void addFileTree(BencodeValue tree, const wstring& dir, ArrayList<wstring> files, ArrayList<uint64> fileSizes, ArrayList<BencodeValue> pieceRoots) {
+  for(BencodeValue name = tree.getFirst(); !name.isNone(); name = name.getNext().getNext()) {
+    BencodeValue node = name.getNext();
+    wstring path = dir + toWideString(name.getString(), "utf-8");
+    BencodeValue file = node.find("");
+    if(file.isNone()) {
+      addFileTree(node, path + _T("/"), files, fileSizes, pieceRoots);
+    } else {
+      files.push_back(path);
+      fileSizes.push_back(getLength(file));
+      pieceRoots.push_back(file.find("pieces root"));
+    }
   }
+}
 
-  void advancePos(unsigned int dpos) {
-    this->pos += dpos;
+/**
+ * @returns expected merkle roots of the pieces of a v2 torrent. Files that fit
+ *   in a single piece are verified against their pieces root. For larger files
+ *   the piece layer is checked against the pieces root first.
+ */
+std::vector<const char*> getV2PieceDigests(const TorrentLayout& layout, ArrayList<BencodeValue> pieceRoots, BencodeValue pieceLayers) {
+  std::vector<const char*> result;
+  Digest zeroPieceRoot = getMerkleRoot(ArrayList<Digest>(), layout.pieceLength / V2_BLOCK_SIZE, getZeroDigest());
+  for(uint32 i = 0; i < pieceRoots.size(); i++) {
+    uint32 pieceCount = layout.fileEndPieces[i] - layout.fileFirstPieces[i];
+    if(pieceCount == 0)
+      continue;
+    if(pieceRoots[i].isNone() || pieceRoots[i].getStringSize() != 32)
+      throw runtime_error("Wrong pieces root");
+    if(pieceCount == 1) {
+      result.push_back(pieceRoots[i].getStringData());
+      continue;
+    }
+
+    BencodeValue layer = pieceLayers[pieceRoots[i].getString()];
+    if(layer.getStringSize() != (size_t) pieceCount * 32)
+      throw runtime_error("Wrong piece layer size");
+    ArrayList<Digest> nodes;
+    for(uint32 j = 0; j < pieceCount; j++)
+      nodes.add(Digest((const byte*) layer.getStringData() + (size_t) j * 32, 32));
+    if(getMerkleRoot(nodes, roundUpToPowerOf2(pieceCount), zeroPieceRoot) != Digest((const byte*) pieceRoots[i].getStringData(), 32))
+      throw runtime_error("Piece layer doesn't match pieces root");
+    for(uint32 j = 0; j < pieceCount; j++)
+      result.push_back(layer.getStringData() + (size_t) j * 32);
   }
+  return result;
+}
 
-  unsigned int getSize() const {
-    return this->size;
+// -------------------------------------------------------------------------- //
+// TorrentCheck
+// -------------------------------------------------------------------------- //
+/**
+ * State of a torrent being verified, shared by the jobs that verify its
+ * pieces. Each job verifies piecesPerJob consecutive pieces and writes its own
+ * part of pieceFailed. Pieces of skipped files are not read. Expected digests
+ * point into the torrent data, they are SHA1 digests of v1 pieces or SHA256
+ * merkle roots of v2 ones.
+ */
+class TorrentCheck {
+private:
+  std::vector<bool> jobsDone;
+  uint32 doneJobCount;
+  mutex doneMutex;
+
+public:
+  TorrentLayout layout;
+  ArrayList<wpath> filePaths;
+  std::vector<char> fileSkipped;
+  boost::shared_ptr<TorrentFileData> torrentData;
+  uint32 hashId;
+  std::vector<const char*> pieceDigests;
+  uint32 piecesPerJob;
+  std::vector<char> pieceFailed;
+
+  TorrentCheck(const TorrentLayout& layout, ArrayList<wpath> filePaths, const std::vector<char>& fileSkipped, boost::shared_ptr<TorrentFileData> torrentData, uint32 hashId, const std::vector<const char*>& pieceDigests): 
+    doneJobCount(0), layout(layout), filePaths(filePaths), fileSkipped(fileSkipped), torrentData(torrentData), hashId(hashId), pieceDigests(pieceDigests), pieceFailed(layout.pieceCount, false)
+  {
+    this->piecesPerJob = max<uint32>(1, TORRENTJOBSIZE / layout.pieceLength);
+    this->jobsDone.resize((layout.pieceCount + this->piecesPerJob - 1) / this->piecesPerJob, false);
   }
 
-  unsigned int getLeft() const {
-    return this->size - this->pos;
+  void setDone(uint32 firstPiece) {
+    mutex::scoped_lock lock(this->doneMutex);
+    this->jobsDone[firstPiece / this->piecesPerJob] = true;
   }
 
-  void reset() {
-    this->pos = 0;
-    this->size = 0;
+  /**
+   * @returns number of pieces at the start of the torrent that are verified.
+   */
+  uint32 getVerifiedPieceCount() {
+    mutex::scoped_lock lock(this->doneMutex);
+    while(this->doneJobCount < this->jobsDone.size() && this->jobsDone[this->doneJobCount])
+      this->doneJobCount++;
+    return min(this->doneJobCount * this->piecesPerJob, this->layout.pieceCount);
   }
 };
 
-ArrayList<CheckError> errorList(CheckError error) {
-  ArrayList<CheckError> result;
-  result.push_back(error);
-  return result;
+/**
+ * @returns SHA256 merkle root of a piece of a v2 torrent. Pieces of files that
+ *   fit in a single piece are padded up to a power of 2 blocks, other pieces up
+ *   to the piece length.
+ */
+Digest getPieceRoot(const TorrentLayout& layout, uint32 piece, const unsigned char* data, size_t size) {
+  uint32 fileIndex = layout.extents[layout.pieceExtents[piece]].fileIndex;
+  uint32 leafCount = layout.pieceLength / V2_BLOCK_SIZE;
+  if(layout.fileEndPieces[fileIndex] - layout.fileFirstPieces[fileIndex] == 1)
+    leafCount = (uint32) roundUpToPowerOf2((size + V2_BLOCK_SIZE - 1) / V2_BLOCK_SIZE);
+
+  ArrayList<const unsigned char*> blocks;
+  ArrayList<size_t> blockSizes;
+  for(size_t offset = 0; offset < size; offset += V2_BLOCK_SIZE) {
+    blocks.add(data + offset);
+    blockSizes.add(min<size_t>(V2_BLOCK_SIZE, size - offset));
+  }
+  return getMerkleRoot(calculateHashes(blocks, blockSizes, H_SHA256), leafCount, getZeroDigest());
 }
 
-void checkTorrent(wpath torrentFile, CheckResultReporter reporter) {
-  wpath dir = torrentFile.branch_path();
-  if(dir == _T(""))
-    dir = _T(".");
+/**
+ * Reads the pieces of a job whole with positioned reads, and hashes them all
+ * at once, in the lanes of the vector registers where the cpu supports it.
+ */
+void verifyPieces(boost::shared_ptr<TorrentCheck> check, uint32 firstPiece) {
+  const TorrentLayout& layout = check->layout;
+  uint32 pieceCount = min(check->piecesPerJob, layout.pieceCount - firstPiece);
+  size_t bufSize = 0;
+  for(uint32 i = layout.pieceExtents[firstPiece]; i < layout.pieceExtents[firstPiece + pieceCount]; i++)
+    bufSize += (size_t) layout.extents[i].length;
+  scoped_array<unsigned char> buf(new unsigned char[max<size_t>(bufSize, 1)]);
+
+  ArrayList<const unsigned char*> data;
+  ArrayList<size_t> sizes;
+  uint32 fileIndex = (uint32) -1;
+  InputStream stream;
+  uint64 streamPos = 0;
+  unsigned char* bufPos = buf.get();
+  for(uint32 piece = firstPiece; piece < firstPiece + pieceCount; piece++) {
+    unsigned char* pieceBuf = bufPos;
+    size_t pieceSize = 0;
+    for(uint32 i = layout.pieceExtents[piece]; i < layout.pieceExtents[piece + 1]; i++)
+      bufPos += (size_t) layout.extents[i].length;
+    try {
+      for(uint32 i = layout.pieceExtents[piece]; i < layout.pieceExtents[piece + 1]; i++) {
+        const FileExtent& extent = layout.extents[i];
+        if(check->fileSkipped[extent.fileIndex])
+          throw runtime_error("v_v");
+        if(extent.fileIndex != fileIndex) {
+          fileIndex = (uint32) -1;
+          stream = FileInputStream(check->filePaths[extent.fileIndex].wstring(), OM_SEQUENTIAL_SCAN);
+          fileIndex = extent.fileIndex;
+          streamPos = 0;
+        }
+        if(streamPos != extent.offset)
+          stream.skip(extent.offset - streamPos);
+        if(stream.read(pieceBuf + pieceSize, extent.length) != (int) extent.length)
+          throw runtime_error("v_v");
+        streamPos = extent.offset + extent.length;
+        pieceSize += extent.length;
+      }
+    } catch (...) {
+      check->pieceFailed[piece] = true;
+      fileIndex = (uint32) -1;
+    }
+    data.add(pieceBuf);
+    sizes.add(pieceSize);
+  }
 
-  string pieces;
-  unsigned int pieceLen;
-  ArrayList<wstring> files;
-  ArrayList<uint64> fileSizes;
+  ArrayList<Digest> digests;
+  if(check->hashId == H_SHA256) {
+    for(uint32 i = 0; i < pieceCount; i++)
+      digests.add(getPieceRoot(layout, firstPiece + i, data[i], sizes[i]));
+  } else if(isMultiBufferHash(H_SHA1)) {
+    digests = calculateHashes(data, sizes, H_SHA1);
+  } else {
+    for(uint32 i = 0; i < pieceCount; i++)
+      digests.add(calculateHash(data[i], sizes[i], H_SHA1));
+  }
+  for(uint32 i = 0; i < pieceCount; i++)
+    if(digests[i] != Digest((const byte*) check->pieceDigests[firstPiece + i], Hash::getDigestSize(check->hashId)))
+      check->pieceFailed[firstPiece + i] = true;
 
-  reporter.begin(torrentFile);
+  check->setDone(firstPiece);
+}
 
-  try {
-    if(!exists(torrentFile)) {
-      reporter.error(CheckError(CE_NOACCESS));
-      reporter.end();
-      return;
-    }
+// -------------------------------------------------------------------------- //
+// TorrentReporter
+// -------------------------------------------------------------------------- //
+/**
+ * Reports the files of a torrent in order, each once all the pieces it is
+ * made of are verified. A file fails if any of its pieces does. Skipped files
+ * are already reported.
+ */
+class TorrentReporter {
+private:
+  boost::shared_ptr<TorrentCheck> check;
+  ArrayList<wstring> files;
+  CheckResultReporter reporter;
+  uint32 reportedFileCount;
+  bool fileBegun;
 
-    unsigned long long torrentSizeL = file_size(torrentFile);
-    if(torrentSizeL > MAX_TORRENT_FILE_SIZE) {
-      reporter.error(_T("Torrent file too big: ") + torrentFile.native());
-      reporter.end();
+public:
+  TorrentReporter(boost::shared_ptr<TorrentCheck> check, ArrayList<wstring> files, CheckResultReporter reporter): 
+    check(check), files(files), reporter(reporter), reportedFileCount(0), fileBegun(false) {}
+
+  /** 
+   * Begins the next file to report, so that the progress of reading it can be
+   * shown.
+   */
+  void beginNext() {
+    if(this->fileBegun || this->reportedFileCount == this->files.size() || this->check->fileSkipped[this->reportedFileCount])
       return;
-    }
+    this->reporter.beginFile(this->check->filePaths[this->reportedFileCount], this->files[this->reportedFileCount]);
+    this->fileBegun = true;
+  }
 
-    MemBuffer torrentFileBuf((unsigned int) torrentSizeL);
-    torrentFileBuf.fillFromStream(FileInputStream(torrentFile.native(), OM_SEQUENTIAL_SCAN));
-    if(torrentFileBuf.getSize() != torrentSizeL) {
-      reporter.error(_T("Error while reading torrent file: ") + torrentFile.native());
-      reporter.end();
+  /** Reports the progress of the begun file within the given pieces. */
+  void update(uint32 firstPiece, uint32 endPiece) {
+    if(!this->fileBegun)
       return;
+    const TorrentLayout& layout = this->check->layout;
+    for(uint32 i = layout.pieceExtents[firstPiece]; i < layout.pieceExtents[endPiece]; i++)
+      if(layout.extents[i].fileIndex == this->reportedFileCount)
+        this->reporter.update(layout.extents[i].length);
+  }
+
+  void report(uint32 verifiedPieceCount) {
+    const TorrentLayout& layout = this->check->layout;
+    while(this->reportedFileCount < this->files.size() && layout.fileEndPieces[this->reportedFileCount] <= verifiedPieceCount) {
+      if(this->check->fileSkipped[this->reportedFileCount]) {
+        this->reportedFileCount++;
+        continue;
+      }
+      beginNext();
+      bool failed = false;
+      for(uint32 piece = layout.fileFirstPieces[this->reportedFileCount]; piece < layout.fileEndPieces[this->reportedFileCount]; piece++)
+        failed = failed || this->check->pieceFailed[piece];
+      if(failed)
+        this->reporter.endFile(errorList(CheckError(CE_WRONGHASH, this->check->hashId, Digest(), Digest())));
+      else
+        this->reporter.endFile(ArrayList<CheckError>());
+      this->reportedFileCount++;
+      this->fileBegun = false;
     }
+  }
+};
 
-    entry infoEntry = bdecode(torrentFileBuf.getBuf(), torrentFileBuf.getBufEnd())["info"];
-    //entry::dictionary_type info = infoEntry.dict();
+// -------------------------------------------------------------------------- //
+// checkTorrent
+// -------------------------------------------------------------------------- //
+void checkTorrent(wpath torrentFile, CheckResultReporter reporter, optional<Scheduler> scheduler) {
+  wpath dir = torrentFile.branch_path();
+  if(dir == _T(""))
+    dir = _T(".");
 
-    pieceLen = (unsigned int) infoEntry["piece length"].integer();
-    pieces = infoEntry["pieces"].string();
+  boost::shared_ptr<TorrentFileData> torrentData;
+  bool isV2;
+  BencodeValue pieces;
+  BencodeValue pieceLayers;
+  unsigned int pieceLen;
+  ArrayList<wstring> files;
+  ArrayList<uint64> fileSizes;
+  ArrayList<BencodeValue> pieceRoots;
 
-    bool singleFileMode = false;
-    if(infoEntry.find_key("files") == NULL)
-      singleFileMode = true;
+  reporter.begin(torrentFile);
 
-    if(singleFileMode) {
-      files.push_back(toWideString(infoEntry["name"].string(), "utf-8"));
-      fileSizes.push_back(infoEntry["length"].integer());
+  if(!exists(torrentFile)) {
+    reporter.error(CheckError(CE_NOACCESS));
+    reporter.end();
+    return;
+  }
+
+  try {
+    torrentData.reset(new TorrentFileData(torrentFile));
+  } catch (std::exception &) {
+    reporter.error(_T("Error while reading torrent file: ") + torrentFile.wstring());
+    reporter.end();
+    return;
+  }
+
+  try {
+    BencodeValue torrent = BencodeValue::parse(torrentData->getData(), torrentData->getSize());
+    BencodeValue info = torrent["info"];
+
+    int64 pieceLength = info["piece length"].getInteger();
+    if(pieceLength <= 0 || pieceLength > MAX_PIECE_LENGTH)
+      throw runtime_error("Wrong piece length");
+    pieceLen = (unsigned int) pieceLength;
+
+    /* Hybrid torrents are checked as v2 ones, their v1 part lists padding
+     * files that aren't there on disk. */
+    BencodeValue metaVersion = info.find("meta version");
+    isV2 = !metaVersion.isNone() && metaVersion.getInteger() == 2;
+    BencodeValue fileList = info.find("files");
+    if(isV2) {
+      if(pieceLen < V2_BLOCK_SIZE || roundUpToPowerOf2(pieceLen) != pieceLen)
+        throw runtime_error("Wrong piece length");
+      addFileTree(info["file tree"], _T(""), files, fileSizes, pieceRoots);
+      pieceLayers = torrent.find("piece layers");
+    } else if(fileList.isNone()) {
+      pieces = info["pieces"];
+      pieces.getStringData();
+      files.push_back(toWideString(info["name"].getString(), "utf-8"));
+      fileSizes.push_back(getLength(info));
     } else {
-      entry::list_type fileList = infoEntry["files"].list();
-      for(entry::list_type::iterator i = fileList.begin(); i != fileList.end(); i++) {
+      pieces = info["pieces"];
+      pieces.getStringData();
+      for(BencodeValue i = fileList.getFirst(); !i.isNone(); i = i.getNext()) {
         std::wstring path;
-        entry::list_type pathList = (*i)["path"].list();
-        for(entry::list_type::iterator j = pathList.begin(); j != pathList.end(); j++)
-          path += toWideString((*j).string(), "utf-8") + _T("/");
+        for(BencodeValue j = i["path"].getFirst(); !j.isNone(); j = j.getNext())
+          path += toWideString(j.getString(), "utf-8") + _T("/");
         files.push_back(path.substr(0, path.size() - 1));
-        fileSizes.push_back((*i)["length"].integer());
+        fileSizes.push_back(getLength(i));
       }
     }
+    checkPieceCount(pieceLen, fileSizes, isV2, pieces, pieceRoots, pieceLayers);
   } catch (...) {
     reporter.error(CheckError(CE_WRONGFORMAT, 0));
     reporter.end();
@@ -170,125 +600,88 @@ void checkTorrent(wpath torrentFile, CheckResultReporter reporter) {
     return;
   }
 
-  int pieceIndex = 0;
-  int fileIndex = -1;
-
-  MemBuffer readBuf(FILEBUFSIZE);
-  InputStream stream;
-  bool hadFails = false;
-  bool firstChunk = false;
-  bool starting = true;
-
-  Hash sha1hash = Hash(H_SHA1, 0);
-  uint32 hashed = 0;
-
-  ArrayList<wstring> currentFiles;
-  ArrayList<wpath> currentFilePaths;
-
-  unsigned int read = 0;
-
-  while(true) {
-    if(starting || read == EOF) {
-      starting = false;
-
-      fileIndex++;
-      if(fileIndex == files.size())
-        break;
-
-      try {
-        stream = FileInputStream(files[fileIndex], OM_SEQUENTIAL_SCAN | OM_UNBUFFERED);
-      } catch (...) {
-        reporter.beginFile(wpath(), files[fileIndex]);
-        reporter.endFile(errorList(CheckError(CE_NOACCESS)));
-        reporter.error(CheckError(CE_TOOMANYERRORS));
-        reporter.end();
-        return;
-      }
-
-      if(!exists(files[fileIndex])) {
-        reporter.beginFile(wpath(), files[fileIndex]);
-        reporter.endFile(errorList(CheckError(CE_NOACCESS)));
-        reporter.error(CheckError(CE_TOOMANYERRORS));
-        reporter.end();
-        return;
-      }
-
-      wpath filePath = wpath(files[fileIndex]).is_complete() ? files[fileIndex] : (dir / files[fileIndex]);
-      uint64 realFileSize;
-      try {
-        realFileSize = file_size(filePath);
-      } catch (...) {
-        realFileSize = (uint64) -1;
-      }
-      
-      if(realFileSize != fileSizes[fileIndex]) {
-        reporter.beginFile(wpath(), files[fileIndex]);
-        reporter.endFile(errorList(CheckError(CE_WRONGSIZE, fileSizes[fileIndex], realFileSize)));
-        reporter.error(CheckError(CE_TOOMANYERRORS));
-        reporter.end();
-        return;
-      }
-
-      if(currentFiles.empty())
-        reporter.beginFile(filePath, files[fileIndex]);
-
-      currentFiles.push_back(files[fileIndex]);
-      currentFilePaths.push_back(filePath);
+  /* Allocation failures land here too. */
+  scoped_ptr<TorrentLayout> layout;
+  std::vector<const char*> pieceDigests;
+  try {
+    layout.reset(new TorrentLayout(pieceLen, fileSizes, isV2));
+    if(isV2) {
+      pieceDigests = getV2PieceDigests(*layout, pieceRoots, pieceLayers);
+    } else {
+      for(uint32 i = 0; i < layout->pieceCount; i++)
+        pieceDigests.push_back(pieces.getStringData() + (size_t) i * 20);
+    }
+  } catch (std::exception &) {
+    reporter.error(CheckError(CE_WRONGFORMAT, 0));
+    reporter.end();
+    return;
+  }
 
-      if(hashed != 0)
-        firstChunk = true;
+  /* All the files are stat'ed before anything is read. Pieces of v1 torrents
+   * span file boundaries, so there is no point in hashing if any of the files
+   * is missing. Files of v2 torrents are verified on their own, the missing 
+   * ones are just skipped. */
+  bool hadSizeFails = false;
+  std::vector<char> fileSkipped(files.size(), false);
+  ArrayList<wpath> filePaths;
+  for(uint32 i = 0; i < files.size(); i++) {
+    wpath filePath = wpath(files[i]).is_complete() ? files[i] : (dir / files[i]);
+    uint64 realFileSize;
+    try {
+      realFileSize = is_regular(filePath) ? file_size(filePath) : (uint64) -1;
+    } catch (...) {
+      realFileSize = (uint64) -1;
     }
-    
-    read = 0;
-    if(readBuf.getLeft() == 0) {
-      readBuf.reset();
-      read = readBuf.updateFromStream(stream);
-      if(read != EOF)
-        reporter.update(read);
+    filePaths.push_back(filePath);
+
+    if(realFileSize == (uint64) -1) {
+      reporter.beginFile(wpath(), files[i]);
+      reporter.endFile(errorList(CheckError(CE_NOACCESS)));
+      hadSizeFails = true;
+      fileSkipped[i] = true;
+    } else if(realFileSize != fileSizes[i]) {
+      reporter.beginFile(wpath(), files[i]);
+      reporter.endFile(errorList(CheckError(CE_WRONGSIZE, fileSizes[i], realFileSize)));
+      hadSizeFails = true;
+      fileSkipped[i] = true;
     }
+  }
+  if(hadSizeFails && !isV2) {
+    reporter.error(CheckError(CE_TOOMANYERRORS));
+    reporter.end();
+    return;
+  }
+  if(options.isQuick()) {
+    for(uint32 i = 0; i < files.size(); i++) {
+      if(fileSkipped[i])
+        continue;
+      reporter.beginFile(filePaths[i], files[i]);
+      reporter.endUnreadFile(true);
+    }
+    reporter.end();
+    return;
+  }
 
-    uint32 toHash = min(readBuf.getLeft(), pieceLen - hashed);
-    sha1hash.update(readBuf.getBuf() + readBuf.getPos(), toHash);
-
-    hashed += toHash;
-    readBuf.advancePos(toHash);
-
-    if((read == EOF && fileIndex == files.size() - 1) || hashed == pieceLen) {
-      Digest chunkDigest = sha1hash.finalize();
-      Digest realDigest((const byte*) pieces.c_str() + (pieceIndex++) * 20, 20);
-      sha1hash = Hash(H_SHA1, 0);
-
-      if((read == EOF && fileIndex == files.size() - 1) || (read == EOF && hashed == pieceLen) || firstChunk) {
-        bool currentHadFails = hadFails || (chunkDigest != realDigest);
-        if(currentHadFails)
-          reporter.endFile(errorList(CheckError(CE_WRONGHASH, H_SHA1, Digest(), Digest())));
-        else
-          reporter.endFile(ArrayList<CheckError>());
-
-        int32 sizeDec = ((read == EOF && hashed == pieceLen) || (read == EOF && fileIndex == files.size() - 1)) ? 0 : 1;
-
-        hadFails = chunkDigest != realDigest;
-        for(uint32 i = 1; i < currentFiles.size() - sizeDec; i++) { // ? -1
-          reporter.beginFile(currentFilePaths[i], currentFiles[i]);
-          if(hadFails)
-            reporter.endFile(errorList(CheckError(CE_WRONGHASH, H_SHA1, Digest(), Digest())));
-          else
-            reporter.endFile(ArrayList<CheckError>());
-        }
-        firstChunk = false;
-
-        currentFiles.erase(0, currentFiles.size() - sizeDec);
-        currentFilePaths.erase(0, currentFilePaths.size() - sizeDec);
-
-        if(!currentFiles.empty())
-          reporter.beginFile(currentFilePaths[0], currentFiles[0]);
-      }
-
-      if(chunkDigest != realDigest)
-        hadFails = true;
-      hashed = 0;
+  boost::shared_ptr<TorrentCheck> check(new TorrentCheck(*layout, filePaths, fileSkipped, torrentData, isV2 ? H_SHA256 : H_SHA1, pieceDigests));
+  TorrentReporter torrentReporter(check, files, reporter);
+  if(scheduler && layout->pieceCount > check->piecesPerJob) {
+    JobGroup group(*scheduler);
+    for(uint32 first = 0; first < layout->pieceCount; first += check->piecesPerJob) {
+      group.run(boost::bind(&verifyPieces, check, first));
+      group.wait(CHECKERQUEUESIZE);
+      torrentReporter.report(check->getVerifiedPieceCount());
+    }
+    group.wait();
+  } else {
+    torrentReporter.beginNext();
+    for(uint32 first = 0; first < layout->pieceCount; first += check->piecesPerJob) {
+      verifyPieces(check, first);
+      torrentReporter.update(first, check->getVerifiedPieceCount());
+      torrentReporter.report(check->getVerifiedPieceCount());
+      torrentReporter.beginNext();
     }
   }
+  torrentReporter.report(layout->pieceCount);
 
   reporter.end();
 }
\ No newline at end of file
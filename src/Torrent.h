@@ -4,8 +4,14 @@
 #include "config.h"
 #include <boost/filesystem.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/optional.hpp>
 #include "Checker.h"
+#include "Scheduler.h"
 
-void checkTorrent(boost::filesystem::wpath torrentFile, CheckResultReporter reporter = CheckResultReporter());
+/**
+ * Checks the files of a torrent against the SHA1 digests of its pieces. Given
+ * a scheduler, pieces are verified as separate jobs, several at once.
+ */
+void checkTorrent(boost::filesystem::wpath torrentFile, CheckResultReporter reporter = CheckResultReporter(), boost::optional<Scheduler> scheduler = boost::none);
 
 #endif
\ No newline at end of file
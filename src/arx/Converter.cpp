@@ -1,13 +1,16 @@
 #include "config.h"
 #include "Converter.h"
 #include <string>
+#include <cstring>
 #include <cassert>
+#include <stdexcept>
 
 #ifdef ARX_WIN
 #  include <Windows.h>
 #endif
 
 #ifdef ARX_LINUX
+#  include <cerrno>
 #  include <iconv.h>
 #endif
 
@@ -162,17 +165,17 @@ namespace arx {
 #endif // ARX_WIN
 #ifdef ARX_LINUX
     private:
-      shared_ptr<iconv_t> conv;
+      boost::shared_ptr<iconv_t> conv;
 
       void init(const char* encoding) {
-        string encs = encoding;
+        std::string encs = encoding;
         if(encs == "DEFAULT")
           encs = "UTF-8";
         iconv_t* pIconv = new iconv_t;
         *pIconv = iconv_open(encs.c_str(), "WCHAR_T");
         if(*pIconv == (iconv_t)(-1)) {
           delete pIconv;
-          throw std::runtime_error("Unknown encoding: " + encoding);
+          throw std::runtime_error("Unknown encoding: " + encs);
         }
         this->conv.reset(pIconv, IconvDeleter());
       }
@@ -181,19 +184,25 @@ namespace arx {
         init(encoding);
       }
       FromUTF16ConverterImpl() {
-        // TODO: is UTF-8 ok?
-        init("UTF-8");
+        init("DEFAULT");
       }
       std::string convert(const std::wstring& src) const {
-        char* inBuf = const_cast<char*>(src.c_str());
-        size_t inBytesLeft = src.size();
-        size_t outBytesLeft = inBytesLeft * 6 + 4; // Is that enough?
-        std::string result("", outBytesLeft);
-        char* outBuf = const_cast<char*>(result.c_str());
-        size_t status = iconv(*this->conv, &inBuf, &inBytesLeft, &outBuf, &outBytesLeft);
-        if(status == (size_t)(-1) && errno != EINVAL)
-          throw std::runtime_error("Conversion from UTF16 failed");
-        return std::string(result.c_str());
+        char* inBuf = reinterpret_cast<char*>(const_cast<wchar_t*>(src.c_str()));
+        size_t inBytesLeft = src.size() * sizeof(wchar_t);
+        size_t outBytesLeft = src.size() * 6 + 4;
+        std::string result(outBytesLeft, '\0');
+        char* outBuf = &result[0];
+        iconv(*this->conv, NULL, NULL, NULL, NULL);
+        while(inBytesLeft > 0) {
+          if(iconv(*this->conv, &inBuf, &inBytesLeft, &outBuf, &outBytesLeft) != (size_t)(-1))
+            break;
+          if(errno != EILSEQ)
+            throw std::runtime_error("Conversion from UTF16 failed");
+          inBuf += sizeof(wchar_t); // Skip unconvertible character
+          inBytesLeft -= sizeof(wchar_t);
+        }
+        result.resize(result.size() - outBytesLeft);
+        return result;
       }
 #endif // ARX_LINUX
     };
@@ -250,40 +259,43 @@ namespace arx {
 
 #ifdef ARX_LINUX
     private:
-      shared_ptr<iconv_t> conv;
+      boost::shared_ptr<iconv_t> conv;
 
       void init(const char* encoding) {
-        string encs = encoding;
+        std::string encs = encoding;
         if(encs == "DEFAULT")
           encs = "UTF-8";
         iconv_t* pIconv = new iconv_t;
         *pIconv = iconv_open("WCHAR_T", encs.c_str());
         if(*pIconv == (iconv_t)(-1)) {
           delete pIconv;
-          throw std::runtime_error("Unknown encoding: " + encoding);
+          throw std::runtime_error("Unknown encoding: " + encs);
         }
         this->conv.reset(pIconv, IconvDeleter());
       }
 
-      std::wstring convert(std::string& src, bool replaceWithIncompleteSeq) {
+      std::wstring convert(std::string& src, bool replaceWithIncompleteSeq) const {
         char* inBuf = const_cast<char*>(src.c_str());
         size_t inBytesLeft = src.size();
-        size_t outBytesLeft = inBytesLeft * 4 + 4; // Is that enough?
-        std::wstring result(L"", outBytesLeft / 2);
-        char* outBuf = const_cast<char*>(result.c_str());
-        while(true) {
-          size_t status = iconv(*this->conv, &inBuf, &inBytesLeft, &outBuf, &outBytesLeft);
-          if(status == (size_t)(-1) && errno == EILSEQ) { // Invalid multibyte sequence
+        std::wstring result(src.size() + 1, L'\0');
+        size_t outBytesLeft = result.size() * sizeof(wchar_t);
+        char* outBuf = reinterpret_cast<char*>(&result[0]);
+        iconv(*this->conv, NULL, NULL, NULL, NULL);
+        while(inBytesLeft > 0) {
+          if(iconv(*this->conv, &inBuf, &inBytesLeft, &outBuf, &outBytesLeft) != (size_t)(-1))
+            break;
+          if(errno == EILSEQ) { // Invalid multibyte sequence
             inBuf++;
             inBytesLeft--;
-          } else if(status != (size_t)(-1) || (status == (size_t)(-1) && errno == EINVAL)) {
-            if(replaceWithIncompleteSeq)
-              src = inBuf;
-            return result;
-          } else if(status == (size_t)(-1) && errno != EINVAL)
+          } else if(errno == EINVAL) // Incomplete multibyte sequence
+            break;
+          else
             throw std::runtime_error("Conversion to UTF16 failed");
         }
-        return std::wstring(result.c_str());
+        result.resize(result.size() - outBytesLeft / sizeof(wchar_t));
+        if(replaceWithIncompleteSeq)
+          src = std::string(inBuf, inBytesLeft);
+        return result;
       }
 
     public:
@@ -292,12 +304,12 @@ namespace arx {
       }
 
       ToUTF16ConverterImpl() {
-        // TODO: is UTF-8 ok?
-        init("UTF-8");
+        init("DEFAULT");
       }
 
       std::wstring convert(const std::string& src) const {
-        return convert(const_cast<std::string&>(src), false);
+        std::string copy = src;
+        return convert(copy, false);
       }
 
       std::wstring convertSome(std::string& src) const {
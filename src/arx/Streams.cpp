@@ -14,12 +14,16 @@
 #  include <sys/types.h>
 #  include <sys/stat.h>
 #  include <fcntl.h>
+#  include <unistd.h>
+#  include <cerrno>
 #endif
 
 #include "Converter.h"
 #include "Exception.h"
 #include <algorithm>
 #include <limits>
+#include <cstring>
+#include <stdexcept>
 
 #ifdef DEBUG
 template<class A, class B> 
@@ -417,49 +421,111 @@ namespace arx {
 #ifdef ARX_LINUX
     private:
       int fd;
-      
-      init(string fileName, int openMode) {
-        int flags = O_LARGEFILE | O_RDONLY;
+      bool owned;
+      bool direct;
+      bool seekable;
+      bool interactive;
+      unsigned long long pos;
+
+      void init(const string& fileName, int openMode) {
+        int flags = O_RDONLY;
         if(openMode & OM_UNBUFFERED)
           flags |= O_DIRECT;
         this->fd = open(fileName.c_str(), flags);
+        if(this->fd == -1 && (flags & O_DIRECT)) // some filesystems do not support O_DIRECT
+          this->fd = open(fileName.c_str(), flags & ~O_DIRECT);
         if(this->fd == -1)
-          throw new runtime_error("Could not open file \"" + fileName + "\" for reading.").
+          throw runtime_error("Could not open file \"" + fileName + "\" for reading.");
+        this->owned = true;
+        initState();
+        if(openMode & OM_SEQUENTIAL_SCAN)
+          posix_fadvise(this->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+      }
+
+      void initState() {
+        this->direct = (fcntl(this->fd, F_GETFL) & O_DIRECT) != 0;
+        this->pos = 0;
+        off_t offset = lseek(this->fd, 0, SEEK_CUR);
+        this->seekable = (offset != (off_t) -1);
+        if(this->seekable)
+          this->pos = offset;
+        this->interactive = isatty(this->fd) != 0;
+      }
+
+      ssize_t readSome(unsigned char* buf, unsigned int len) {
+        while(true) {
+          ssize_t result = this->seekable ? pread(this->fd, buf, len, this->pos) : ::read(this->fd, buf, len);
+          if(result >= 0 || errno != EINTR)
+            return result;
+        }
       }
 
     protected:
       FileInputStreamImpl(int fd) {
         this->fd = fd;
+        this->owned = false;
+        initState();
       }
 
     public:
-
       FileInputStreamImpl(string fileName, int openMode) {
         init(fileName, openMode);
       }
 
       FileInputStreamImpl(wstring fileName, int openMode) {
-        // TODO: is that ok?
-        FromUTF16Converter conv;
-        init(conv.convert(fileName).c_str(), openMode);
+        init(FromUTF16Converter().convert(fileName), openMode);
+      }
+
+      // The base destructor can't reach close() of this class, so the file is
+      // closed here. Standard handles given to the protected constructor stay open.
+      ~FileInputStreamImpl() {
+        if(!this->owned)
+          return;
+        try {
+          this->close();
+        } catch(...) {
+          return;
+        }
       }
 
       int read(unsigned char* buf, unsigned int len) {
-        int result = read(this->fd, buf, len);
-        if(result == 0)
-          return EOF;
-        if(result < 0)
-          throw runtime_error("Error while reading file: read failed");
-        return result;
+        // O_DIRECT requires the buffer, the length and the offset to be aligned. 
+        // Misaligned requests are served from the page cache instead of failing.
+        if(this->direct && (((size_t) buf | len | this->pos) & (ARX_UNBUFFERED_IO_ALIGN - 1)) != 0) {
+          fcntl(this->fd, F_SETFL, fcntl(this->fd, F_GETFL) & ~O_DIRECT);
+          this->direct = false;
+        }
+
+        // Fill the whole buffer, pipes return short reads, and the hashers expect 
+        // full-sized chunks. Terminals are read a line at a time.
+        unsigned int totalRead = 0;
+        while(totalRead < len) {
+          ssize_t result = readSome(buf + totalRead, len - totalRead);
+          if(result < 0)
+            throw runtime_error("Error while reading file: read failed");
+          if(result == 0)
+            break;
+          totalRead += (unsigned int) result;
+          this->pos += result;
+          if(this->interactive)
+            break;
+        }
+        return (totalRead == 0 && len != 0) ? EOF : (int) totalRead;
       }
 
-      // TODO:
-      // long long skip(long long n);
+      long long skip(long long n) {
+        if(!this->seekable)
+          return detail::skip<unsigned char>(this, n);
+        this->pos += n;
+        return n;
+      }
 
       void close() {
         if(this->fd == -1)
           return;
-        if(close(this->fd) != 0)
+        int status = ::close(this->fd);
+        this->fd = -1;
+        if(status != 0)
           throw runtime_error("Error while closing file: close failed");
       }
 #endif // ARX_LINUX
@@ -539,54 +605,62 @@ namespace arx {
 #ifdef ARX_LINUX
     private:
       int fd;
+      bool owned;
 
-      init(string fileName, int openMode) {
-        int flags = O_LARGEFILE | O_WRONLY;
-        if(openMode & OM_UNBUFFERED)
-          flags |= O_DIRECT;
-        this->fd = open(fileName.c_str(), flags);
+      void init(const string& fileName, int openMode) {
+        this->fd = open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
         if(this->fd == -1)
-          throw new runtime_error("Could not open file \"" + fileName + "\" for writing.").
+          throw runtime_error("Could not open file \"" + fileName + "\" for writing.");
+        this->owned = true;
       }
 
     protected:
       FileOutputStreamImpl(int fd) {
         this->fd = fd;
+        this->owned = false;
       }
 
     public:
-
       FileOutputStreamImpl(string fileName, int openMode) {
         init(fileName, openMode);
       }
 
       FileOutputStreamImpl(wstring fileName, int openMode) {
-        // TODO: is that ok?
-        FromUTF16Converter conv;
-        init(conv.convert(fileName).c_str(), openMode);
+        init(FromUTF16Converter().convert(fileName), openMode);
+      }
+
+      ~FileOutputStreamImpl() {
+        if(!this->owned)
+          return;
+        try {
+          this->close();
+        } catch(...) {
+          return;
+        }
       }
 
       void write(const unsigned char* buf, unsigned int len) {
-        ssize_t write(int fd, const void *buf, size_t count)
-        DWORD written;
-        do {
-          ssize_t written = write(this->handle, buf, len);
+        while(len != 0) {
+          ssize_t written = ::write(this->fd, buf, len);
+          if(written == -1 && errno == EINTR)
+            continue;
           if(written == -1)
             throw runtime_error("Error while writing to file: write failed");
-          len -= written;
+          len -= static_cast<unsigned int>(written);
           buf += written;
-        } while(len != 0);
+        }
       }
 
       void flush() {
-        // TODO!!!
         return;
       }
 
       void close() {
         if(this->fd == -1)
           return;
-        if(close(this->fd) != 0)
+        int status = ::close(this->fd);
+        this->fd = -1;
+        if(status != 0)
           throw runtime_error("Error while closing file: close failed");
       }
 #endif // ARX_LINUX
@@ -1349,8 +1423,8 @@ namespace arx {
 // -------------------------------------------------------------------------- //
 // wCin && wCout
 // -------------------------------------------------------------------------- //
-  shared_ptr<Printer> localWCout;
-  shared_ptr<Scanner> localWCin;
+  boost::shared_ptr<Printer> localWCout;
+  boost::shared_ptr<Scanner> localWCin;
 
   void initWStreams() {
     static bool initialized = false;
@@ -12,6 +12,10 @@
 // indirectly, by means of a permutation vector
 #define ARX_LINEAR_SOLVER_PERMUTATION_VERTOR_USAGE_BORDER 5
 
+// Buffers, lengths and file offsets passed to streams opened with OM_UNBUFFERED 
+// must be aligned to this boundary
+#define ARX_UNBUFFERED_IO_ALIGN 4096
+
 // -------------------------------------------------------------------------- //
 // Guess defines - do not change
 // -------------------------------------------------------------------------- //
@@ -2,6 +2,7 @@
 #define __CONFIG_H__
 
 #include "arx/config.h"
+#include <stddef.h>
 
 // ------------------------------------------------------------------------- //
 // Config defines - feel free to change 'em
@@ -15,9 +16,72 @@
 // Size of buffer for file read operations
 #define FILEBUFSIZE (1024 * 1024)
 
+// Number of FILEBUFSIZE buffers the multithreaded hasher, or every disk with
+// --per-device, can read ahead
+#define HASHERBUFCOUNT 8
+
+// Number of reads the hasher keeps in flight. Reads are asynchronous on linux,
+// where they go through io_uring, elsewhere files are read one buffer at a time
+#define HASHERQUEUEDEPTH 4
+
+// Size of the window in which files are mapped into memory with --mmap, larger
+// files are mapped window after window
+#define MMAPWINDOWSIZE (16 * 1024 * 1024)
+
+// Files smaller than this are never split between several threads
+#define PARALLELHASHMINSIZE (64 * 1024 * 1024)
+
+// Size of a piece of file that is hashed as a single job when splitting a 
+// file between several threads, must be a power of 2
+#define PARALLELHASHSHARDSIZE (4 * 1024 * 1024)
+
+// Number of bytes of large files that may be waiting to be hashed per thread
+// they are split between, shared by all the files hashed at once
+#define PARALLELHASHQUEUESIZE (2 * PARALLELHASHSHARDSIZE)
+
+// Files not larger than this are read whole and hashed in batches, so that 
+// md5 and sha1 of several files can be computed at once
+#define BATCHMAXFILESIZE (256 * 1024)
+
+// Maximal total size of the files in a batch
+#define BATCHMAXSIZE (8 * 1024 * 1024)
+
+// Maximal number of files in a batch
+#define BATCHMAXFILES 256
+
+// Number of batches every disk can read ahead of their hashing with --per-device
+#define DEVICEBATCHCOUNT 2
+
+// Maximal number of files, or jobs of torrent pieces, being checked at once in
+// check mode with -j, no more jobs are queued until one of them finishes
+#define CHECKERQUEUESIZE 16
+
+// Number of bytes of torrent pieces verified as a single job, torrents with
+// larger pieces are verified a piece per job
+#define TORRENTJOBSIZE (4 * 1024 * 1024)
+
+// Number of files stat'ed as a single job before anything is read in check
+// mode with -j
+#define CHECKERSTATBATCHSIZE 256
+
+// Number of rows of a file table the hasher takes at once
+#define HASHERWINDOWSIZE 65536
+
+// Size of buffer for directory reads, directory entries are read in bulk
+#define DIRBUFSIZE (64 * 1024)
+
 // Size of data chunk used for speed testing
 #define TESTDATACHUNKSIZE ((1024 - 7) * (1024 - 13))
 
+// Number of threads large files are hashed with when testing the memory that
+// parallel hashing takes
+#define TESTMEMORYJOBCOUNT 16
+
+// Memory a large file hashed with tth and ed2k may take when testing parallel
+// hashing, not counting the budget shared by all files: a buffer being 
+// filled for each hash and the read buffers
+#define TESTMEMORYPERFILE (24 * 1024 * 1024)
+
 // Maximal number of test iterations
 #define TESTMAXITERATIONS 1024
 
@@ -27,9 +91,13 @@
 // Maximal number of errors in hash file
 #define HASHFILEMAXERRORS 5
 
-// Maximal size of .torrent file
+// Maximal size of .torrent file, on linux torrent files are mapped into memory
+// and can be of any size
 #define MAX_TORRENT_FILE_SIZE (1024 * 1024 * 32)
 
+// Maximal nesting of lists and dictionaries in a .torrent file
+#define MAX_BENCODE_DEPTH 64
+
 // ------------------------------------------------------------------------- //
 // DO NOT CHANGE ANYTHING BELOW THIS LINE UNLESS YOU KNOW WHAT YOU'RE DOING!
 // ------------------------------------------------------------------------- //
@@ -38,7 +106,6 @@ typedef unsigned char byte;
 typedef unsigned short uint16;
 typedef unsigned int uint32;
 typedef unsigned long long uint64;
-typedef unsigned int size_t;
 typedef short int16;
 typedef int int32;
 typedef long long int64;
@@ -48,7 +115,6 @@ typedef long long int64;
 #  ifdef ARX_WIN
 #    define MD5_ASM
 #    define SHA1_ASM
-#    define CRC_ASM
 #    define SHAREAZA_USE_ASM
 #  endif
 #endif
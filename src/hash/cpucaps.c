@@ -0,0 +1,86 @@
+/*
+ * cpucaps.c - runtime detection of the cpu features used by the hash 
+ * implementations.
+ */
+
+#include "cpucaps.h"
+
+#if defined(CPUCAPS_X86) && defined(_MSC_VER)
+#  include <intrin.h>
+#elif defined(CPUCAPS_X86) && defined(__GNUC__)
+#  include <cpuid.h>
+#endif
+
+#ifdef CPUCAPS_X86
+static void cpuid(unsigned int leaf, unsigned int subleaf, unsigned int regs[4])
+  {
+#ifdef _MSC_VER
+  int r[4];
+  __cpuidex(r, (int) leaf, (int) subleaf);
+  regs[0] = r[0]; regs[1] = r[1]; regs[2] = r[2]; regs[3] = r[3];
+#else
+  __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+  }
+
+static unsigned int cpucaps_xcr0(void)
+  {
+#ifdef _MSC_VER
+  return (unsigned int) _xgetbv(0);
+#else
+  unsigned int eax, edx;
+  __asm__ (".byte 0x0f, 0x01, 0xd0" : "=a" (eax), "=d" (edx) : "c" (0)); /* xgetbv */
+  return eax;
+#endif
+  }
+
+static unsigned int cpucaps_detect(void)
+  {
+  unsigned int regs[4];
+  unsigned int caps = 0;
+  unsigned int xcr0;
+  int osavx, osavx512;
+
+  cpuid(0, 0, regs);
+  if (regs[0] < 1)
+    return 0;
+
+  cpuid(1, 0, regs);
+  if (regs[3] & (1u << 26)) caps |= CPUCAP_SSE2;
+  if (regs[2] & (1u << 9))  caps |= CPUCAP_SSSE3;
+  if (regs[2] & (1u << 19)) caps |= CPUCAP_SSE41;
+  if (regs[2] & (1u << 1))  caps |= CPUCAP_PCLMUL;
+
+  /* AVX state must be enabled by the OS, see xgetbv. */
+  xcr0 = (regs[2] & (1u << 27)) ? cpucaps_xcr0() : 0;
+  osavx = (regs[2] & (1u << 28)) && (xcr0 & 0x06) == 0x06;
+  osavx512 = osavx && (xcr0 & 0xE0) == 0xE0;
+
+  cpuid(0, 0, regs);
+  if (regs[0] < 7)
+    return caps;
+
+  cpuid(7, 0, regs);
+  if (osavx && (regs[1] & (1u << 5)))     caps |= CPUCAP_AVX2;
+  if (regs[1] & (1u << 29))              caps |= CPUCAP_SHA;
+  if (osavx512 && (regs[1] & (1u << 16))) caps |= CPUCAP_AVX512F;
+  return caps;
+  }
+#endif
+
+unsigned int CPUCAPS_Get(void)
+  {
+#ifdef CPUCAPS_X86
+  /* Detection is idempotent, so a race here only means it's done twice. */
+  static volatile unsigned int caps = 0;
+  static volatile int detected = 0;
+  if (!detected)
+    {
+    caps = cpucaps_detect();
+    detected = 1;
+    }
+  return caps;
+#else
+  return 0;
+#endif
+  }
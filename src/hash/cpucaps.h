@@ -0,0 +1,35 @@
+/*
+ * cpucaps.h - runtime detection of the cpu features used by the hash 
+ * implementations.
+ */
+
+#ifndef HEADER_CPUCAPS_H
+#define HEADER_CPUCAPS_H
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#  define CPUCAPS_X86
+#endif
+
+#define CPUCAP_SSE2     0x00000001
+#define CPUCAP_SSSE3    0x00000002
+#define CPUCAP_SSE41    0x00000004
+#define CPUCAP_PCLMUL   0x00000008
+#define CPUCAP_AVX2     0x00000010
+#define CPUCAP_SHA      0x00000020
+#define CPUCAP_AVX512F  0x00000040
+
+/**
+ * Returns a combination of CPUCAP_* flags supported by the cpu we're running 
+ * on. Always returns 0 on non-x86 platforms.
+ */
+unsigned int CPUCAPS_Get(void);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,172 @@
+/*
+ * crc32.c - crc32 with runtime selection of the implementation.
+ *
+ * The PCLMULQDQ code follows "Fast CRC Computation for Generic Polynomials 
+ * Using PCLMULQDQ Instruction" by V. Gopal et al. (Intel, 2009): four 128-bit
+ * accumulators are folded 64 bytes at a time, then reduced to 128 bits, then
+ * to 32 bits with Barrett reduction. The constants are the bit-reflected ones
+ * for the crc32 polynomial given at the end of the paper.
+ */
+
+#include "crc32.h"
+#include "crc32_table.h"
+#include "../cpucaps.h"
+
+#if defined(CPUCAPS_X86) && (defined(_MSC_VER) || defined(__GNUC__))
+#  define CRC32_CLMUL
+#  include <emmintrin.h>
+#  include <smmintrin.h>
+#  include <wmmintrin.h>
+#  ifdef __GNUC__
+#    define CRC32_CLMUL_TARGET __attribute__((target("sse4.1,pclmul")))
+#  else
+#    define CRC32_CLMUL_TARGET
+#  endif
+#endif
+
+/* Data shorter than this is not worth the setup of the folding loop. */
+#define CRC32_CLMUL_MIN_LEN 64
+
+static unsigned int crc32_slice16(unsigned int crc, const unsigned char *p, size_t len)
+  {
+  unsigned int a, b, c, d;
+
+  while (len >= 16)
+    {
+    a = crc ^ ((unsigned int) p[0] | ((unsigned int) p[1] << 8) | ((unsigned int) p[2] << 16) | ((unsigned int) p[3] << 24));
+    b = (unsigned int) p[4] | ((unsigned int) p[5] << 8) | ((unsigned int) p[6] << 16) | ((unsigned int) p[7] << 24);
+    c = (unsigned int) p[8] | ((unsigned int) p[9] << 8) | ((unsigned int) p[10] << 16) | ((unsigned int) p[11] << 24);
+    d = (unsigned int) p[12] | ((unsigned int) p[13] << 8) | ((unsigned int) p[14] << 16) | ((unsigned int) p[15] << 24);
+    crc = crc32_table[15][a & 0xff] ^ crc32_table[14][(a >> 8) & 0xff] ^
+          crc32_table[13][(a >> 16) & 0xff] ^ crc32_table[12][a >> 24] ^
+          crc32_table[11][b & 0xff] ^ crc32_table[10][(b >> 8) & 0xff] ^
+          crc32_table[9][(b >> 16) & 0xff] ^ crc32_table[8][b >> 24] ^
+          crc32_table[7][c & 0xff] ^ crc32_table[6][(c >> 8) & 0xff] ^
+          crc32_table[5][(c >> 16) & 0xff] ^ crc32_table[4][c >> 24] ^
+          crc32_table[3][d & 0xff] ^ crc32_table[2][(d >> 8) & 0xff] ^
+          crc32_table[1][(d >> 16) & 0xff] ^ crc32_table[0][d >> 24];
+    p += 16;
+    len -= 16;
+    }
+
+  while (len--)
+    crc = (crc >> 8) ^ crc32_table[0][(crc ^ *p++) & 0xff];
+  return crc;
+  }
+
+#ifdef CRC32_CLMUL
+/* Folds len bytes into crc, len must be a multiple of 16 and at least 64. */
+CRC32_CLMUL_TARGET
+static unsigned int crc32_clmul(unsigned int crc, const unsigned char *p, size_t len)
+  {
+  static const unsigned int k1k2[4] = { 0x54442bd4, 0x00000001, 0xc6e41596, 0x00000001 };
+  static const unsigned int k3k4[4] = { 0x751997d0, 0x00000001, 0xccaa009e, 0x00000000 };
+  static const unsigned int k5k0[4] = { 0x63cd6124, 0x00000001, 0x00000000, 0x00000000 };
+  static const unsigned int poly[4] = { 0xdb710641, 0x00000001, 0xf7011641, 0x00000001 };
+  __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, mask;
+
+  x1 = _mm_loadu_si128((const __m128i *) (p + 0x00));
+  x2 = _mm_loadu_si128((const __m128i *) (p + 0x10));
+  x3 = _mm_loadu_si128((const __m128i *) (p + 0x20));
+  x4 = _mm_loadu_si128((const __m128i *) (p + 0x30));
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int) crc));
+  x0 = _mm_loadu_si128((const __m128i *) k1k2);
+  p += 64;
+  len -= 64;
+
+  /* Fold 64 bytes at a time into four accumulators. */
+  while (len >= 64)
+    {
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+    x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+    x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+    x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i *) (p + 0x00)));
+    x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i *) (p + 0x10)));
+    x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i *) (p + 0x20)));
+    x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i *) (p + 0x30)));
+    p += 64;
+    len -= 64;
+    }
+
+  /* Fold the accumulators into one. */
+  x0 = _mm_loadu_si128((const __m128i *) k3k4);
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+  /* Fold the remaining 16-byte blocks. */
+  while (len >= 16)
+    {
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i *) p)), x5);
+    p += 16;
+    len -= 16;
+    }
+
+  /* Reduce 128 bits to 64. */
+  mask = _mm_setr_epi32(~0, 0, ~0, 0);
+  x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+  x0 = _mm_loadu_si128((const __m128i *) k5k0);
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_and_si128(x1, mask);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  /* Barrett reduction to 32 bits. */
+  x0 = _mm_loadu_si128((const __m128i *) poly);
+  x2 = _mm_and_si128(x1, mask);
+  x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+  x2 = _mm_and_si128(x2, mask);
+  x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+  return (unsigned int) _mm_extract_epi32(x1, 1);
+  }
+#endif
+
+int CRC32_Init(CRC32_CTX *c)
+  {
+  c->crc=0xFFFFFFFF;
+  return 1;
+  }
+
+int CRC32_Update(CRC32_CTX *c, const void *data, size_t len)
+  {
+  const unsigned char *p=(const unsigned char *) data;
+#ifdef CRC32_CLMUL
+  const unsigned int needed=CPUCAP_SSE41|CPUCAP_PCLMUL;
+  size_t bulk;
+
+  if (len >= CRC32_CLMUL_MIN_LEN && (CPUCAPS_Get() & needed) == needed)
+    {
+    bulk=len & ~(size_t) 15;
+    c->crc=crc32_clmul(c->crc, p, bulk);
+    p+=bulk;
+    len-=bulk;
+    }
+#endif
+  c->crc=crc32_slice16(c->crc, p, len);
+  return 1;
+  }
+
+int CRC32_Final(unsigned char *md, CRC32_CTX *c)
+  {
+  unsigned int crc=~c->crc;
+  md[0]=(unsigned char) (crc >> 24);
+  md[1]=(unsigned char) (crc >> 16);
+  md[2]=(unsigned char) (crc >> 8);
+  md[3]=(unsigned char) crc;
+  return 1;
+  }
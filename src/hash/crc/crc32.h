@@ -0,0 +1,31 @@
+/*
+ * crc32.h - crc32 as used in .sfv files (reflected polynomial 0xEDB88320).
+ *
+ * On x86 cpus with PCLMULQDQ the bulk of the data is folded with carry-less
+ * multiplication, elsewhere a slicing-by-16 table implementation is used.
+ */
+
+#ifndef HEADER_CRC32_H
+#define HEADER_CRC32_H
+
+#include <stddef.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+#define CRC32_DIGEST_LENGTH 4
+
+typedef struct CRC32state_st
+  {
+  unsigned int crc;
+  } CRC32_CTX;
+
+int CRC32_Init(CRC32_CTX *c);
+int CRC32_Update(CRC32_CTX *c, const void *data, size_t len);
+int CRC32_Final(unsigned char *md, CRC32_CTX *c);
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
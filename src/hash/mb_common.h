@@ -0,0 +1,193 @@
+/*
+ * mb_common.h - message scheduler for the multi-buffer hash functions.
+ *
+ * Every lane hashes its own message. When a lane runs out of data it is 
+ * refilled with the next message, so the lanes stay busy until the very 
+ * last messages. A message is hashed as two segments: the complete blocks
+ * straight from the caller's buffer, then the last partial block with the
+ * padding, which is built in the lane itself.
+ *
+ * The includer defines:
+ *  MB_FUNCTION          name of the function that hashes several messages
+ *  MB_LANES_FUNCTION    name of the function that returns the lane count
+ *  MB_STATE_WORDS       number of 32-bit words in the hash state
+ *  MB_DIGEST_LENGTH     length of the digest
+ *  MB_BIG_ENDIAN        if the hash treats data as big-endian words
+ *  MB_SINGLE(d,n,md)    hashes a single message, used when there's no 
+ *                       multi-buffer kernel for the cpu
+ *  MB_INIT_STATE        array of MB_STATE_WORDS initial state words
+ *  MB_BLOCK_AVX2, MB_BLOCK_AVX512  the kernels
+ *  MB_SCALAR_CAPS       optional, cpu capabilities that make single-stream
+ *                       hashing faster than the 8-lane AVX2 kernel
+ */
+
+#include <string.h>
+
+#ifndef MB_SCALAR_CAPS
+#  define MB_SCALAR_CAPS 0
+#endif
+
+#ifdef MB_X86
+typedef void (*mb_block_fn)(unsigned int *state, const unsigned char *const *data, size_t num);
+
+typedef struct mb_lane_st
+  {
+  size_t msg;                 /* message index, or count if the lane is idle */
+  const unsigned char *p;     /* current position in the segment */
+  size_t blocks;              /* blocks left in the segment */
+  size_t tailBlocks;
+  int inTail;
+  unsigned char tail[128];    /* last partial block with the padding */
+  } MB_LANE;
+
+static int mb_lane_count(void)
+  {
+  unsigned int caps = CPUCAPS_Get();
+  if (caps & CPUCAP_AVX512F)
+    return 16;
+  if ((caps & CPUCAP_AVX2) && !(caps & MB_SCALAR_CAPS))
+    return 8;
+  return 0;
+  }
+
+static void mb_lane_start(MB_LANE *lane, unsigned int *state, int l,
+  const unsigned char *const *d, const size_t *n, size_t *next, size_t count)
+  {
+  size_t len, rem;
+  unsigned long long bits;
+  int i;
+
+  if (*next >= count)
+    {
+    lane->msg = count;
+    return;
+    }
+
+  lane->msg = (*next)++;
+  len = n[lane->msg];
+  rem = len % 64;
+  for (i = 0; i < MB_STATE_WORDS; i++)
+    state[i * MB_LANES_MAX + l] = MB_INIT_STATE[i];
+
+  memset(lane->tail, 0, sizeof(lane->tail));
+  if (rem != 0)
+    memcpy(lane->tail, d[lane->msg] + len - rem, rem);
+  lane->tail[rem] = 0x80;
+  lane->tailBlocks = (rem < 56) ? 1 : 2;
+  bits = (unsigned long long) len << 3;
+  for (i = 0; i < 8; i++)
+#ifdef MB_BIG_ENDIAN
+    lane->tail[lane->tailBlocks * 64 - 1 - i] = (unsigned char) (bits >> (8 * i));
+#else
+    lane->tail[lane->tailBlocks * 64 - 8 + i] = (unsigned char) (bits >> (8 * i));
+#endif
+
+  lane->p = d[lane->msg];
+  lane->blocks = len / 64;
+  lane->inTail = 0;
+  if (lane->blocks == 0)
+    {
+    lane->p = lane->tail;
+    lane->blocks = lane->tailBlocks;
+    lane->inTail = 1;
+    }
+  }
+
+static void mb_lane_finish(MB_LANE *lane, unsigned int *state, int l, unsigned char *const *md)
+  {
+  unsigned char *out = md[lane->msg];
+  unsigned int word;
+  int i;
+
+  for (i = 0; i < MB_STATE_WORDS; i++)
+    {
+    word = state[i * MB_LANES_MAX + l];
+#ifdef MB_BIG_ENDIAN
+    out[4 * i + 0] = (unsigned char) (word >> 24);
+    out[4 * i + 1] = (unsigned char) (word >> 16);
+    out[4 * i + 2] = (unsigned char) (word >> 8);
+    out[4 * i + 3] = (unsigned char) word;
+#else
+    out[4 * i + 0] = (unsigned char) word;
+    out[4 * i + 1] = (unsigned char) (word >> 8);
+    out[4 * i + 2] = (unsigned char) (word >> 16);
+    out[4 * i + 3] = (unsigned char) (word >> 24);
+#endif
+    }
+  }
+#endif /* MB_X86 */
+
+int MB_LANES_FUNCTION(void)
+  {
+#ifdef MB_X86
+  return mb_lane_count();
+#else
+  return 0;
+#endif
+  }
+
+void MB_FUNCTION(const unsigned char *const *d, const size_t *n, unsigned char *const *md, size_t count)
+  {
+#ifdef MB_X86
+  MB_LANE lane[MB_LANES_MAX];
+  unsigned int state[MB_STATE_WORDS * MB_LANES_MAX];
+  const unsigned char *p[MB_LANES_MAX];
+  mb_block_fn block;
+  size_t next = 0, num;
+  int lanes, l, active;
+
+  lanes = mb_lane_count();
+  if (lanes != 0 && count > 1)
+    {
+    block = (lanes == 16) ? MB_BLOCK_AVX512 : MB_BLOCK_AVX2;
+    for (l = 0; l < lanes; l++)
+      mb_lane_start(&lane[l], state, l, d, n, &next, count);
+
+    for (;;)
+      {
+      active = -1;
+      num = 0;
+      for (l = 0; l < lanes; l++)
+        if (lane[l].msg < count && (active < 0 || lane[l].blocks < num))
+          {
+          active = l;
+          num = lane[l].blocks;
+          }
+      if (active < 0)
+        break;
+
+      /* Idle lanes hash garbage, but must be given readable memory. */
+      for (l = 0; l < lanes; l++)
+        p[l] = (lane[l].msg < count) ? lane[l].p : lane[active].p;
+      block(state, p, num);
+
+      for (l = 0; l < lanes; l++)
+        {
+        if (lane[l].msg >= count)
+          continue;
+        lane[l].p += num * 64;
+        lane[l].blocks -= num;
+        if (lane[l].blocks != 0)
+          continue;
+        if (!lane[l].inTail)
+          {
+          lane[l].p = lane[l].tail;
+          lane[l].blocks = lane[l].tailBlocks;
+          lane[l].inTail = 1;
+          }
+        else
+          {
+          mb_lane_finish(&lane[l], state, l, md);
+          mb_lane_start(&lane[l], state, l, d, n, &next, count);
+          }
+        }
+      }
+    return;
+    }
+#endif
+    {
+    size_t i;
+    for (i = 0; i < count; i++)
+      MB_SINGLE(d[i], n[i], md[i]);
+    }
+  }
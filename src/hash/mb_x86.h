@@ -0,0 +1,157 @@
+/*
+ * mb_x86.h - vector primitives for the multi-buffer hash kernels.
+ *
+ * A multi-buffer kernel hashes one block of every lane at once, lane i 
+ * being the i-th 32-bit element of the vectors. Kernels are written once in
+ * terms of the MB_* macros below and compiled for every vector width:
+ * before including a kernel define MB_AVX2 or MB_AVX512 and include this 
+ * file again to get the matching set of macros.
+ */
+
+#ifndef HEADER_MB_X86_H
+#define HEADER_MB_X86_H
+
+#include <stddef.h>
+#include "cpucaps.h"
+
+#if defined(CPUCAPS_X86) && ((defined(_MSC_VER) && _MSC_VER >= 1900) || defined(__GNUC__))
+#  define MB_X86
+#endif
+
+/* Maximal number of lanes, state of lane i is kept at state[word * MB_LANES_MAX + i]. */
+#define MB_LANES_MAX 16
+
+#ifdef MB_X86
+
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#include <immintrin.h>
+
+#ifdef __GNUC__
+#  define MB_TARGET_AVX2    __attribute__((target("avx2")))
+#  define MB_TARGET_AVX512  __attribute__((target("avx512f")))
+#else
+#  define MB_TARGET_AVX2
+#  define MB_TARGET_AVX512
+#endif
+
+/*
+ * Loads 16 bytes of 4 lanes and transposes them, so that out[j] holds the
+ * j-th word of every lane. Words are byte-swapped if bswap is set.
+ */
+MB_TARGET_AVX2
+static void mb_load4(__m128i out[4], const unsigned char *const *p, size_t offset, int bswap)
+  {
+  __m128i a, b, c, d, t0, t1, t2, t3;
+
+  a = _mm_loadu_si128((const __m128i *) (p[0] + offset));
+  b = _mm_loadu_si128((const __m128i *) (p[1] + offset));
+  c = _mm_loadu_si128((const __m128i *) (p[2] + offset));
+  d = _mm_loadu_si128((const __m128i *) (p[3] + offset));
+  t0 = _mm_unpacklo_epi32(a, b);
+  t1 = _mm_unpacklo_epi32(c, d);
+  t2 = _mm_unpackhi_epi32(a, b);
+  t3 = _mm_unpackhi_epi32(c, d);
+  out[0] = _mm_unpacklo_epi64(t0, t1);
+  out[1] = _mm_unpackhi_epi64(t0, t1);
+  out[2] = _mm_unpacklo_epi64(t2, t3);
+  out[3] = _mm_unpackhi_epi64(t2, t3);
+  if (bswap)
+    {
+    __m128i mask = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    out[0] = _mm_shuffle_epi8(out[0], mask);
+    out[1] = _mm_shuffle_epi8(out[1], mask);
+    out[2] = _mm_shuffle_epi8(out[2], mask);
+    out[3] = _mm_shuffle_epi8(out[3], mask);
+    }
+  }
+
+/* Loads a 64-byte block of 8 lanes. */
+MB_TARGET_AVX2
+static void mb_load_avx2(__m256i w[16], const unsigned char *const *p, size_t offset, int bswap)
+  {
+  __m128i lo[4], hi[4];
+  int q, j;
+
+  for (q = 0; q < 4; q++)
+    {
+    mb_load4(lo, p, offset + 16 * q, bswap);
+    mb_load4(hi, p + 4, offset + 16 * q, bswap);
+    for (j = 0; j < 4; j++)
+      w[4 * q + j] = _mm256_inserti128_si256(_mm256_castsi128_si256(lo[j]), hi[j], 1);
+    }
+  }
+
+/* Loads a 64-byte block of 16 lanes. */
+MB_TARGET_AVX512
+static void mb_load_avx512(__m512i w[16], const unsigned char *const *p, size_t offset, int bswap)
+  {
+  __m128i g0[4], g1[4], g2[4], g3[4];
+  int q, j;
+
+  for (q = 0; q < 4; q++)
+    {
+    mb_load4(g0, p, offset + 16 * q, bswap);
+    mb_load4(g1, p + 4, offset + 16 * q, bswap);
+    mb_load4(g2, p + 8, offset + 16 * q, bswap);
+    mb_load4(g3, p + 12, offset + 16 * q, bswap);
+    for (j = 0; j < 4; j++)
+      {
+      __m512i v = _mm512_castsi128_si512(g0[j]);
+      v = _mm512_inserti32x4(v, g1[j], 1);
+      v = _mm512_inserti32x4(v, g2[j], 2);
+      w[4 * q + j] = _mm512_inserti32x4(v, g3[j], 3);
+      }
+    }
+  }
+
+#endif /* MB_X86 */
+
+#endif /* HEADER_MB_X86_H */
+
+/*
+ * Vector macros for the width requested by the includer.
+ */
+#undef MB_LANES
+#undef MB_TARGET
+#undef MB_V
+#undef MB_ADD
+#undef MB_XOR
+#undef MB_AND
+#undef MB_OR
+#undef MB_SET1
+#undef MB_ROL
+#undef MB_LOADU
+#undef MB_STOREU
+#undef MB_LOAD_BLOCK
+#undef MB_TERNARY
+
+#if defined(MB_X86) && defined(MB_AVX2)
+#  define MB_LANES          8
+#  define MB_TARGET         MB_TARGET_AVX2
+#  define MB_V              __m256i
+#  define MB_ADD(a,b)       _mm256_add_epi32((a),(b))
+#  define MB_XOR(a,b)       _mm256_xor_si256((a),(b))
+#  define MB_AND(a,b)       _mm256_and_si256((a),(b))
+#  define MB_OR(a,b)        _mm256_or_si256((a),(b))
+#  define MB_SET1(x)        _mm256_set1_epi32((int) (x))
+#  define MB_ROL(x,n)       _mm256_or_si256(_mm256_slli_epi32((x),(n)), _mm256_srli_epi32((x),32-(n)))
+#  define MB_LOADU(p)       _mm256_loadu_si256((const __m256i *) (p))
+#  define MB_STOREU(p,x)    _mm256_storeu_si256((__m256i *) (p),(x))
+#  define MB_LOAD_BLOCK(w,p,offset,bswap) mb_load_avx2((w),(p),(offset),(bswap))
+#elif defined(MB_X86) && defined(MB_AVX512)
+#  define MB_LANES          16
+#  define MB_TARGET         MB_TARGET_AVX512
+#  define MB_V              __m512i
+#  define MB_ADD(a,b)       _mm512_add_epi32((a),(b))
+#  define MB_XOR(a,b)       _mm512_xor_si512((a),(b))
+#  define MB_AND(a,b)       _mm512_and_si512((a),(b))
+#  define MB_OR(a,b)        _mm512_or_si512((a),(b))
+#  define MB_SET1(x)        _mm512_set1_epi32((int) (x))
+#  define MB_ROL(x,n)       _mm512_rol_epi32((x),(n))
+#  define MB_LOADU(p)       _mm512_loadu_si512((const void *) (p))
+#  define MB_STOREU(p,x)    _mm512_storeu_si512((void *) (p),(x))
+#  define MB_LOAD_BLOCK(w,p,offset,bswap) mb_load_avx512((w),(p),(offset),(bswap))
+/* Any function of 3 arguments, imm is its truth table for a=0xF0, b=0xCC, c=0xAA. */
+#  define MB_TERNARY(a,b,c,imm) _mm512_ternarylogic_epi32((a),(b),(c),(imm))
+#endif
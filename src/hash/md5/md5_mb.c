@@ -0,0 +1,37 @@
+/*
+ * md5_mb.c - multi-buffer md5, see md5_mb.h.
+ */
+
+#include "md5_mb.h"
+#include "md5.h"
+#include "../mb_x86.h"
+
+#ifdef MB_X86
+#  define MB_AVX2
+#  include "../mb_x86.h"
+#  define MD5_MB_KERNEL md5_mb_block_avx2
+#  include "md5_mb_kernel.h"
+#  undef MD5_MB_KERNEL
+#  undef MB_AVX2
+
+#  define MB_AVX512
+#  include "../mb_x86.h"
+#  define MD5_MB_KERNEL md5_mb_block_avx512
+#  include "md5_mb_kernel.h"
+#  undef MD5_MB_KERNEL
+#  undef MB_AVX512
+#endif
+
+static const unsigned int md5_mb_init_state[4] = {
+  0x67452301UL, 0xefcdab89UL, 0x98badcfeUL, 0x10325476UL };
+
+#define MB_FUNCTION         MD5_MB
+#define MB_LANES_FUNCTION   MD5_MB_Lanes
+#define MB_STATE_WORDS      4
+#define MB_DIGEST_LENGTH    MD5_DIGEST_LENGTH
+#define MB_SINGLE(d,n,md)   MD5((d),(n),(md))
+#define MB_INIT_STATE       md5_mb_init_state
+#define MB_BLOCK_AVX2       md5_mb_block_avx2
+#define MB_BLOCK_AVX512     md5_mb_block_avx512
+
+#include "../mb_common.h"
@@ -0,0 +1,26 @@
+/*
+ * md5_mb.h - multi-buffer md5, hashes several independent messages at once
+ * in the lanes of the vector registers.
+ */
+
+#ifndef HEADER_MD5_MB_H
+#define HEADER_MD5_MB_H
+
+#include <stddef.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/* Returns the number of messages hashed at once, 0 if the cpu has no 
+ * suitable vector extensions and MD5_MB falls back to MD5. */
+int MD5_MB_Lanes(void);
+
+/* Computes md[i] = MD5(d[i], n[i]) for i < count. */
+void MD5_MB(const unsigned char *const *d, const size_t *n, unsigned char *const *md, size_t count);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
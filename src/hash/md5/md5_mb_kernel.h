@@ -0,0 +1,124 @@
+/*
+ * md5_mb_kernel.h - multi-buffer md5 block function, included by md5_mb.c
+ * once for every vector width, see ../mb_x86.h.
+ */
+
+#ifdef MB_TERNARY
+#  define MD5_MB_F(b,c,d)  MB_TERNARY((b),(c),(d),0xCA)
+#  define MD5_MB_G(b,c,d)  MB_TERNARY((b),(c),(d),0xE4)
+#  define MD5_MB_H(b,c,d)  MB_TERNARY((b),(c),(d),0x96)
+#  define MD5_MB_I(b,c,d)  MB_TERNARY((b),(c),(d),0x39)
+#else
+#  define MD5_MB_F(b,c,d)  MB_XOR((d), MB_AND((b), MB_XOR((c),(d))))
+#  define MD5_MB_G(b,c,d)  MB_XOR((c), MB_AND((d), MB_XOR((b),(c))))
+#  define MD5_MB_H(b,c,d)  MB_XOR(MB_XOR((b),(c)),(d))
+#  define MD5_MB_I(b,c,d)  MB_XOR((c), MB_OR((b), MB_XOR((d), MB_SET1(0xffffffffUL))))
+#endif
+
+#define MD5_MB_R(f,a,b,c,d,k,s,t) do {  \
+  a=MB_ADD(a, MB_ADD(MB_ADD(X[k], MB_SET1(t)), f((b),(c),(d))));  \
+  a=MB_ADD(MB_ROL(a,s), b);  } while (0)
+
+MB_TARGET
+static void MD5_MB_KERNEL (unsigned int *state, const unsigned char *const *data, size_t num)
+  {
+  MB_V A,B,C,D,AA,BB,CC,DD;
+  MB_V X[16];
+  size_t offset;
+
+  A=MB_LOADU(state + 0 * MB_LANES_MAX);
+  B=MB_LOADU(state + 1 * MB_LANES_MAX);
+  C=MB_LOADU(state + 2 * MB_LANES_MAX);
+  D=MB_LOADU(state + 3 * MB_LANES_MAX);
+
+  for (offset=0; num--; offset+=64)
+    {
+    MB_LOAD_BLOCK(X, data, offset, 0);
+    AA=A; BB=B; CC=C; DD=D;
+
+    /* Round 0 */
+    MD5_MB_R(MD5_MB_F,A,B,C,D, 0, 7,0xd76aa478UL);
+    MD5_MB_R(MD5_MB_F,D,A,B,C, 1,12,0xe8c7b756UL);
+    MD5_MB_R(MD5_MB_F,C,D,A,B, 2,17,0x242070dbUL);
+    MD5_MB_R(MD5_MB_F,B,C,D,A, 3,22,0xc1bdceeeUL);
+    MD5_MB_R(MD5_MB_F,A,B,C,D, 4, 7,0xf57c0fafUL);
+    MD5_MB_R(MD5_MB_F,D,A,B,C, 5,12,0x4787c62aUL);
+    MD5_MB_R(MD5_MB_F,C,D,A,B, 6,17,0xa8304613UL);
+    MD5_MB_R(MD5_MB_F,B,C,D,A, 7,22,0xfd469501UL);
+    MD5_MB_R(MD5_MB_F,A,B,C,D, 8, 7,0x698098d8UL);
+    MD5_MB_R(MD5_MB_F,D,A,B,C, 9,12,0x8b44f7afUL);
+    MD5_MB_R(MD5_MB_F,C,D,A,B,10,17,0xffff5bb1UL);
+    MD5_MB_R(MD5_MB_F,B,C,D,A,11,22,0x895cd7beUL);
+    MD5_MB_R(MD5_MB_F,A,B,C,D,12, 7,0x6b901122UL);
+    MD5_MB_R(MD5_MB_F,D,A,B,C,13,12,0xfd987193UL);
+    MD5_MB_R(MD5_MB_F,C,D,A,B,14,17,0xa679438eUL);
+    MD5_MB_R(MD5_MB_F,B,C,D,A,15,22,0x49b40821UL);
+    /* Round 1 */
+    MD5_MB_R(MD5_MB_G,A,B,C,D, 1, 5,0xf61e2562UL);
+    MD5_MB_R(MD5_MB_G,D,A,B,C, 6, 9,0xc040b340UL);
+    MD5_MB_R(MD5_MB_G,C,D,A,B,11,14,0x265e5a51UL);
+    MD5_MB_R(MD5_MB_G,B,C,D,A, 0,20,0xe9b6c7aaUL);
+    MD5_MB_R(MD5_MB_G,A,B,C,D, 5, 5,0xd62f105dUL);
+    MD5_MB_R(MD5_MB_G,D,A,B,C,10, 9,0x02441453UL);
+    MD5_MB_R(MD5_MB_G,C,D,A,B,15,14,0xd8a1e681UL);
+    MD5_MB_R(MD5_MB_G,B,C,D,A, 4,20,0xe7d3fbc8UL);
+    MD5_MB_R(MD5_MB_G,A,B,C,D, 9, 5,0x21e1cde6UL);
+    MD5_MB_R(MD5_MB_G,D,A,B,C,14, 9,0xc33707d6UL);
+    MD5_MB_R(MD5_MB_G,C,D,A,B, 3,14,0xf4d50d87UL);
+    MD5_MB_R(MD5_MB_G,B,C,D,A, 8,20,0x455a14edUL);
+    MD5_MB_R(MD5_MB_G,A,B,C,D,13, 5,0xa9e3e905UL);
+    MD5_MB_R(MD5_MB_G,D,A,B,C, 2, 9,0xfcefa3f8UL);
+    MD5_MB_R(MD5_MB_G,C,D,A,B, 7,14,0x676f02d9UL);
+    MD5_MB_R(MD5_MB_G,B,C,D,A,12,20,0x8d2a4c8aUL);
+    /* Round 2 */
+    MD5_MB_R(MD5_MB_H,A,B,C,D, 5, 4,0xfffa3942UL);
+    MD5_MB_R(MD5_MB_H,D,A,B,C, 8,11,0x8771f681UL);
+    MD5_MB_R(MD5_MB_H,C,D,A,B,11,16,0x6d9d6122UL);
+    MD5_MB_R(MD5_MB_H,B,C,D,A,14,23,0xfde5380cUL);
+    MD5_MB_R(MD5_MB_H,A,B,C,D, 1, 4,0xa4beea44UL);
+    MD5_MB_R(MD5_MB_H,D,A,B,C, 4,11,0x4bdecfa9UL);
+    MD5_MB_R(MD5_MB_H,C,D,A,B, 7,16,0xf6bb4b60UL);
+    MD5_MB_R(MD5_MB_H,B,C,D,A,10,23,0xbebfbc70UL);
+    MD5_MB_R(MD5_MB_H,A,B,C,D,13, 4,0x289b7ec6UL);
+    MD5_MB_R(MD5_MB_H,D,A,B,C, 0,11,0xeaa127faUL);
+    MD5_MB_R(MD5_MB_H,C,D,A,B, 3,16,0xd4ef3085UL);
+    MD5_MB_R(MD5_MB_H,B,C,D,A, 6,23,0x04881d05UL);
+    MD5_MB_R(MD5_MB_H,A,B,C,D, 9, 4,0xd9d4d039UL);
+    MD5_MB_R(MD5_MB_H,D,A,B,C,12,11,0xe6db99e5UL);
+    MD5_MB_R(MD5_MB_H,C,D,A,B,15,16,0x1fa27cf8UL);
+    MD5_MB_R(MD5_MB_H,B,C,D,A, 2,23,0xc4ac5665UL);
+    /* Round 3 */
+    MD5_MB_R(MD5_MB_I,A,B,C,D, 0, 6,0xf4292244UL);
+    MD5_MB_R(MD5_MB_I,D,A,B,C, 7,10,0x432aff97UL);
+    MD5_MB_R(MD5_MB_I,C,D,A,B,14,15,0xab9423a7UL);
+    MD5_MB_R(MD5_MB_I,B,C,D,A, 5,21,0xfc93a039UL);
+    MD5_MB_R(MD5_MB_I,A,B,C,D,12, 6,0x655b59c3UL);
+    MD5_MB_R(MD5_MB_I,D,A,B,C, 3,10,0x8f0ccc92UL);
+    MD5_MB_R(MD5_MB_I,C,D,A,B,10,15,0xffeff47dUL);
+    MD5_MB_R(MD5_MB_I,B,C,D,A, 1,21,0x85845dd1UL);
+    MD5_MB_R(MD5_MB_I,A,B,C,D, 8, 6,0x6fa87e4fUL);
+    MD5_MB_R(MD5_MB_I,D,A,B,C,15,10,0xfe2ce6e0UL);
+    MD5_MB_R(MD5_MB_I,C,D,A,B, 6,15,0xa3014314UL);
+    MD5_MB_R(MD5_MB_I,B,C,D,A,13,21,0x4e0811a1UL);
+    MD5_MB_R(MD5_MB_I,A,B,C,D, 4, 6,0xf7537e82UL);
+    MD5_MB_R(MD5_MB_I,D,A,B,C,11,10,0xbd3af235UL);
+    MD5_MB_R(MD5_MB_I,C,D,A,B, 2,15,0x2ad7d2bbUL);
+    MD5_MB_R(MD5_MB_I,B,C,D,A, 9,21,0xeb86d391UL);
+
+    A=MB_ADD(A,AA);
+    B=MB_ADD(B,BB);
+    C=MB_ADD(C,CC);
+    D=MB_ADD(D,DD);
+    }
+
+  MB_STOREU(state + 0 * MB_LANES_MAX, A);
+  MB_STOREU(state + 1 * MB_LANES_MAX, B);
+  MB_STOREU(state + 2 * MB_LANES_MAX, C);
+  MB_STOREU(state + 3 * MB_LANES_MAX, D);
+  }
+
+#undef MD5_MB_F
+#undef MD5_MB_G
+#undef MD5_MB_H
+#undef MD5_MB_I
+#undef MD5_MB_R
@@ -0,0 +1,39 @@
+/*
+ * sha1_mb.c - multi-buffer sha1, see sha1_mb.h.
+ */
+
+#include "sha1_mb.h"
+#include "sha.h"
+#include "../mb_x86.h"
+
+#ifdef MB_X86
+#  define MB_AVX2
+#  include "../mb_x86.h"
+#  define SHA1_MB_KERNEL sha1_mb_block_avx2
+#  include "sha1_mb_kernel.h"
+#  undef SHA1_MB_KERNEL
+#  undef MB_AVX2
+
+#  define MB_AVX512
+#  include "../mb_x86.h"
+#  define SHA1_MB_KERNEL sha1_mb_block_avx512
+#  include "sha1_mb_kernel.h"
+#  undef SHA1_MB_KERNEL
+#  undef MB_AVX512
+#endif
+
+static const unsigned int sha1_mb_init_state[5] = {
+  0x67452301UL, 0xefcdab89UL, 0x98badcfeUL, 0x10325476UL, 0xc3d2e1f0UL };
+
+#define MB_FUNCTION         SHA1_MB
+#define MB_LANES_FUNCTION   SHA1_MB_Lanes
+#define MB_STATE_WORDS      5
+#define MB_DIGEST_LENGTH    SHA_DIGEST_LENGTH
+#define MB_BIG_ENDIAN
+#define MB_SINGLE(d,n,md)   SHA1((d),(n),(md))
+#define MB_INIT_STATE       sha1_mb_init_state
+#define MB_BLOCK_AVX2       sha1_mb_block_avx2
+#define MB_BLOCK_AVX512     sha1_mb_block_avx512
+#define MB_SCALAR_CAPS      CPUCAP_SHA
+
+#include "../mb_common.h"
@@ -0,0 +1,26 @@
+/*
+ * sha1_mb.h - multi-buffer sha1, hashes several independent messages at once
+ * in the lanes of the vector registers.
+ */
+
+#ifndef HEADER_SHA1_MB_H
+#define HEADER_SHA1_MB_H
+
+#include <stddef.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/* Returns the number of messages hashed at once, 0 if the cpu has no 
+ * suitable vector extensions and SHA1_MB falls back to SHA1. */
+int SHA1_MB_Lanes(void);
+
+/* Computes md[i] = SHA1(d[i], n[i]) for i < count. */
+void SHA1_MB(const unsigned char *const *d, const size_t *n, unsigned char *const *md, size_t count);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
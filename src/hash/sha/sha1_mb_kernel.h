@@ -0,0 +1,71 @@
+/*
+ * sha1_mb_kernel.h - multi-buffer sha1 block function, included by sha1_mb.c
+ * once for every vector width, see ../mb_x86.h.
+ */
+
+#ifdef MB_TERNARY
+#  define SHA1_MB_F_00_19(b,c,d)  MB_TERNARY((b),(c),(d),0xCA)
+#  define SHA1_MB_F_20_39(b,c,d)  MB_TERNARY((b),(c),(d),0x96)
+#  define SHA1_MB_F_40_59(b,c,d)  MB_TERNARY((b),(c),(d),0xE8)
+#else
+#  define SHA1_MB_F_00_19(b,c,d)  MB_XOR((d), MB_AND((b), MB_XOR((c),(d))))
+#  define SHA1_MB_F_20_39(b,c,d)  MB_XOR(MB_XOR((b),(c)),(d))
+#  define SHA1_MB_F_40_59(b,c,d)  MB_OR(MB_AND((b),(c)), MB_AND(MB_OR((b),(c)),(d)))
+#endif
+#define SHA1_MB_F_60_79(b,c,d)    SHA1_MB_F_20_39(b,c,d)
+
+/* Message schedule is computed in place, X[i&15] holds W[i]. */
+#define SHA1_MB_X(i)  (X[(i)&15] = (i) < 16 ? X[(i)&15] :  \
+  MB_ROL(MB_XOR(MB_XOR(X[((i)+13)&15], X[((i)+8)&15]), MB_XOR(X[((i)+2)&15], X[(i)&15])), 1))
+
+#define SHA1_MB_ROUNDS(from,to,f,k)  \
+  for (i=(from); i<(to); i++)  \
+    {  \
+    T=MB_ADD(MB_ADD(MB_ROL(A,5), f(B,C,D)), MB_ADD(MB_ADD(E, MB_SET1(k)), SHA1_MB_X(i)));  \
+    E=D; D=C; C=MB_ROL(B,30); B=A; A=T;  \
+    }
+
+MB_TARGET
+static void SHA1_MB_KERNEL (unsigned int *state, const unsigned char *const *data, size_t num)
+  {
+  MB_V A,B,C,D,E,T,AA,BB,CC,DD,EE;
+  MB_V X[16];
+  size_t offset;
+  int i;
+
+  A=MB_LOADU(state + 0 * MB_LANES_MAX);
+  B=MB_LOADU(state + 1 * MB_LANES_MAX);
+  C=MB_LOADU(state + 2 * MB_LANES_MAX);
+  D=MB_LOADU(state + 3 * MB_LANES_MAX);
+  E=MB_LOADU(state + 4 * MB_LANES_MAX);
+
+  for (offset=0; num--; offset+=64)
+    {
+    MB_LOAD_BLOCK(X, data, offset, 1);
+    AA=A; BB=B; CC=C; DD=D; EE=E;
+
+    SHA1_MB_ROUNDS( 0,20,SHA1_MB_F_00_19,0x5a827999UL);
+    SHA1_MB_ROUNDS(20,40,SHA1_MB_F_20_39,0x6ed9eba1UL);
+    SHA1_MB_ROUNDS(40,60,SHA1_MB_F_40_59,0x8f1bbcdcUL);
+    SHA1_MB_ROUNDS(60,80,SHA1_MB_F_60_79,0xca62c1d6UL);
+
+    A=MB_ADD(A,AA);
+    B=MB_ADD(B,BB);
+    C=MB_ADD(C,CC);
+    D=MB_ADD(D,DD);
+    E=MB_ADD(E,EE);
+    }
+
+  MB_STOREU(state + 0 * MB_LANES_MAX, A);
+  MB_STOREU(state + 1 * MB_LANES_MAX, B);
+  MB_STOREU(state + 2 * MB_LANES_MAX, C);
+  MB_STOREU(state + 3 * MB_LANES_MAX, D);
+  MB_STOREU(state + 4 * MB_LANES_MAX, E);
+  }
+
+#undef SHA1_MB_F_00_19
+#undef SHA1_MB_F_20_39
+#undef SHA1_MB_F_40_59
+#undef SHA1_MB_F_60_79
+#undef SHA1_MB_X
+#undef SHA1_MB_ROUNDS
@@ -12,6 +12,7 @@
 
 //#include <openssl/crypto.h>
 #include "sha.h"
+#include "sha_x86.h"
 //#include <openssl/opensslv.h>
 
 const char *SHA256_version="SHA-256" /*OPENSSL_VERSION_PTEXT*/;
@@ -311,9 +312,19 @@ static void sha256_block (SHA256_CTX *ctx, const void *in, size_t num, int host)
  * is appreciated:-)
  */
 void HASH_BLOCK_HOST_ORDER (SHA256_CTX *ctx, const void *in, size_t num)
-{   sha256_block (ctx,in,num,1);   }
+{
+#ifdef SHA_X86
+    if (sha256_block_x86 (ctx->h,in,num,1)) return;
+#endif
+    sha256_block (ctx,in,num,1);
+}
 
 void HASH_BLOCK_DATA_ORDER (SHA256_CTX *ctx, const void *in, size_t num)
-{   sha256_block (ctx,in,num,0);   }
+{
+#ifdef SHA_X86
+    if (sha256_block_x86 (ctx->h,in,num,0)) return;
+#endif
+    sha256_block (ctx,in,num,0);
+}
 
 #endif /* OPENSSL_NO_SHA256 */
@@ -61,6 +61,7 @@
 
 //#include <openssl/opensslconf.h>
 #include "sha.h"
+#include "sha_x86.h"
 #include "../../config.h"
 
 #ifndef SHA_LONG_LOG2
@@ -133,6 +134,9 @@
 # endif
   void sha1_block_host_order (SHA_CTX *c, const void *p,size_t num);
   void sha1_block_data_order (SHA_CTX *c, const void *p,size_t num);
+# ifdef SHA_X86
+#  define SHA1_X86_DISPATCH
+# endif
 
 #else
 # error "Either SHA_0 or SHA_1 must be defined."
@@ -242,6 +246,10 @@ void HASH_BLOCK_HOST_ORDER (SHA_CTX *c, const void *d, size_t num)
   SHA_LONG  XX[16];
 #endif
 
+#ifdef SHA1_X86_DISPATCH
+  if (sha1_block_x86(&c->h0,d,num,1)) return;
+#endif
+
   A=c->h0;
   B=c->h1;
   C=c->h2;
@@ -367,6 +375,10 @@ void HASH_BLOCK_DATA_ORDER (SHA_CTX *c, const void *p, size_t num)
   SHA_LONG  XX[16];
 #endif
 
+#ifdef SHA1_X86_DISPATCH
+  if (sha1_block_x86(&c->h0,p,num,0)) return;
+#endif
+
   A=c->h0;
   B=c->h1;
   C=c->h2;
@@ -520,6 +532,10 @@ void HASH_BLOCK_HOST_ORDER (SHA_CTX *c, const void *d, size_t num)
   int i;
   SHA_LONG  X[16];
 
+#ifdef SHA1_X86_DISPATCH
+  if (sha1_block_x86(&c->h0,d,num,1)) return;
+#endif
+
   A=c->h0;
   B=c->h1;
   C=c->h2;
@@ -566,6 +582,10 @@ void HASH_BLOCK_DATA_ORDER (SHA_CTX *c, const void *p, size_t num)
   int i;
   SHA_LONG  X[16];
 
+#ifdef SHA1_X86_DISPATCH
+  if (sha1_block_x86(&c->h0,p,num,0)) return;
+#endif
+
   A=c->h0;
   B=c->h1;
   C=c->h2;
@@ -0,0 +1,521 @@
+/*
+ * sha_x86.c - x86 backends for the sha1 and sha256 block functions.
+ *
+ * sha1_block_x86 and sha256_block_x86 are called by the portable block 
+ * functions and return 0 if there is nothing faster than the portable code
+ * on the cpu we're running on. Otherwise they pick the fastest backend:
+ *
+ *  - SHA extensions (sha1rnds4/sha256rnds2) for both sha1 and sha256;
+ *  - AVX2 for sha256: the message schedule of two blocks is computed at 
+ *    once in the two halves of a ymm register, the rounds are scalar.
+ *
+ * "host" means that the block was already converted to host order words
+ * by md32_common.h, otherwise it's the raw big-endian message.
+ */
+
+#include "sha_x86.h"
+
+#ifdef SHA_X86
+
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#include <smmintrin.h>
+#include <immintrin.h>
+#include "../cpucaps.h"
+
+#ifdef __GNUC__
+#  define SHA_X86_TARGET(x) __attribute__((target(x)))
+#else
+#  define SHA_X86_TARGET(x)
+#endif
+
+/* Reverses the order of bytes in each word. */
+#define SHA_X86_BSWAP_MASK _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3)
+
+/* Reverses the order of words, sha1 instructions want W[0] in the highest one. */
+#define SHA_X86_WSWAP_MASK _mm_set_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12)
+
+/* Reverses the order of all bytes. */
+#define SHA_X86_REVERSE_MASK _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15)
+
+static const SHA_LONG K256[64] = {
+  0x428a2f98UL,0x71374491UL,0xb5c0fbcfUL,0xe9b5dba5UL,
+  0x3956c25bUL,0x59f111f1UL,0x923f82a4UL,0xab1c5ed5UL,
+  0xd807aa98UL,0x12835b01UL,0x243185beUL,0x550c7dc3UL,
+  0x72be5d74UL,0x80deb1feUL,0x9bdc06a7UL,0xc19bf174UL,
+  0xe49b69c1UL,0xefbe4786UL,0x0fc19dc6UL,0x240ca1ccUL,
+  0x2de92c6fUL,0x4a7484aaUL,0x5cb0a9dcUL,0x76f988daUL,
+  0x983e5152UL,0xa831c66dUL,0xb00327c8UL,0xbf597fc7UL,
+  0xc6e00bf3UL,0xd5a79147UL,0x06ca6351UL,0x14292967UL,
+  0x27b70a85UL,0x2e1b2138UL,0x4d2c6dfcUL,0x53380d13UL,
+  0x650a7354UL,0x766a0abbUL,0x81c2c92eUL,0x92722c85UL,
+  0xa2bfe8a1UL,0xa81a664bUL,0xc24b8b70UL,0xc76c51a3UL,
+  0xd192e819UL,0xd6990624UL,0xf40e3585UL,0x106aa070UL,
+  0x19a4c116UL,0x1e376c08UL,0x2748774cUL,0x34b0bcb5UL,
+  0x391c0cb3UL,0x4ed8aa4aUL,0x5b9cca4fUL,0x682e6ff3UL,
+  0x748f82eeUL,0x78a5636fUL,0x84c87814UL,0x8cc70208UL,
+  0x90befffaUL,0xa4506cebUL,0xbef9a3f7UL,0xc67178f2UL };
+
+/*
+ * SHA extensions
+ */
+SHA_X86_TARGET("sse4.1,sha")
+static void sha1_block_shani(SHA_LONG *state, const unsigned char *data, size_t num, int host)
+  {
+  __m128i ABCD, ABCD_SAVE, E0, E0_SAVE, E1;
+  __m128i MSG0, MSG1, MSG2, MSG3;
+  __m128i mask=host ? SHA_X86_WSWAP_MASK : SHA_X86_REVERSE_MASK;
+
+  ABCD = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) state), 0x1B);
+  E0 = _mm_set_epi32((int) state[4], 0, 0, 0);
+
+  while (num--)
+    {
+    ABCD_SAVE = ABCD;
+    E0_SAVE = E0;
+
+    /* Rounds 0-3 */
+    MSG0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 0)), mask);
+    E0 = _mm_add_epi32(E0, MSG0);
+    E1 = ABCD;
+    ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 0);
+
+    /* Rounds 4-7 */
+    MSG1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 16)), mask);
+    E1 = _mm_sha1nexte_epu32(E1, MSG1);
+    E0 = ABCD;
+    ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 0);
+    MSG0 = _mm_sha1msg1_epu32(MSG0, MSG1);
+
+    /* Rounds 8-11 */
+    MSG2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 32)), mask);
+    E0 = _mm_sha1nexte_epu32(E0, MSG2);
+    E1 = ABCD;
+    ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 0);
+    MSG1 = _mm_sha1msg1_epu32(MSG1, MSG2);
+    MSG0 = _mm_xor_si128(MSG0, MSG2);
+
+    /* Rounds 12-15 */
+    MSG3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 48)), mask);
+    E1 = _mm_sha1nexte_epu32(E1, MSG3);
+    E0 = ABCD;
+    MSG0 = _mm_sha1msg2_epu32(MSG0, MSG3);
+    ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 0);
+    MSG2 = _mm_sha1msg1_epu32(MSG2, MSG3);
+    MSG1 = _mm_xor_si128(MSG1, MSG3);
+
+    /* Rounds 16-19 */
+    E0 = _mm_sha1nexte_epu32(E0, MSG0);
+    E1 = ABCD;
+    MSG1 = _mm_sha1msg2_epu32(MSG1, MSG0);
+    ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 0);
+    MSG3 = _mm_sha1msg1_epu32(MSG3, MSG0);
+    MSG2 = _mm_xor_si128(MSG2, MSG0);
+
+    /* Rounds 20-23 */
+    E1 = _mm_sha1nexte_epu32(E1, MSG1);
+    E0 = ABCD;
+    MSG2 = _mm_sha1msg2_epu32(MSG2, MSG1);
+    ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 1);
+    MSG0 = _mm_sha1msg1_epu32(MSG0, MSG1);
+    MSG3 = _mm_xor_si128(MSG3, MSG1);
+
+    /* Rounds 24-27 */
+    E0 = _mm_sha1nexte_epu32(E0, MSG2);
+    E1 = ABCD;
+    MSG3 = _mm_sha1msg2_epu32(MSG3, MSG2);
+    ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 1);
+    MSG1 = _mm_sha1msg1_epu32(MSG1, MSG2);
+    MSG0 = _mm_xor_si128(MSG0, MSG2);
+
+    /* Rounds 28-31 */
+    E1 = _mm_sha1nexte_epu32(E1, MSG3);
+    E0 = ABCD;
+    MSG0 = _mm_sha1msg2_epu32(MSG0, MSG3);
+    ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 1);
+    MSG2 = _mm_sha1msg1_epu32(MSG2, MSG3);
+    MSG1 = _mm_xor_si128(MSG1, MSG3);
+
+    /* Rounds 32-35 */
+    E0 = _mm_sha1nexte_epu32(E0, MSG0);
+    E1 = ABCD;
+    MSG1 = _mm_sha1msg2_epu32(MSG1, MSG0);
+    ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 1);
+    MSG3 = _mm_sha1msg1_epu32(MSG3, MSG0);
+    MSG2 = _mm_xor_si128(MSG2, MSG0);
+
+    /* Rounds 36-39 */
+    E1 = _mm_sha1nexte_epu32(E1, MSG1);
+    E0 = ABCD;
+    MSG2 = _mm_sha1msg2_epu32(MSG2, MSG1);
+    ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 1);
+    MSG0 = _mm_sha1msg1_epu32(MSG0, MSG1);
+    MSG3 = _mm_xor_si128(MSG3, MSG1);
+
+    /* Rounds 40-43 */
+    E0 = _mm_sha1nexte_epu32(E0, MSG2);
+    E1 = ABCD;
+    MSG3 = _mm_sha1msg2_epu32(MSG3, MSG2);
+    ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 2);
+    MSG1 = _mm_sha1msg1_epu32(MSG1, MSG2);
+    MSG0 = _mm_xor_si128(MSG0, MSG2);
+
+    /* Rounds 44-47 */
+    E1 = _mm_sha1nexte_epu32(E1, MSG3);
+    E0 = ABCD;
+    MSG0 = _mm_sha1msg2_epu32(MSG0, MSG3);
+    ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 2);
+    MSG2 = _mm_sha1msg1_epu32(MSG2, MSG3);
+    MSG1 = _mm_xor_si128(MSG1, MSG3);
+
+    /* Rounds 48-51 */
+    E0 = _mm_sha1nexte_epu32(E0, MSG0);
+    E1 = ABCD;
+    MSG1 = _mm_sha1msg2_epu32(MSG1, MSG0);
+    ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 2);
+    MSG3 = _mm_sha1msg1_epu32(MSG3, MSG0);
+    MSG2 = _mm_xor_si128(MSG2, MSG0);
+
+    /* Rounds 52-55 */
+    E1 = _mm_sha1nexte_epu32(E1, MSG1);
+    E0 = ABCD;
+    MSG2 = _mm_sha1msg2_epu32(MSG2, MSG1);
+    ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 2);
+    MSG0 = _mm_sha1msg1_epu32(MSG0, MSG1);
+    MSG3 = _mm_xor_si128(MSG3, MSG1);
+
+    /* Rounds 56-59 */
+    E0 = _mm_sha1nexte_epu32(E0, MSG2);
+    E1 = ABCD;
+    MSG3 = _mm_sha1msg2_epu32(MSG3, MSG2);
+    ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 2);
+    MSG1 = _mm_sha1msg1_epu32(MSG1, MSG2);
+    MSG0 = _mm_xor_si128(MSG0, MSG2);
+
+    /* Rounds 60-63 */
+    E1 = _mm_sha1nexte_epu32(E1, MSG3);
+    E0 = ABCD;
+    MSG0 = _mm_sha1msg2_epu32(MSG0, MSG3);
+    ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 3);
+    MSG2 = _mm_sha1msg1_epu32(MSG2, MSG3);
+    MSG1 = _mm_xor_si128(MSG1, MSG3);
+
+    /* Rounds 64-67 */
+    E0 = _mm_sha1nexte_epu32(E0, MSG0);
+    E1 = ABCD;
+    MSG1 = _mm_sha1msg2_epu32(MSG1, MSG0);
+    ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 3);
+    MSG3 = _mm_sha1msg1_epu32(MSG3, MSG0);
+    MSG2 = _mm_xor_si128(MSG2, MSG0);
+
+    /* Rounds 68-71 */
+    E1 = _mm_sha1nexte_epu32(E1, MSG1);
+    E0 = ABCD;
+    MSG2 = _mm_sha1msg2_epu32(MSG2, MSG1);
+    ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 3);
+    MSG3 = _mm_xor_si128(MSG3, MSG1);
+
+    /* Rounds 72-75 */
+    E0 = _mm_sha1nexte_epu32(E0, MSG2);
+    E1 = ABCD;
+    MSG3 = _mm_sha1msg2_epu32(MSG3, MSG2);
+    ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 3);
+
+    /* Rounds 76-79 */
+    E1 = _mm_sha1nexte_epu32(E1, MSG3);
+    E0 = ABCD;
+    ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 3);
+    E0 = _mm_sha1nexte_epu32(E0, E0_SAVE);
+    ABCD = _mm_add_epi32(ABCD, ABCD_SAVE);
+    data += 64;
+    }
+
+  _mm_storeu_si128((__m128i *) state, _mm_shuffle_epi32(ABCD, 0x1B));
+  state[4] = (SHA_LONG) _mm_extract_epi32(E0, 3);
+  }
+
+SHA_X86_TARGET("sse4.1,sha")
+static void sha256_block_shani(SHA_LONG *state, const unsigned char *data, size_t num, int host)
+  {
+  __m128i STATE0, STATE1, ABEF_SAVE, CDGH_SAVE, MSG, TMP;
+  __m128i MSG0, MSG1, MSG2, MSG3;
+  __m128i mask=host ? _mm_set_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0) : SHA_X86_BSWAP_MASK;
+
+  TMP = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) &state[0]), 0xB1);   /* CDAB */
+  STATE1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) &state[4]), 0x1B); /* EFGH */
+  STATE0 = _mm_alignr_epi8(TMP, STATE1, 8);    /* ABEF */
+  STATE1 = _mm_blend_epi16(STATE1, TMP, 0xF0); /* CDGH */
+
+  while (num--)
+    {
+    ABEF_SAVE = STATE0;
+    CDGH_SAVE = STATE1;
+
+    /* Rounds 0-3 */
+    MSG0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 0)), mask);
+    MSG = _mm_add_epi32(MSG0, _mm_loadu_si128((const __m128i *) (K256 + 0)));
+    STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+    STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, _mm_shuffle_epi32(MSG, 0x0E));
+
+    /* Rounds 4-7 */
+    MSG1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 16)), mask);
+    MSG = _mm_add_epi32(MSG1, _mm_loadu_si128((const __m128i *) (K256 + 4)));
+    STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+    STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, _mm_shuffle_epi32(MSG, 0x0E));
+    MSG0 = _mm_sha256msg1_epu32(MSG0, MSG1);
+
+    /* Rounds 8-11 */
+    MSG2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 32)), mask);
+    MSG = _mm_add_epi32(MSG2, _mm_loadu_si128((const __m128i *) (K256 + 8)));
+    STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+    STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, _mm_shuffle_epi32(MSG, 0x0E));
+    MSG1 = _mm_sha256msg1_epu32(MSG1, MSG2);
+
+    /* Rounds 12-15 */
+    MSG3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 48)), mask);
+    MSG = _mm_add_epi32(MSG3, _mm_loadu_si128((const __m128i *) (K256 + 12)));
+    STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+    MSG0 = _mm_add_epi32(MSG0, _mm_alignr_epi8(MSG3, MSG2, 4));
+    MSG0 = _mm_sha256msg2_epu32(MSG0, MSG3);
+    STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, _mm_shuffle_epi32(MSG, 0x0E));
+    MSG2 = _mm_sha256msg1_epu32(MSG2, MSG3);
+
+    /* Rounds 16-19 */
+    MSG = _mm_add_epi32(MSG0, _mm_loadu_si128((const __m128i *) (K256 + 16)));
+    STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+    MSG1 = _mm_add_epi32(MSG1, _mm_alignr_epi8(MSG0, MSG3, 4));
+    MSG1 = _mm_sha256msg2_epu32(MSG1, MSG0);
+    STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, _mm_shuffle_epi32(MSG, 0x0E));
+    MSG3 = _mm_sha256msg1_epu32(MSG3, MSG0);
+
+    /* Rounds 20-23 */
+    MSG = _mm_add_epi32(MSG1, _mm_loadu_si128((const __m128i *) (K256 + 20)));
+    STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+    MSG2 = _mm_add_epi32(MSG2, _mm_alignr_epi8(MSG1, MSG0, 4));
+    MSG2 = _mm_sha256msg2_epu32(MSG2, MSG1);
+    STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, _mm_shuffle_epi32(MSG, 0x0E));
+    MSG0 = _mm_sha256msg1_epu32(MSG0, MSG1);
+
+    /* Rounds 24-27 */
+    MSG = _mm_add_epi32(MSG2, _mm_loadu_si128((const __m128i *) (K256 + 24)));
+    STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+    MSG3 = _mm_add_epi32(MSG3, _mm_alignr_epi8(MSG2, MSG1, 4));
+    MSG3 = _mm_sha256msg2_epu32(MSG3, MSG2);
+    STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, _mm_shuffle_epi32(MSG, 0x0E));
+    MSG1 = _mm_sha256msg1_epu32(MSG1, MSG2);
+
+    /* Rounds 28-31 */
+    MSG = _mm_add_epi32(MSG3, _mm_loadu_si128((const __m128i *) (K256 + 28)));
+    STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+    MSG0 = _mm_add_epi32(MSG0, _mm_alignr_epi8(MSG3, MSG2, 4));
+    MSG0 = _mm_sha256msg2_epu32(MSG0, MSG3);
+    STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, _mm_shuffle_epi32(MSG, 0x0E));
+    MSG2 = _mm_sha256msg1_epu32(MSG2, MSG3);
+
+    /* Rounds 32-35 */
+    MSG = _mm_add_epi32(MSG0, _mm_loadu_si128((const __m128i *) (K256 + 32)));
+    STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+    MSG1 = _mm_add_epi32(MSG1, _mm_alignr_epi8(MSG0, MSG3, 4));
+    MSG1 = _mm_sha256msg2_epu32(MSG1, MSG0);
+    STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, _mm_shuffle_epi32(MSG, 0x0E));
+    MSG3 = _mm_sha256msg1_epu32(MSG3, MSG0);
+
+    /* Rounds 36-39 */
+    MSG = _mm_add_epi32(MSG1, _mm_loadu_si128((const __m128i *) (K256 + 36)));
+    STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+    MSG2 = _mm_add_epi32(MSG2, _mm_alignr_epi8(MSG1, MSG0, 4));
+    MSG2 = _mm_sha256msg2_epu32(MSG2, MSG1);
+    STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, _mm_shuffle_epi32(MSG, 0x0E));
+    MSG0 = _mm_sha256msg1_epu32(MSG0, MSG1);
+
+    /* Rounds 40-43 */
+    MSG = _mm_add_epi32(MSG2, _mm_loadu_si128((const __m128i *) (K256 + 40)));
+    STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+    MSG3 = _mm_add_epi32(MSG3, _mm_alignr_epi8(MSG2, MSG1, 4));
+    MSG3 = _mm_sha256msg2_epu32(MSG3, MSG2);
+    STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, _mm_shuffle_epi32(MSG, 0x0E));
+    MSG1 = _mm_sha256msg1_epu32(MSG1, MSG2);
+
+    /* Rounds 44-47 */
+    MSG = _mm_add_epi32(MSG3, _mm_loadu_si128((const __m128i *) (K256 + 44)));
+    STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+    MSG0 = _mm_add_epi32(MSG0, _mm_alignr_epi8(MSG3, MSG2, 4));
+    MSG0 = _mm_sha256msg2_epu32(MSG0, MSG3);
+    STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, _mm_shuffle_epi32(MSG, 0x0E));
+    MSG2 = _mm_sha256msg1_epu32(MSG2, MSG3);
+
+    /* Rounds 48-51 */
+    MSG = _mm_add_epi32(MSG0, _mm_loadu_si128((const __m128i *) (K256 + 48)));
+    STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+    MSG1 = _mm_add_epi32(MSG1, _mm_alignr_epi8(MSG0, MSG3, 4));
+    MSG1 = _mm_sha256msg2_epu32(MSG1, MSG0);
+    STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, _mm_shuffle_epi32(MSG, 0x0E));
+    MSG3 = _mm_sha256msg1_epu32(MSG3, MSG0);
+
+    /* Rounds 52-55 */
+    MSG = _mm_add_epi32(MSG1, _mm_loadu_si128((const __m128i *) (K256 + 52)));
+    STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+    MSG2 = _mm_add_epi32(MSG2, _mm_alignr_epi8(MSG1, MSG0, 4));
+    MSG2 = _mm_sha256msg2_epu32(MSG2, MSG1);
+    STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, _mm_shuffle_epi32(MSG, 0x0E));
+
+    /* Rounds 56-59 */
+    MSG = _mm_add_epi32(MSG2, _mm_loadu_si128((const __m128i *) (K256 + 56)));
+    STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+    MSG3 = _mm_add_epi32(MSG3, _mm_alignr_epi8(MSG2, MSG1, 4));
+    MSG3 = _mm_sha256msg2_epu32(MSG3, MSG2);
+    STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, _mm_shuffle_epi32(MSG, 0x0E));
+
+    /* Rounds 60-63 */
+    MSG = _mm_add_epi32(MSG3, _mm_loadu_si128((const __m128i *) (K256 + 60)));
+    STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+    STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, _mm_shuffle_epi32(MSG, 0x0E));
+    STATE0 = _mm_add_epi32(STATE0, ABEF_SAVE);
+    STATE1 = _mm_add_epi32(STATE1, CDGH_SAVE);
+    data += 64;
+    }
+
+  TMP = _mm_shuffle_epi32(STATE0, 0x1B);       /* FEBA */
+  STATE1 = _mm_shuffle_epi32(STATE1, 0xB1);    /* DCHG */
+  STATE0 = _mm_blend_epi16(TMP, STATE1, 0xF0); /* DCBA */
+  STATE1 = _mm_alignr_epi8(STATE1, TMP, 8);    /* ABEF */
+  _mm_storeu_si128((__m128i *) &state[0], STATE0);
+  _mm_storeu_si128((__m128i *) &state[4], STATE1);
+  }
+
+/*
+ * AVX2
+ */
+#define ROTR(x,n)   (((x) >> (n)) | ((x) << (32 - (n))))
+#define Sigma0(x)   (ROTR((x),2) ^ ROTR((x),13) ^ ROTR((x),22))
+#define Sigma1(x)   (ROTR((x),6) ^ ROTR((x),11) ^ ROTR((x),25))
+#define Ch(x,y,z)   (((x) & (y)) ^ ((~(x)) & (z)))
+#define Maj(x,y,z)  (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+
+#define ROUND(i,a,b,c,d,e,f,g,h)  do {  \
+  T1 = (h) + Sigma1(e) + Ch((e),(f),(g)) + wk[i];  \
+  (d) += T1;  \
+  (h) = T1 + Sigma0(a) + Maj((a),(b),(c));  } while (0)
+
+static void sha256_rounds(SHA_LONG *state, const SHA_LONG *wk)
+  {
+  SHA_LONG a,b,c,d,e,f,g,h,T1;
+  int i;
+
+  a = state[0];  b = state[1];  c = state[2];  d = state[3];
+  e = state[4];  f = state[5];  g = state[6];  h = state[7];
+
+  for (i=0;i<64;i+=8)
+    {
+    ROUND(i+0,a,b,c,d,e,f,g,h);
+    ROUND(i+1,h,a,b,c,d,e,f,g);
+    ROUND(i+2,g,h,a,b,c,d,e,f);
+    ROUND(i+3,f,g,h,a,b,c,d,e);
+    ROUND(i+4,e,f,g,h,a,b,c,d);
+    ROUND(i+5,d,e,f,g,h,a,b,c);
+    ROUND(i+6,c,d,e,f,g,h,a,b);
+    ROUND(i+7,b,c,d,e,f,g,h,a);
+    }
+
+  state[0] += a;  state[1] += b;  state[2] += c;  state[3] += d;
+  state[4] += e;  state[5] += f;  state[6] += g;  state[7] += h;
+  }
+
+#define YROTR(x,n)  _mm256_or_si256(_mm256_srli_epi32((x),(n)), _mm256_slli_epi32((x),32-(n)))
+#define YSIGMA0(x)  _mm256_xor_si256(_mm256_xor_si256(YROTR((x),7), YROTR((x),18)), _mm256_srli_epi32((x),3))
+#define YSIGMA1(x)  _mm256_xor_si256(_mm256_xor_si256(YROTR((x),17), YROTR((x),19)), _mm256_srli_epi32((x),10))
+
+/* Stores W+K for the words t..t+3 of both blocks. */
+#define YSTORE(w,t)  do {  \
+  __m256i wk_=_mm256_add_epi32((w), _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) (K256 + (t)))));  \
+  _mm_storeu_si128((__m128i *) (wk[0] + (t)), _mm256_castsi256_si128(wk_));  \
+  _mm_storeu_si128((__m128i *) (wk[1] + (t)), _mm256_extracti128_si256(wk_, 1));  } while (0)
+
+SHA_X86_TARGET("avx2")
+static void sha256_block_avx2(SHA_LONG *state, const unsigned char *data, size_t num, int host)
+  {
+  SHA_LONG wk[2][64];
+  __m256i X0, X1, X2, X3, W, mask;
+  const unsigned char *next;
+  int t;
+
+  mask = _mm256_broadcastsi128_si256(SHA_X86_BSWAP_MASK);
+
+  while (num > 0)
+    {
+    /* With an odd number of blocks the last one goes to both halves. */
+    next = (num > 1) ? data + 64 : data;
+
+    X0 = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) (data + 0))), _mm_loadu_si128((const __m128i *) (next + 0)), 1);
+    X1 = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) (data + 16))), _mm_loadu_si128((const __m128i *) (next + 16)), 1);
+    X2 = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) (data + 32))), _mm_loadu_si128((const __m128i *) (next + 32)), 1);
+    X3 = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) (data + 48))), _mm_loadu_si128((const __m128i *) (next + 48)), 1);
+    if (!host)
+      {
+      X0 = _mm256_shuffle_epi8(X0, mask);
+      X1 = _mm256_shuffle_epi8(X1, mask);
+      X2 = _mm256_shuffle_epi8(X2, mask);
+      X3 = _mm256_shuffle_epi8(X3, mask);
+      }
+    YSTORE(X0, 0);
+    YSTORE(X1, 4);
+    YSTORE(X2, 8);
+    YSTORE(X3, 12);
+
+    /*
+     * W[t..t+3] = sigma1(W[t-2..t+1]) + W[t-7..t-4] + sigma0(W[t-15..t-12]) + W[t-16..t-13].
+     * W[t] and W[t+1] are needed for the upper half of sigma1, so it's 
+     * added in two steps, using sigma1(0) == 0.
+     */
+    for (t=16;t<64;t+=4)
+      {
+      W = _mm256_add_epi32(X0, _mm256_alignr_epi8(X3, X2, 4));
+      W = _mm256_add_epi32(W, YSIGMA0(_mm256_alignr_epi8(X1, X0, 4)));
+      W = _mm256_add_epi32(W, YSIGMA1(_mm256_srli_si256(X3, 8)));
+      W = _mm256_add_epi32(W, YSIGMA1(_mm256_slli_si256(W, 8)));
+      YSTORE(W, t);
+      X0 = X1;
+      X1 = X2;
+      X2 = X3;
+      X3 = W;
+      }
+
+    sha256_rounds(state, wk[0]);
+    if (num == 1)
+      break;
+    sha256_rounds(state, wk[1]);
+    data += 128;
+    num -= 2;
+    }
+  }
+
+/*
+ * Dispatch
+ */
+int sha1_block_x86(SHA_LONG *state, const void *data, size_t num, int host)
+  {
+  if (CPUCAPS_Get() & CPUCAP_SHA)
+    {
+    sha1_block_shani(state, (const unsigned char *) data, num, host);
+    return 1;
+    }
+  return 0;
+  }
+
+int sha256_block_x86(SHA_LONG *state, const void *data, size_t num, int host)
+  {
+  unsigned int caps=CPUCAPS_Get();
+  if (caps & CPUCAP_SHA)
+    {
+    sha256_block_shani(state, (const unsigned char *) data, num, host);
+    return 1;
+    }
+  if (caps & CPUCAP_AVX2)
+    {
+    sha256_block_avx2(state, (const unsigned char *) data, num, host);
+    return 1;
+    }
+  return 0;
+  }
+
+#endif
@@ -0,0 +1,25 @@
+/*
+ * sha_x86.h - x86 backends for the sha1 and sha256 block functions, see
+ * sha_x86.c.
+ */
+
+#ifndef HEADER_SHA_X86_H
+#define HEADER_SHA_X86_H
+
+#include <stddef.h>
+#include "sha.h"
+#include "../cpucaps.h"
+
+#if defined(CPUCAPS_X86) && ((defined(_MSC_VER) && _MSC_VER >= 1900) || defined(__GNUC__))
+#  define SHA_X86
+
+/**
+ * Process num blocks with the fastest backend the cpu supports.
+ * @returns 0 if there is no backend faster than the portable code, and 
+ *   nothing was done.
+ */
+int sha1_block_x86(SHA_LONG *state, const void *data, size_t num, int host);
+int sha256_block_x86(SHA_LONG *state, const void *data, size_t num, int host);
+#endif
+
+#endif
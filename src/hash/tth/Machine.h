@@ -3,7 +3,7 @@
 
 namespace Machine
 {
-#ifndef _WIN64
+#if defined(_MSC_VER) && !defined(_WIN64)
   inline unsigned long long cpuFlags()
   {
     __asm
@@ -19,7 +19,7 @@ namespace Machine
   inline bool SupportsSSE() { return ( cpuFlags() & 0x02000000 ) != 0; }
   inline bool SupportsSSE2() { return ( cpuFlags() & 0x04000000 ) != 0; }
   inline bool SupportsSSE3() { return ( cpuFlags() & 0x100000000 ) != 0; }
-#elif defined _WIN64
+#else
   inline bool SupportsMMX() { return false; }
   inline bool SupportsSSE() { return true; }
   inline bool SupportsSSE2() { return true; }
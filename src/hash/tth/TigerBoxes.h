@@ -22,7 +22,7 @@
 #ifndef TIGERBOXES_H_INCLUDED
 #define TIGERBOXES_H_INCLUDED
 
-typedef unsigned __int64 QWORD;
+typedef unsigned long long QWORD;
 
 namespace
 {
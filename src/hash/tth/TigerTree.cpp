@@ -366,6 +366,68 @@ void CTigerTree::AddToFile(LPCVOID pInput, DWORD nLength)
   }
 }
 
+//////////////////////////////////////////////////////////////////////
+// CTigerTree add a precomputed subtree to the file
+//
+// pValue is the root of nLeafCount leaves as computed by HashLeaves.
+// nLeafCount must be a power of two not greater than the number of leaves
+// per base node, and only the last subtree of the file may be incomplete.
+
+void CTigerTree::AddNodeToFile(const uint64* pValue, DWORD nLeafCount)
+{
+  assert( m_pNode != NULL );
+  assert( m_nBlockPos % nLeafCount == 0 );
+
+  CopyMemory( m_pStackTop->value, pValue, TIGER_SIZE );
+  m_pStackTop ++;
+
+  m_nBlockPos += nLeafCount;
+
+  for ( DWORD nCollapse = m_nBlockPos / nLeafCount ; ! ( nCollapse & 1 ) ; nCollapse >>= 1 )
+  {
+    Collapse();
+  }
+
+  if ( m_nBlockPos >= m_nBlockCount )
+  {
+    BlocksToNode();
+  }
+}
+
+//////////////////////////////////////////////////////////////////////
+// CTigerTree hash a range of leaves into a single node
+//
+// Doesn't touch the tree state, so it may be called from several threads
+// at once.
+
+void CTigerTree::HashLeaves(LPCVOID pInput, DWORD nLength, uint64* pOutput)
+{
+  CTigerNode pStack[ STACK_SIZE ];
+  CTigerNode* pStackTop = pStack;
+  LPBYTE pBlock = (LPBYTE)pInput;
+  DWORD nBlockPos = 0;
+
+  while ( nLength > 0 )
+  {
+    DWORD nBlock = min( nLength, BLOCK_SIZE );
+
+    Tiger( pBlock, (uint64)nBlock, pStackTop->value );
+    pStackTop ++;
+
+    for ( DWORD nCollapse = ++nBlockPos ; ! ( nCollapse & 1 ) ; nCollapse >>= 1 )
+    {
+      Collapse( pStackTop );
+    }
+
+    pBlock += nBlock;
+    nLength -= nBlock;
+  }
+
+  while ( pStackTop - 1 > pStack ) Collapse( pStackTop );
+
+  CopyMemory( pOutput, pStack->value, TIGER_SIZE );
+}
+
 //////////////////////////////////////////////////////////////////////
 // CTigerTree finish file
 
@@ -740,11 +802,16 @@ void CTigerTree::Collapse()
 {
   assert( m_pStackTop - m_pStackBase >= 2 );
 
-  Tiger( NULL, TIGER_SIZE * 2, m_pStackTop->value, m_pStackTop[-2].value, m_pStackTop[-1].value );
+  Collapse( m_pStackTop );
+}
 
-  m_pStackTop -= 2;
-  m_pStackTop[0] = m_pStackTop[2];
-  m_pStackTop ++;
+void CTigerTree::Collapse(CTigerNode*& pStackTop)
+{
+  Tiger( NULL, TIGER_SIZE * 2, pStackTop->value, pStackTop[-2].value, pStackTop[-1].value );
+
+  pStackTop -= 2;
+  pStackTop[0] = pStackTop[2];
+  pStackTop ++;
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -27,7 +27,7 @@
 #include <memory.h>
 #include <stdlib.h>
 
-typedef unsigned long DWORD;
+typedef unsigned int DWORD;
 typedef int BOOL;
 typedef unsigned char BYTE;
 typedef const void *LPCVOID;
@@ -57,11 +57,8 @@ typedef BYTE *LPBYTE;
 #  define CopyMemory(Destination,Source,Length) memcpy((Destination),(Source),(Length))
 #endif
 
-typedef unsigned __int64 uint64;
+typedef unsigned long long uint64;
 typedef unsigned int uint32;
-namespace std {
-  typedef unsigned int size_t;
-}
 
 class CTigerNode;
 
@@ -85,7 +82,10 @@ public:
 public:
   void  BeginFile(DWORD nHeight, uint64 nLength);
   void  AddToFile(const void* pInput, DWORD nLength);
+  void  AddNodeToFile(const uint64* pValue, DWORD nLeafCount);
   BOOL  FinishFile();
+public:
+  void  HashLeaves(const void* pInput, DWORD nLength, uint64* pOutput);
 public:
   void  BeginBlockTest();
   void  AddToTest(const void* pInput, DWORD nLength);
@@ -122,6 +122,7 @@ private:
 // Implementation
 private:
   void  Collapse();
+  void  Collapse(CTigerNode*& pStackTop);
   void  BlocksToNode();
   void  Tiger(LPCVOID pInput, uint64 nInput, uint64* pOutput, uint64* pInput1 = NULL, uint64* pInput2 = NULL);
 };
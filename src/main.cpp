@@ -24,12 +24,48 @@ ANY, PROVIDED HEREUNDER IS PROVIDED "AS IS". THE AUTHOR HAS NO OBLIGATION
 TO PROVIDE MAINTENANCE, SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS.
 
 TODO:
-- linux32 port
-- linux64 port
 - printf output
 - 2ch hash checking
 - faster crc --failed
 
+v1.3.6
+* multithreaded hasher no longer runs hash threads in lockstep, reads ahead 
+  into a ring of buffers instead
++ -j option, hashes several files at once
++ large files are split between several threads when computing tth and ed2k
+* much faster crc32, uses pclmulqdq when the cpu supports it
+* sha1 and sha256 use the sha extensions of x86 cpus, sha256 uses avx2 where
+  they are missing
++ small files are hashed in batches, md5 and sha1 of several files are 
+  computed at once with avx2 / avx-512
+! linux port, files are read with O_DIRECT and posix_fadvise
+* several reads are kept in flight with io_uring on linux, the next file is 
+  read while the previous one is hashed
++ --mmap option, hashes files straight from the page cache
++ --cache option, digests of unchanged files are taken from a cache file
++ --prune option, files not looked up in a run are dropped from the cache
++ --xattr option, digests are kept in extended attributes of the files
+* file list is stored column by column, takes much less memory for large trees
++ --stream option, files are written out as soon as they are hashed
+* directories are read in bulk with getdents64, several at once with -j, 
+  sizes and times of the files are taken in the same pass
+* file masks are compiled once instead of being turned into regular 
+  expressions, masks of the same directory are matched in a single pass
++ --disk-order option, files are read in the order of their extents on disk
++ --per-device option, files of different disks are read in parallel
+* checksum files are parsed without regular expressions, much faster on 
+  large files
++ -j applies to check mode, several files of a checksum file are verified 
+  at once
+* in check mode missing files and files of wrong size are reported before
+  anything is read, files changed after the checksum file are verified first
++ --quick option, only file sizes are checked
+* torrent pieces are verified in parallel with -j, files of a torrent are
+  looked for next to it
+* .torrent files are parsed in place, without decoding them into trees
++ BitTorrent v2 and hybrid torrents are checked against their SHA256 merkle
+  trees
+
 v1.3.5
 ! ported to MSVC2010
 - removed unused files.
@@ -122,20 +158,27 @@ v1.0.0
 #include <boost/array.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
-#include <boost/regex.hpp>
 #include <boost/timer.hpp>
 #include <boost/program_options.hpp>
 #include "arx/Streams.h"
+#include "arx/Converter.h"
 #include "Hash.h"
 #include "ArrayList.h"
+#include "Map.h"
 #include "Options.h"
 #include "Streams.h"
 #include "FileEntry.h"
 #include "Hasher.h"
+#include "AsyncReader.h"
+#include "HashCache.h"
+#include "Scheduler.h"
 #include "Task.h"
 #include "Output.h"
 #include "Torrent.h"
 #include "Checker.h"
+#include "DirectoryWalker.h"
+#include "FileMask.h"
+#include "Test.h"
 
 #ifdef _WIN32
 #  define NOMINMAX
@@ -148,57 +191,34 @@ using namespace boost::algorithm;
 using namespace boost::filesystem;
 using namespace arx;
 
-ArrayList<FileEntry> addToFileList(path dir, wregex fileNameMask, bool isRecursive, ArrayList<FileEntry> fileList) {
-  directory_iterator end;
-  try {
-    for(directory_iterator itr(dir); itr != end; itr++) {
-      if(isRecursive && is_directory(itr->status())) {
-        addToFileList(*itr, fileNameMask, isRecursive, fileList);
-      } else if(is_regular(itr->status())) {
-        if(regex_match(itr->path().filename().wstring(), fileNameMask)) {
-          wstring filePath = (dir / itr->path().filename()).native();
-          if(starts_with(filePath, ".") && !starts_with(filePath, ".."))
-            filePath = filePath.substr(2);
-          fileList.add(FileEntry(filePath));
-        }
-      }
-    }
-  } catch (std::exception &) {
-    // cout << e.what() << endl;
+/**
+ * Splits file path masks into directories and file name masks. Masks of the
+ * same directory are merged, so that it's read only once.
+ */
+Map<wstring, FileMask> groupFileMasks(ArrayList<wstring> filePathMasks) {
+  Map<wstring, FileMask> result;
+  FOREACH(wstring filePathMask, filePathMasks) {
+    path fullPath(filePathMask);
+    path dir = fullPath.branch_path();
+    if(dir.empty())
+      dir = path(_T("."));
+    result[dir.wstring()].add(fullPath.filename().wstring());
   }
-  return fileList;
+  return result;
 }
 
-ArrayList<FileEntry> addToFileList(wstring filePathMask, bool isRecursive, ArrayList<FileEntry> fileList) {
-  path fullPath(filePathMask);
-  path dir = fullPath.branch_path();
-  if(dir.empty())
-    dir = path(_T("."));
-  wstring mask = fullPath.filename().wstring();
-  struct regex_replacement {
-    wregex expression;
-    wstring replacement;
-  };
-  const static regex_replacement replaces[] = {
-    //{regex("\\\\"), "\\\\\\\\"},
-    //{regex("\\|"), "\\\\|"},
-    {wregex(_T("\\.")), _T("\\\\.")},
-    {wregex(_T("\\[")), _T("\\\\[")},
-    {wregex(_T("\\{")), _T("\\\\{")},
-    {wregex(_T("\\(")), _T("\\\\(")},
-    {wregex(_T("\\)")), _T("\\\\)")},
-    {wregex(_T("\\+")), _T("\\\\+")},
-    {wregex(_T("\\^")), _T("\\\\^")},
-    {wregex(_T("\\$")), _T("\\\\$")},
-    {wregex(_T("\\?")), _T(".")},
-    {wregex(_T("\\*")), _T(".*")}
-  };
-  for(int i = 0; i < sizeof(replaces) / sizeof(regex_replacement); i++)
-    mask = regex_replace(mask, replaces[i].expression, replaces[i].replacement);
-  return addToFileList(dir, wregex(mask), isRecursive, fileList);
+Hasher createHasher(optional<Scheduler> scheduler, HasherCallBack callback) {
+  if(options.isPerDevice() && scheduler)
+    return DeviceHasher(options.getHashTask(), options.isMultiThreaded(), *scheduler, callback);
+  else if(options.isPerDevice())
+    return DeviceHasher(options.getHashTask(), options.isMultiThreaded(), callback);
+  else if(scheduler)
+    return Hasher(options.getHashTask(), options.isMultiThreaded(), *scheduler, callback);
+  else
+    return Hasher(options.getHashTask(), options.isMultiThreaded(), callback);
 }
 
-ArrayList<FileEntry> fileList;
+FileTable fileList;
 
 int main(int argc, char** argv) {
   ArrayList<wstring> commandLine;
@@ -212,40 +232,57 @@ int main(int argc, char** argv) {
       commandLine.push_back(lppCommandLine[i]);
   }
 #else
-#  error Not implemented
+  for(int i = 0; i < argc; i++)
+    commandLine.push_back(toWideString(argv[i]));
 #endif
 
   options.parse(commandLine);
 
   changeCinCoutEncoding(options.getInputEncoding(), options.getOutputEncoding());
 
-  FOREACH(wstring fileMask, options.getFileMasks())
-    addToFileList(fileMask, options.isRecursive(), fileList);
+  if(options.isTesting()) {
+    testHashSpeed();
+    if(options.getJobCount() != 1 && !testParallelHashing(options.getJobCount()))
+      return 1;
+    return 0;
+  }
+
+  /* Shards of large files get their own workers, see Hash::setScheduler. */
+  optional<Scheduler> scheduler, shardScheduler;
+  if(options.getJobCount() != 1) {
+    scheduler = Scheduler(options.getJobCount());
+    shardScheduler = Scheduler(options.getJobCount());
+  }
+
+  DirectoryWalker walker(fileList, scheduler);
+  Map<wstring, FileMask> fileMasks = groupFileMasks(options.getFileMasks());
+  for(Map<wstring, FileMask>::iterator i = fileMasks.begin(); i != fileMasks.end(); i++)
+    walker.walk(i->first, i->second, options.isRecursive());
 
   if(options.getFileMasks().empty())
-    fileList.add(FileEntry(_T("-")));
+    fileList.add(_T("-"));
 
   if(options.isUsingFileList()) {
-    ArrayList<FileEntry> newFileList;
+    FileTable newFileList;
     FOREACH(FileEntry file, fileList) {
       Reader reader;
       try {
         reader = createReader(file.getPath(), options.getInputEncoding());
       } catch (...) {
-        wCout << "[error] cannot access file: " << file.getPath() << endl;
+        wCout << "[error] cannot access file: " << file.getPath().wstring() << endl;
         continue;
       }
       Scanner scanner(reader);
       while(!scanner.eof() && !scanner.fail()) {
         wstring fileName;
         getline(scanner, fileName);
-        newFileList.add(FileEntry(fileName));
+        newFileList.add(fileName);
       }
     }
     fileList = newFileList;
   }
 
-  sort(fileList.begin(), fileList.end());
+  fileList.sort();
 
   uint64 sumSize = 0;
   FOREACH(FileEntry file, fileList) {
@@ -255,6 +292,8 @@ int main(int argc, char** argv) {
       time(&lTime);
       file.setDateTime(lTime);
       sumSize += file.getSize();
+    } else if(file.isStatusKnown()) {
+      sumSize += file.getSize();
     } else {
       try {
         file.setSize(file_size(file.getPath()));
@@ -262,25 +301,49 @@ int main(int argc, char** argv) {
         file.setDateTime(last_write_time(file.getPath()));
       } catch (std::exception &) {
         file.setFailed(true);
-        wCout << "[error] cannot access file: " << file.getPath() << endl;
+        wCout << "[error] cannot access file: " << file.getPath().wstring() << endl;
       }
     }
   }
 
+  AsyncReader::setMemoryMapped(options.isMemoryMapped());
+
+  optional<HashCache> cache;
+  if(options.isUsingXattrs())
+    cache = XattrHashCache(options.isRehashing());
+  else if(!options.getCacheFile().empty())
+    cache = HashCache(options.getCacheFile(), options.isRehashing(), options.isPruning());
+
   if(options.isInCheckMode()) {
     Checker checker = Checker(PrinterCheckResultReporter(&wCout));
+    checker.setCache(cache);
+    checker.setScheduler(scheduler);
+    Hash::setScheduler(shardScheduler);
     FOREACH(FileEntry file, fileList)
       checker.check(file.getPath());
+    Hash::setScheduler(none);
   } else {
     HasherCallBack callback;
     if(!options.isQuiet())
       callback = PrinterHasherCallBack(sumSize, &wCout);
-    Hasher hasher(options.getHashTask(), options.isMultiThreaded(), callback);
-    FOREACH(FileEntry file, fileList) 
-      if(!file.isFailed())
-        hasher.hash(file);
-    options.getOutputTask().perform(options.getHashTask(), fileList);
+    if(options.isStreaming()) {
+      options.getOutputTask().begin(options.getHashTask(), fileList);
+      callback = SynchronizedHasherCallBack(OutputHasherCallBack(callback, options.getOutputTask(), options.getHashTask()));
+    }
+    Hash::setScheduler(shardScheduler);
+    Hasher hasher = createHasher(scheduler, callback);
+    hasher.setCache(cache);
+    hasher.setDiskOrdered(options.isDiskOrdered());
+    hasher.hash(fileList);
+    Hash::setScheduler(none);
+    if(options.isStreaming())
+      options.getOutputTask().end();
+    else
+      options.getOutputTask().perform(options.getHashTask(), fileList);
   }
+
+  if(cache)
+    cache->save();
   
   return 0;
 }
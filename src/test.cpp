@@ -3,14 +3,24 @@
 
 #include <iostream>
 #include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
 #include <boost/timer.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
 #include "arx/Streams.h"
 #include "Hash.h"
 #include "Hasher.h"
+#include "Scheduler.h"
+#include "Task.h"
+#include "FileEntry.h"
 
 using namespace arx;
 using namespace std;
 using namespace boost;
+using namespace boost::filesystem;
 
 void testHashSpeed() {
   wCout << "Testing hash speed...\n";
@@ -30,3 +40,143 @@ void testHashSpeed() {
   wCout << "End of test.\n";
   delete[] dataChunk;
 }
+
+namespace {
+  /** Fills the buffer with data that doesn't repeat from one tth leaf or ed2k block to another. */
+  void fillTestData(unsigned char* data, size_t size, uint32& seed) {
+    for(size_t i = 0; i < size; i++) {
+      seed = seed * 1664525 + 1013904223;
+      data[i] = (unsigned char) (seed >> 24);
+    }
+  }
+
+#ifdef ARX_LINUX
+  /**
+   * Resets the peak resident size of the process to the current one.
+   * @returns false if the kernel does not allow that.
+   */
+  bool resetPeakMemory() {
+    std::ofstream file("/proc/self/clear_refs");
+    file << "5";
+    file.close();
+    return !file.fail();
+  }
+
+  /**
+   * @returns the given memory size from /proc/self/status, in bytes.
+   */
+  uint64 getMemoryStatus(const string& name) {
+    std::ifstream file("/proc/self/status");
+    string line;
+    while(getline(file, line)) {
+      if(line.compare(0, name.size() + 1, name + ":") != 0)
+        continue;
+      uint64 size = 0;
+      istringstream(line.substr(name.size() + 1)) >> size;
+      return size * 1024;
+    }
+    return 0;
+  }
+#endif
+
+  ArrayList<FileEntry> createEntries(const ArrayList<wpath>& paths, const ArrayList<uint64>& sizes) {
+    ArrayList<FileEntry> entries;
+    for(uint32 i = 0; i < paths.size(); i++) {
+      FileEntry entry(paths[i]);
+      entry.setSize(sizes[i]);
+      entries.add(entry);
+    }
+    return entries;
+  }
+
+  uint32 countWrongDigests(HashTask task, ArrayList<FileEntry> entries, ArrayList<FileEntry> expected) {
+    uint32 wrongDigests = 0;
+    for(uint32 i = 0; i < entries.size(); i++)
+      for(uint32 id = 0; id < task.size(); id++)
+        if(task.isSet(id) && (entries[i].isFailed() || entries[i].getDigest(id) != expected[i].getDigest(id)))
+          wrongDigests++;
+    return wrongDigests;
+  }
+}
+
+bool testParallelHashing(uint32 jobCount) {
+  wCout << "Testing parallel hashing...\n";
+  Scheduler scheduler(jobCount), shardScheduler(jobCount);
+  HashTask task;
+  task.add(H_ED2K);
+  task.add(H_TTH);
+
+  /* Enough files large enough to be split into shards for every worker to hash one. */
+  uint32 fileCount = 2 * scheduler.getWorkerCount() + 2;
+  ArrayList<wpath> paths;
+  ArrayList<uint64> sizes;
+  ArrayList<FileEntry> expected;
+  /* Data is hashed in chunks of FILEBUFSIZE, tth takes whole leaves only until the end of file. */
+  scoped_array<unsigned char> dataChunk(new unsigned char[FILEBUFSIZE]);
+  uint32 seed = 0;
+  for(uint32 i = 0; i < fileCount; i++) {
+    wpath path = temp_directory_path() / ("arxsum-test-" + lexical_cast<string>(i));
+    uint64 size = PARALLELHASHMINSIZE + i * 1000 + 1;
+    ArrayList<Hash> hashList = task.createHashList(size);
+    std::ofstream file(path.string().c_str(), ios::binary);
+    for(uint64 pos = 0; pos < size; pos += FILEBUFSIZE) {
+      size_t len = (size_t) min<uint64>(FILEBUFSIZE, size - pos);
+      fillTestData(dataChunk.get(), len, seed);
+      file.write((const char*) dataChunk.get(), len);
+      FOREACH(Hash hash, hashList)
+        hash.update(dataChunk.get(), len);
+    }
+    FileEntry entry(path);
+    FOREACH(Hash hash, hashList)
+      entry.setDigest(hash.getId(), hash.finalize());
+    paths.add(path);
+    sizes.add(size);
+    expected.add(entry);
+  }
+
+  bool result = true;
+  Hash::setScheduler(shardScheduler);
+  for(int multiThreaded = 0; multiThreaded < 2; multiThreaded++) {
+    ArrayList<FileEntry> entries = createEntries(paths, sizes);
+    Hasher hasher(task, multiThreaded != 0, scheduler);
+    hasher.hash(entries);
+
+    uint32 wrongDigests = countWrongDigests(task, entries, expected);
+    wCout << "  " << (multiThreaded ? "-m " : "") << "-j " << scheduler.getWorkerCount() << ": ";
+    if(wrongDigests == 0)
+      wCout << "ok\n";
+    else
+      wCout << wrongDigests << " wrong digests\n";
+    result = result && wrongDigests == 0;
+  }
+
+  /* Data waiting for the shard workers is limited by a budget shared by all 
+   * the files, so memory must not grow with the number of files times the 
+   * number of workers. */
+  Scheduler memoryScheduler(max(jobCount, (uint32) TESTMEMORYJOBCOUNT)), memoryShardScheduler(memoryScheduler.getWorkerCount());
+  Hash::setScheduler(memoryShardScheduler);
+  wCout << "  memory with -j " << memoryScheduler.getWorkerCount() << ": ";
+#ifdef ARX_LINUX
+  if(resetPeakMemory()) {
+    uint64 startMemory = getMemoryStatus("VmRSS");
+    ArrayList<FileEntry> entries = createEntries(paths, sizes);
+    Hasher hasher(task, false, memoryScheduler);
+    hasher.hash(entries);
+    uint64 memory = getMemoryStatus("VmHWM") - min(startMemory, getMemoryStatus("VmHWM"));
+    uint64 maxMemory = Hash::getShardBudget(memoryShardScheduler) + (uint64) min(fileCount, memoryScheduler.getWorkerCount()) * TESTMEMORYPERFILE;
+    uint32 wrongDigests = countWrongDigests(task, entries, expected);
+    wCout << memory / (1024 * 1024) << "Mb of " << maxMemory / (1024 * 1024) << "Mb allowed";
+    if(wrongDigests != 0)
+      wCout << ", " << wrongDigests << " wrong digests";
+    wCout << "\n";
+    result = result && memory <= maxMemory && wrongDigests == 0;
+  } else
+#endif
+    wCout << "not measured\n";
+  Hash::setScheduler(none);
+
+  FOREACH(wpath path, paths)
+    remove(path);
+  wCout << "End of test.\n";
+  return result;
+}